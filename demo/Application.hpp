@@ -27,21 +27,30 @@ namespace demo
         return result;
     }
 
-    inline sr::Color fragmentShader(const sr::VertexShaderOutput& input,
-                                    const std::array<const sr::Sampler*, 2>& samplers,
-                                    const std::array<const sr::Texture*, 2>& textures)
+    // the texture is sampled through a binding that is resolved once per frame
+    struct FragmentShader final
     {
-        const auto sampleColor = textures[0]->sample(samplers[0], input.texCoords[0]);
-
-        const sr::Color result{
-            input.color.r * sampleColor.r,
-            input.color.g * sampleColor.g,
-            input.color.b * sampleColor.b,
-            input.color.a * sampleColor.a
-        };
+        sr::Color operator()(const sr::VertexShaderOutput& input,
+                             const sr::Derivatives<sr::VertexShaderOutput>& derivatives,
+                             const std::array<const sr::Sampler*, 2>&,
+                             const std::array<const sr::Texture*, 2>&) const
+        {
+            const auto sampleColor = binding.sample(input.texCoords[0],
+                                                    derivatives.ddx.texCoords[0],
+                                                    derivatives.ddy.texCoords[0]);
+
+            const sr::Color result{
+                input.color.r * sampleColor.r,
+                input.color.g * sampleColor.g,
+                input.color.b * sampleColor.b,
+                input.color.a * sampleColor.a
+            };
+
+            return result;
+        }
 
-        return result;
-    }
+        const sr::SamplerBinding& binding;
+    };
 
     std::string getResourcePath();
 
@@ -96,12 +105,13 @@ namespace demo
             }
         {
             const sr::bmp::Bmp bmp{getResourcePath() + "/cube.bmp"};
-            texture = sr::Texture{sr::PixelFormat::rgba8, bmp.getWidth(), bmp.getHeight()};
+            texture = sr::Texture{sr::PixelFormat::rgba8, bmp.getWidth(), bmp.getHeight(), true};
             texture.setData(bmp.getData(), 0);
+            texture.generateMipMaps();
 
             sampler.addressModeX = sr::Sampler::AddressMode::repeat;
             sampler.addressModeY = sr::Sampler::AddressMode::repeat;
-            sampler.filter = sr::Sampler::Filter::linear;
+            sampler.filter = sr::Sampler::Filter::trilinear;
 
             blendState.colorBlendSource = sr::BlendState::Factor::srcAlpha;
             blendState.colorBlendDest = sr::BlendState::Factor::invSrcAlpha;
@@ -113,6 +123,14 @@ namespace demo
 
             depthState.read = true;
             depthState.write = true;
+
+            renderPass.colorAttachment.texture = &frameBuffer;
+            renderPass.colorAttachment.loadAction = sr::RenderPass::LoadAction::clear;
+            renderPass.colorAttachment.clearColor = sr::Color{255, 255, 255, 255};
+            renderPass.depthAttachment.texture = &depthBuffer;
+            renderPass.depthAttachment.loadAction = sr::RenderPass::LoadAction::clear;
+            renderPass.depthAttachment.storeAction = sr::RenderPass::StoreAction::discard;
+            renderPass.depthAttachment.clearDepth = 1000.0F;
         }
         virtual ~Application() = default;
 
@@ -143,22 +161,20 @@ namespace demo
 
             const auto modelViewProjection = projection * view * model;
 
-            clear(frameBuffer, sr::Color{255, 255, 255, 255});
-            clear(depthBuffer, 1000.0F);
-
-            drawTriangles(frameBuffer,
-                          depthBuffer,
-                          vertexShader,
-                          fragmentShader,
-                          {&sampler, nullptr},
-                          {&texture, nullptr},
-                          viewport,
-                          scissorRect,
-                          blendState,
-                          depthState,
-                          indices,
-                          vertices,
-                          modelViewProjection);
+            const sr::SamplerBinding binding{texture, sampler};
+
+            commandBuffer.setShaders(vertexShader, FragmentShader{binding});
+            commandBuffer.setTextures({&sampler, nullptr}, {&texture, nullptr});
+            commandBuffer.setViewport(viewport);
+            commandBuffer.setScissorRect(scissorRect);
+            commandBuffer.setBlendState(blendState);
+            commandBuffer.setDepthState(depthState);
+            commandBuffer.setRasterizerState(rasterizerState);
+            commandBuffer.drawIndexed(indices, vertices, modelViewProjection);
+
+            // nothing reads the depth after the frame, so it never leaves the tile memory
+            sr::submit(renderPass, commandBuffer);
+            commandBuffer.reset();
         }
         
         const sr::Texture& getFrameBuffer() const noexcept { return frameBuffer; }
@@ -191,6 +207,9 @@ namespace demo
         sr::Rect<float> scissorRect{0.0F, 0.0F, 1.0F, 1.0F};
         sr::BlendState blendState;
         sr::DepthState depthState;
+        sr::RasterizerState rasterizerState;
+        sr::RenderPass renderPass;
+        sr::CommandBuffer commandBuffer;
 
         sr::Sampler sampler;
         sr::Texture texture;
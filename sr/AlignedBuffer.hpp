@@ -0,0 +1,177 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_ALIGNEDBUFFER_HPP
+#define SR_ALIGNEDBUFFER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#if defined(_WIN32)
+#  include <malloc.h>
+#endif
+#if defined(__linux__)
+#  include <sys/mman.h>
+#endif
+
+namespace sr
+{
+    // view of contiguous elements that it does not own
+    template <class T>
+    class Span final
+    {
+    public:
+        constexpr Span() noexcept = default;
+
+        constexpr Span(T* initData, const std::size_t initSize) noexcept:
+            pointer{initData},
+            count{initSize}
+        {
+        }
+
+        constexpr operator Span<const T>() const noexcept { return Span<const T>{pointer, count}; }
+
+        constexpr T* data() const noexcept { return pointer; }
+        constexpr std::size_t size() const noexcept { return count; }
+        constexpr bool empty() const noexcept { return count == 0; }
+
+        constexpr T* begin() const noexcept { return pointer; }
+        constexpr T* end() const noexcept { return pointer + count; }
+
+        constexpr T& operator[](const std::size_t index) const noexcept { return pointer[index]; }
+
+    private:
+        T* pointer = nullptr;
+        std::size_t count = 0;
+    };
+
+    // equal if the elements are equal
+    template <class T, class U>
+    bool operator==(const Span<T>& a, const Span<U>& b) noexcept
+    {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end());
+    }
+
+    template <class T, class U>
+    bool operator!=(const Span<T>& a, const Span<U>& b) noexcept
+    {
+        return !(a == b);
+    }
+
+    // Bytes aligned to a cache line, so that any 64-byte aligned offset into them is safe for aligned SIMD loads
+    // and stores. Allocations of at least 2 MiB are aligned to and backed by huge pages where the operating
+    // system supports them, so that large render targets need fewer TLB entries.
+    class AlignedBuffer final
+    {
+    public:
+        static constexpr std::size_t alignment = 64;
+        static constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+
+        AlignedBuffer() noexcept = default;
+
+        explicit AlignedBuffer(const std::size_t initSize)
+        {
+            allocate(initSize);
+        }
+
+        AlignedBuffer(const AlignedBuffer& other):
+            AlignedBuffer{other.size}
+        {
+            std::copy_n(other.pointer, size, pointer);
+        }
+
+        AlignedBuffer(AlignedBuffer&& other) noexcept:
+            pointer{other.pointer},
+            size{other.size},
+            capacity{other.capacity}
+        {
+            other.pointer = nullptr;
+            other.size = 0;
+            other.capacity = 0;
+        }
+
+        AlignedBuffer& operator=(const AlignedBuffer& other)
+        {
+            if (&other == this) return *this;
+
+            allocate(other.size);
+            std::copy_n(other.pointer, size, pointer);
+            return *this;
+        }
+
+        AlignedBuffer& operator=(AlignedBuffer&& other) noexcept
+        {
+            if (&other == this) return *this;
+
+            release(pointer);
+            pointer = other.pointer;
+            size = other.size;
+            capacity = other.capacity;
+            other.pointer = nullptr;
+            other.size = 0;
+            other.capacity = 0;
+            return *this;
+        }
+
+        ~AlignedBuffer()
+        {
+            release(pointer);
+        }
+
+        std::uint8_t* getData() noexcept { return pointer; }
+        const std::uint8_t* getData() const noexcept { return pointer; }
+        std::size_t getSize() const noexcept { return size; }
+        std::size_t getCapacity() const noexcept { return capacity; }
+
+        // Sets the size, reusing the allocation if it is large enough. The contents are not kept.
+        void allocate(const std::size_t newSize)
+        {
+            if (newSize > capacity)
+            {
+                const auto newAlignment = newSize >= hugePageSize ? hugePageSize : alignment;
+                const auto newCapacity = (newSize + newAlignment - 1) / newAlignment * newAlignment;
+
+                release(pointer);
+                pointer = nullptr;
+                capacity = 0;
+
+#if defined(_WIN32)
+                pointer = static_cast<std::uint8_t*>(_aligned_malloc(newCapacity, newAlignment));
+#else
+                void* result = nullptr;
+                if (posix_memalign(&result, newAlignment, newCapacity) == 0)
+                    pointer = static_cast<std::uint8_t*>(result);
+#endif
+                if (!pointer) throw std::bad_alloc{};
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+                // transparent huge pages, only a hint
+                if (newAlignment == hugePageSize)
+                    madvise(pointer, newCapacity, MADV_HUGEPAGE);
+#endif
+                capacity = newCapacity;
+            }
+
+            size = newSize;
+        }
+
+    private:
+        static void release(std::uint8_t* data) noexcept
+        {
+#if defined(_WIN32)
+            _aligned_free(data);
+#else
+            std::free(data);
+#endif
+        }
+
+        std::uint8_t* pointer = nullptr;
+        std::size_t size = 0;
+        std::size_t capacity = 0;
+    };
+}
+
+#endif
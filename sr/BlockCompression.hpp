@@ -0,0 +1,623 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_BLOCKCOMPRESSION_HPP
+#define SR_BLOCKCOMPRESSION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "PixelFormat.hpp"
+
+namespace sr
+{
+    // 4x4 blocks are decoded to and encoded from 16 rgba8 texels in row-major order
+    using BlockTexels = std::uint8_t[64];
+
+    // expands a 5:6:5 color to 8 bits per channel
+    inline void unpackRGB565(const std::uint32_t color, std::uint8_t* rgb) noexcept
+    {
+        const auto r = (color >> 11) & 0x1FU;
+        const auto g = (color >> 5) & 0x3FU;
+        const auto b = color & 0x1FU;
+        rgb[0] = static_cast<std::uint8_t>((r << 3) | (r >> 2));
+        rgb[1] = static_cast<std::uint8_t>((g << 2) | (g >> 4));
+        rgb[2] = static_cast<std::uint8_t>((b << 3) | (b >> 2));
+    }
+
+    inline std::uint32_t packRGB565(const std::uint8_t* rgb) noexcept
+    {
+        return (((rgb[0] * 31U + 127U) / 255U) << 11) |
+            (((rgb[1] * 63U + 127U) / 255U) << 5) |
+            ((rgb[2] * 31U + 127U) / 255U);
+    }
+
+    // The colors of a BC1 color block, rounded to nearest. If color0 is not greater than color1, the block has
+    // three colors and transparent black, but the color blocks of BC3 always have four colors.
+    inline void getBC1Palette(const std::uint32_t color0,
+                              const std::uint32_t color1,
+                              const bool threeColorMode,
+                              std::uint8_t (&palette)[4][4]) noexcept
+    {
+        unpackRGB565(color0, palette[0]);
+        unpackRGB565(color1, palette[1]);
+
+        for (std::size_t channel = 0; channel < 3; ++channel)
+        {
+            const std::uint32_t value0 = palette[0][channel];
+            const std::uint32_t value1 = palette[1][channel];
+
+            if (threeColorMode)
+            {
+                palette[2][channel] = static_cast<std::uint8_t>((value0 + value1 + 1) / 2);
+                palette[3][channel] = 0;
+            }
+            else
+            {
+                palette[2][channel] = static_cast<std::uint8_t>((value0 * 2 + value1 + 1) / 3);
+                palette[3][channel] = static_cast<std::uint8_t>((value0 + value1 * 2 + 1) / 3);
+            }
+        }
+
+        palette[0][3] = palette[1][3] = palette[2][3] = 255;
+        palette[3][3] = threeColorMode ? 0 : 255;
+    }
+
+    // the values of a BC4 block, rounded to nearest, with 0 and 255 as the last two of the six value mode
+    inline void getBC4Palette(const std::uint32_t value0, const std::uint32_t value1, std::uint8_t (&palette)[8]) noexcept
+    {
+        palette[0] = static_cast<std::uint8_t>(value0);
+        palette[1] = static_cast<std::uint8_t>(value1);
+
+        if (value0 > value1)
+            for (std::uint32_t i = 1; i < 7; ++i)
+                palette[i + 1] = static_cast<std::uint8_t>((value0 * (7 - i) + value1 * i + 3) / 7);
+        else
+        {
+            for (std::uint32_t i = 1; i < 5; ++i)
+                palette[i + 1] = static_cast<std::uint8_t>((value0 * (5 - i) + value1 * i + 2) / 5);
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    inline void decodeBC1Block(const std::uint8_t* block, const bool allowThreeColorMode, BlockTexels& texels) noexcept
+    {
+        const std::uint32_t color0 = block[0] | (block[1] << 8);
+        const std::uint32_t color1 = block[2] | (block[3] << 8);
+        const std::uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<std::uint32_t>(block[7]) << 24);
+
+        std::uint8_t palette[4][4];
+        getBC1Palette(color0, color1, allowThreeColorMode && color0 <= color1, palette);
+
+        for (std::size_t i = 0; i < 16; ++i)
+            std::copy_n(palette[(indices >> (i * 2)) & 0x03U], 4, &texels[i * 4]);
+    }
+
+    // writes the values to the given channel of the texels
+    inline void decodeBC4Block(const std::uint8_t* block, const std::size_t channel, BlockTexels& texels) noexcept
+    {
+        std::uint8_t palette[8];
+        getBC4Palette(block[0], block[1], palette);
+
+        std::uint64_t indices = 0;
+        for (std::size_t i = 0; i < 6; ++i)
+            indices |= static_cast<std::uint64_t>(block[i + 2]) << (i * 8);
+
+        for (std::size_t i = 0; i < 16; ++i)
+            texels[i * 4 + channel] = palette[(indices >> (i * 3)) & 0x07U];
+    }
+
+    // modifiers of the ETC sub-blocks for the pixel indices 0 and 1, the indices 2 and 3 negate them
+    constexpr std::int32_t etcModifiers[8][2]{
+        {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}
+    };
+
+    // distances of the paint colors of the T and H modes of ETC2
+    constexpr std::int32_t etcDistances[8]{3, 6, 11, 16, 23, 32, 41, 64};
+
+    // The ETC2 RGB8 modes: the individual and differential modes of ETC1, and the T, H and planar modes that
+    // ETC2 encodes as the differential mode with red, green or blue out of range.
+    inline void decodeETC2Block(const std::uint8_t* block, BlockTexels& texels) noexcept
+    {
+        std::uint64_t bits = 0;
+        for (std::size_t i = 0; i < 8; ++i)
+            bits = (bits << 8) | block[i];
+
+        const auto getBits = [bits](const std::uint32_t first, const std::uint32_t count) noexcept {
+            return static_cast<std::int32_t>((bits >> first) & ((1U << count) - 1U));
+        };
+        const auto clampChannel = [](const std::int32_t value) noexcept {
+            return static_cast<std::uint8_t>(std::clamp(value, 0, 255));
+        };
+        // the pixel indices are in column-major order, with their high bits above the low bits
+        const auto getPixelIndex = [&getBits](const std::uint32_t x, const std::uint32_t y) noexcept {
+            return (getBits(16 + x * 4 + y, 1) << 1) | getBits(x * 4 + y, 1);
+        };
+        const auto expand4 = [](const std::int32_t value) noexcept { return value * 17; };
+
+        std::int32_t baseColors[2][3];
+        const bool differential = getBits(33, 1) != 0;
+
+        for (std::uint32_t channel = 0; channel < 3; ++channel)
+        {
+            if (!differential)
+            {
+                baseColors[0][channel] = expand4(getBits(60 - channel * 8, 4));
+                baseColors[1][channel] = expand4(getBits(56 - channel * 8, 4));
+                continue;
+            }
+
+            const auto value = getBits(59 - channel * 8, 5);
+            const auto delta = getBits(56 - channel * 8, 3);
+            const auto value1 = value + (delta >= 4 ? delta - 8 : delta);
+
+            if (value1 < 0 || value1 > 31)
+            {
+                std::int32_t paintColors[4][3];
+
+                if (channel == 0) // T mode
+                {
+                    const std::int32_t color0[3]{expand4((getBits(59, 2) << 2) | getBits(56, 2)), expand4(getBits(52, 4)), expand4(getBits(48, 4))};
+                    const std::int32_t color1[3]{expand4(getBits(44, 4)), expand4(getBits(40, 4)), expand4(getBits(36, 4))};
+                    const auto distance = etcDistances[(getBits(34, 2) << 1) | getBits(32, 1)];
+
+                    for (std::size_t c = 0; c < 3; ++c)
+                    {
+                        paintColors[0][c] = color0[c];
+                        paintColors[1][c] = color1[c] + distance;
+                        paintColors[2][c] = color1[c];
+                        paintColors[3][c] = color1[c] - distance;
+                    }
+                }
+                else if (channel == 1) // H mode
+                {
+                    const std::int32_t color0[3]{getBits(59, 4), (getBits(56, 3) << 1) | getBits(52, 1), (getBits(51, 1) << 3) | getBits(47, 3)};
+                    const std::int32_t color1[3]{getBits(43, 4), getBits(39, 4), getBits(35, 4)};
+                    const auto greater = ((color0[0] << 8) | (color0[1] << 4) | color0[2]) >=
+                        ((color1[0] << 8) | (color1[1] << 4) | color1[2]);
+                    const auto distance = etcDistances[(getBits(34, 1) << 2) | (getBits(32, 1) << 1) | (greater ? 1 : 0)];
+
+                    for (std::size_t c = 0; c < 3; ++c)
+                    {
+                        paintColors[0][c] = expand4(color0[c]) + distance;
+                        paintColors[1][c] = expand4(color0[c]) - distance;
+                        paintColors[2][c] = expand4(color1[c]) + distance;
+                        paintColors[3][c] = expand4(color1[c]) - distance;
+                    }
+                }
+                else // planar mode
+                {
+                    const auto expand6 = [](const std::int32_t v) noexcept { return (v << 2) | (v >> 4); };
+                    const auto expand7 = [](const std::int32_t v) noexcept { return (v << 1) | (v >> 6); };
+
+                    const std::int32_t origin[3]{
+                        expand6(getBits(57, 6)),
+                        expand7((getBits(56, 1) << 6) | getBits(49, 6)),
+                        expand6((getBits(48, 1) << 5) | (getBits(43, 2) << 3) | getBits(39, 3))
+                    };
+                    const std::int32_t horizontal[3]{
+                        expand6((getBits(34, 5) << 1) | getBits(32, 1)),
+                        expand7(getBits(25, 7)),
+                        expand6(getBits(19, 6))
+                    };
+                    const std::int32_t vertical[3]{
+                        expand6(getBits(13, 6)),
+                        expand7(getBits(6, 7)),
+                        expand6(getBits(0, 6))
+                    };
+
+                    for (std::int32_t y = 0; y < 4; ++y)
+                        for (std::int32_t x = 0; x < 4; ++x)
+                        {
+                            for (std::size_t c = 0; c < 3; ++c)
+                                texels[(y * 4 + x) * 4 + c] = clampChannel((x * (horizontal[c] - origin[c]) +
+                                                                            y * (vertical[c] - origin[c]) +
+                                                                            4 * origin[c] + 2) >> 2);
+                            texels[(y * 4 + x) * 4 + 3] = 255;
+                        }
+                    return;
+                }
+
+                for (std::uint32_t y = 0; y < 4; ++y)
+                    for (std::uint32_t x = 0; x < 4; ++x)
+                    {
+                        const auto& paintColor = paintColors[getPixelIndex(x, y)];
+                        for (std::size_t c = 0; c < 3; ++c)
+                            texels[(y * 4 + x) * 4 + c] = clampChannel(paintColor[c]);
+                        texels[(y * 4 + x) * 4 + 3] = 255;
+                    }
+                return;
+            }
+
+            baseColors[0][channel] = (value << 3) | (value >> 2);
+            baseColors[1][channel] = (value1 << 3) | (value1 >> 2);
+        }
+
+        const std::int32_t tables[2]{getBits(37, 3), getBits(34, 3)};
+        const bool flip = getBits(32, 1) != 0;
+
+        for (std::uint32_t y = 0; y < 4; ++y)
+            for (std::uint32_t x = 0; x < 4; ++x)
+            {
+                // two 2x4 sub-blocks side by side, or two 4x2 sub-blocks on top of each other if flipped
+                const auto subBlock = flip ? y / 2 : x / 2;
+                const auto pixelIndex = getPixelIndex(x, y);
+                const auto modifier = etcModifiers[tables[subBlock]][pixelIndex & 1];
+                const auto offset = (pixelIndex & 2) ? -modifier : modifier;
+
+                for (std::size_t c = 0; c < 3; ++c)
+                    texels[(y * 4 + x) * 4 + c] = clampChannel(baseColors[subBlock][c] + offset);
+                texels[(y * 4 + x) * 4 + 3] = 255;
+            }
+    }
+
+    inline void decodeBlock(const PixelFormat pixelFormat, const std::uint8_t* block, BlockTexels& texels)
+    {
+        switch (pixelFormat)
+        {
+            case PixelFormat::bc1:
+                decodeBC1Block(block, true, texels);
+                break;
+            case PixelFormat::bc3:
+                decodeBC1Block(block + 8, false, texels);
+                decodeBC4Block(block, 3, texels);
+                break;
+            case PixelFormat::bc4:
+                decodeBC4Block(block, 0, texels);
+                for (std::size_t i = 0; i < 16; ++i)
+                {
+                    texels[i * 4 + 1] = texels[i * 4 + 2] = texels[i * 4];
+                    texels[i * 4 + 3] = 255;
+                }
+                break;
+            case PixelFormat::etc2:
+                decodeETC2Block(block, texels);
+                break;
+            default:
+                throw std::runtime_error{"Invalid pixel format"};
+        }
+    }
+
+    // Decodes the block through a small cache of each thread, so that neighboring samples decode a block once.
+    // The cache is direct-mapped by the address of the block, the version tells apart the contents that a
+    // texture had at the same address before and after its data was changed.
+    inline const std::uint8_t* getDecodedBlock(const PixelFormat pixelFormat,
+                                               const std::uint8_t* block,
+                                               const std::uint64_t version)
+    {
+        struct Entry final
+        {
+            const std::uint8_t* block = nullptr;
+            std::uint64_t version = 0;
+            BlockTexels texels;
+        };
+
+        constexpr std::size_t entryCount = 64;
+        thread_local Entry entries[entryCount];
+
+        // the row above or below a block maps to another entry even if the rows are a multiple of 64 blocks long
+        const auto blockIndex = reinterpret_cast<std::uintptr_t>(block) / getBlockSize(pixelFormat);
+        auto& entry = entries[(blockIndex ^ (blockIndex >> 6)) % entryCount];
+
+        if (entry.block != block || entry.version != version)
+        {
+            decodeBlock(pixelFormat, block, entry.texels);
+            entry.block = block;
+            entry.version = version;
+        }
+
+        return entry.texels;
+    }
+
+    inline std::uint32_t getSquaredDistance(const std::uint8_t* a, const std::uint8_t* b, const std::size_t channelCount) noexcept
+    {
+        std::uint32_t result = 0;
+        for (std::size_t channel = 0; channel < channelCount; ++channel)
+        {
+            const auto difference = static_cast<std::int32_t>(a[channel]) - static_cast<std::int32_t>(b[channel]);
+            result += static_cast<std::uint32_t>(difference * difference);
+        }
+        return result;
+    }
+
+    // The endpoints are the corners of the bounding box of the colors, on the diagonal along which green and
+    // blue vary with red. Texels with alpha below 128 make a BC1 block use transparent black.
+    inline void encodeBC1Block(const BlockTexels& texels, const bool allowTransparency, std::uint8_t* block) noexcept
+    {
+        bool transparent = false;
+        std::uint8_t minColor[3]{255, 255, 255};
+        std::uint8_t maxColor[3]{0, 0, 0};
+        std::int32_t sums[3]{};
+        std::int32_t opaqueCount = 0;
+
+        for (std::size_t i = 0; i < 16; ++i)
+        {
+            if (allowTransparency && texels[i * 4 + 3] < 128)
+            {
+                transparent = true;
+                continue;
+            }
+
+            for (std::size_t channel = 0; channel < 3; ++channel)
+            {
+                minColor[channel] = std::min(minColor[channel], texels[i * 4 + channel]);
+                maxColor[channel] = std::max(maxColor[channel], texels[i * 4 + channel]);
+                sums[channel] += texels[i * 4 + channel];
+            }
+            ++opaqueCount;
+        }
+
+        if (opaqueCount == 0)
+            minColor[0] = minColor[1] = minColor[2] = 0;
+        else
+        {
+            // covariances of red with green and blue, scaled by the number of texels
+            std::int32_t covariances[3]{};
+            for (std::size_t i = 0; i < 16; ++i)
+                if (!allowTransparency || texels[i * 4 + 3] >= 128)
+                    for (std::size_t channel = 1; channel < 3; ++channel)
+                        covariances[channel] += (texels[i * 4] * opaqueCount - sums[0]) *
+                            (texels[i * 4 + channel] * opaqueCount - sums[channel]) / 256;
+
+            for (std::size_t channel = 1; channel < 3; ++channel)
+                if (covariances[channel] < 0) std::swap(minColor[channel], maxColor[channel]);
+        }
+
+        auto color0 = packRGB565(maxColor);
+        auto color1 = packRGB565(minColor);
+
+        // four colors need color0 > color1, three colors and transparent black need color0 <= color1
+        if (transparent ? color0 > color1 : color0 < color1) std::swap(color0, color1);
+        const bool threeColorMode = transparent || color0 == color1;
+
+        std::uint8_t palette[4][4];
+        getBC1Palette(color0, color1, threeColorMode, palette);
+
+        std::uint32_t indices = 0;
+        for (std::size_t i = 0; i < 16; ++i)
+        {
+            std::uint32_t bestIndex = 3;
+
+            if (!transparent || texels[i * 4 + 3] >= 128)
+            {
+                auto bestDistance = std::numeric_limits<std::uint32_t>::max();
+                for (std::uint32_t index = 0; index < (threeColorMode ? 3U : 4U); ++index)
+                {
+                    const auto distance = getSquaredDistance(&texels[i * 4], palette[index], 3);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        bestIndex = index;
+                    }
+                }
+            }
+
+            indices |= bestIndex << (i * 2);
+        }
+
+        block[0] = static_cast<std::uint8_t>(color0);
+        block[1] = static_cast<std::uint8_t>(color0 >> 8);
+        block[2] = static_cast<std::uint8_t>(color1);
+        block[3] = static_cast<std::uint8_t>(color1 >> 8);
+        for (std::size_t i = 0; i < 4; ++i)
+            block[4 + i] = static_cast<std::uint8_t>(indices >> (i * 8));
+    }
+
+    // the endpoints are the extremes of the values of the given channel, in the eight value mode
+    inline void encodeBC4Block(const BlockTexels& texels, const std::size_t channel, std::uint8_t* block) noexcept
+    {
+        std::uint8_t minValue = 255;
+        std::uint8_t maxValue = 0;
+        for (std::size_t i = 0; i < 16; ++i)
+        {
+            minValue = std::min(minValue, texels[i * 4 + channel]);
+            maxValue = std::max(maxValue, texels[i * 4 + channel]);
+        }
+
+        std::uint8_t palette[8];
+        getBC4Palette(maxValue, minValue, palette);
+
+        std::uint64_t indices = 0;
+        for (std::size_t i = 0; i < 16; ++i)
+        {
+            std::uint64_t bestIndex = 0;
+            auto bestDistance = std::numeric_limits<std::uint32_t>::max();
+            for (std::uint32_t index = 0; index < 8; ++index)
+            {
+                const auto distance = getSquaredDistance(&texels[i * 4 + channel], &palette[index], 1);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    bestIndex = index;
+                }
+            }
+
+            indices |= bestIndex << (i * 3);
+        }
+
+        block[0] = maxValue;
+        block[1] = minValue;
+        for (std::size_t i = 0; i < 6; ++i)
+            block[2 + i] = static_cast<std::uint8_t>(indices >> (i * 8));
+    }
+
+    // Encodes ETC1 blocks, which are valid ETC2 blocks: both orientations of the sub-blocks are tried with the
+    // averages of the sub-blocks as their base colors and the best table of modifiers for each of them.
+    inline void encodeETC2Block(const BlockTexels& texels, std::uint8_t* block) noexcept
+    {
+        const auto isInSecondSubBlock = [](const bool flip, const std::uint32_t x, const std::uint32_t y) noexcept {
+            return flip ? y >= 2 : x >= 2;
+        };
+
+        auto bestError = std::numeric_limits<std::uint32_t>::max();
+        std::uint64_t bestBits = 0;
+
+        for (std::uint32_t flipIndex = 0; flipIndex < 2; ++flipIndex)
+        {
+            const bool flip = flipIndex != 0;
+
+            std::uint32_t sums[2][3]{};
+            for (std::uint32_t y = 0; y < 4; ++y)
+                for (std::uint32_t x = 0; x < 4; ++x)
+                    for (std::size_t c = 0; c < 3; ++c)
+                        sums[isInSecondSubBlock(flip, x, y) ? 1 : 0][c] += texels[(y * 4 + x) * 4 + c];
+
+            // the differential mode has more precision, if the base colors are close enough for it
+            std::int32_t quantized[2][3];
+            bool differential = true;
+            for (std::size_t subBlock = 0; subBlock < 2; ++subBlock)
+                for (std::size_t c = 0; c < 3; ++c)
+                    quantized[subBlock][c] = static_cast<std::int32_t>((sums[subBlock][c] * 31 + 255 * 4) / (255 * 8));
+            for (std::size_t c = 0; c < 3; ++c)
+                if (quantized[1][c] - quantized[0][c] < -4 || quantized[1][c] - quantized[0][c] > 3)
+                    differential = false;
+
+            std::int32_t baseColors[2][3];
+            for (std::size_t subBlock = 0; subBlock < 2; ++subBlock)
+                for (std::size_t c = 0; c < 3; ++c)
+                {
+                    if (!differential)
+                        quantized[subBlock][c] = static_cast<std::int32_t>((sums[subBlock][c] * 15 + 255 * 4) / (255 * 8));
+
+                    const auto value = quantized[subBlock][c];
+                    baseColors[subBlock][c] = differential ? (value << 3) | (value >> 2) : value * 17;
+                }
+
+            std::uint64_t bits = 0;
+            if (differential)
+            {
+                for (std::uint32_t c = 0; c < 3; ++c)
+                    bits |= (static_cast<std::uint64_t>(quantized[0][c]) << (59 - c * 8)) |
+                        (static_cast<std::uint64_t>((quantized[1][c] - quantized[0][c]) & 0x07) << (56 - c * 8));
+                bits |= std::uint64_t{1} << 33;
+            }
+            else
+                for (std::uint32_t c = 0; c < 3; ++c)
+                    bits |= (static_cast<std::uint64_t>(quantized[0][c]) << (60 - c * 8)) |
+                        (static_cast<std::uint64_t>(quantized[1][c]) << (56 - c * 8));
+
+            if (flip) bits |= std::uint64_t{1} << 32;
+
+            std::uint32_t error = 0;
+            for (std::uint32_t subBlock = 0; subBlock < 2; ++subBlock)
+            {
+                auto bestTableError = std::numeric_limits<std::uint32_t>::max();
+                std::uint64_t bestTableBits = 0;
+
+                for (std::uint32_t table = 0; table < 8; ++table)
+                {
+                    std::uint32_t tableError = 0;
+                    std::uint64_t tableBits = static_cast<std::uint64_t>(table) << (subBlock == 0 ? 37 : 34);
+
+                    for (std::uint32_t y = 0; y < 4; ++y)
+                        for (std::uint32_t x = 0; x < 4; ++x)
+                        {
+                            if (isInSecondSubBlock(flip, x, y) != (subBlock == 1)) continue;
+
+                            auto bestDistance = std::numeric_limits<std::uint32_t>::max();
+                            std::uint64_t bestIndex = 0;
+                            for (std::uint32_t index = 0; index < 4; ++index)
+                            {
+                                const auto modifier = etcModifiers[table][index & 1];
+                                const auto offset = (index & 2) ? -modifier : modifier;
+
+                                std::uint8_t color[3];
+                                for (std::size_t c = 0; c < 3; ++c)
+                                    color[c] = static_cast<std::uint8_t>(std::clamp(baseColors[subBlock][c] + offset, 0, 255));
+
+                                const auto distance = getSquaredDistance(&texels[(y * 4 + x) * 4], color, 3);
+                                if (distance < bestDistance)
+                                {
+                                    bestDistance = distance;
+                                    bestIndex = index;
+                                }
+                            }
+
+                            tableError += bestDistance;
+                            tableBits |= ((bestIndex >> 1) << (16 + x * 4 + y)) | ((bestIndex & 1) << (x * 4 + y));
+                        }
+
+                    if (tableError < bestTableError)
+                    {
+                        bestTableError = tableError;
+                        bestTableBits = tableBits;
+                    }
+                }
+
+                error += bestTableError;
+                bits |= bestTableBits;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                bestBits = bits;
+            }
+        }
+
+        for (std::size_t i = 0; i < 8; ++i)
+            block[i] = static_cast<std::uint8_t>(bestBits >> (56 - i * 8));
+    }
+
+    inline void encodeBlock(const PixelFormat pixelFormat, const BlockTexels& texels, std::uint8_t* block)
+    {
+        switch (pixelFormat)
+        {
+            case PixelFormat::bc1:
+                encodeBC1Block(texels, true, block);
+                break;
+            case PixelFormat::bc3:
+                encodeBC4Block(texels, 3, block);
+                encodeBC1Block(texels, false, block + 8);
+                break;
+            case PixelFormat::bc4:
+                encodeBC4Block(texels, 0, block);
+                break;
+            case PixelFormat::etc2:
+                encodeETC2Block(texels, block);
+                break;
+            default:
+                throw std::runtime_error{"Invalid pixel format"};
+        }
+    }
+
+    // Encodes an rgba8 image in the linear layout to the blocks of a block-compressed format, for converting
+    // assets offline. BC4 stores the red channel. The partial blocks at the edges repeat the last row and column.
+    inline std::vector<std::uint8_t> encodeBlocks(const PixelFormat pixelFormat,
+                                                  const std::vector<std::uint8_t>& pixels,
+                                                  const std::size_t width,
+                                                  const std::size_t height)
+    {
+        if (!isBlockCompressed(pixelFormat))
+            throw std::runtime_error{"Invalid pixel format"};
+
+        if (pixels.size() != width * height * 4)
+            throw std::runtime_error{"Invalid buffer size"};
+
+        const auto blockSize = getBlockSize(pixelFormat);
+        std::vector<std::uint8_t> result(getDataSize(pixelFormat, width, height));
+        auto block = result.data();
+
+        for (std::size_t blockY = 0; blockY < height; blockY += 4)
+            for (std::size_t blockX = 0; blockX < width; blockX += 4)
+            {
+                BlockTexels texels;
+                for (std::size_t y = 0; y < 4; ++y)
+                    for (std::size_t x = 0; x < 4; ++x)
+                        std::copy_n(&pixels[(std::min(blockY + y, height - 1) * width + std::min(blockX + x, width - 1)) * 4],
+                                    4, &texels[(y * 4 + x) * 4]);
+
+                encodeBlock(pixelFormat, texels, block);
+                block += blockSize;
+            }
+
+        return result;
+    }
+}
+
+#endif
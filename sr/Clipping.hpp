@@ -0,0 +1,136 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_CLIPPING_HPP
+#define SR_CLIPPING_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include "Rect.hpp"
+#include "Shader.hpp"
+#include "Vector.hpp"
+
+namespace sr
+{
+    // planes that the triangles are clipped against: the near plane and the four sides of the guard band
+    constexpr std::size_t clipPlaneCount = 5;
+
+    // every clipping plane can add one vertex to the polygon
+    constexpr std::size_t maxClippedVertexCount = 3 + clipPlaneCount;
+
+    // a position is inside of a plane if its dot product with the plane is not negative
+    using ClipPlanes = std::array<Vector<float, 4>, clipPlaneCount>;
+
+    // The guard band is the region of viewport coordinates in [-guardBand, guardBand]. Triangles inside of it are
+    // only scissored, so it is made as large as the fixed-point edge functions allow and the rare triangles that
+    // reach out of it are the only ones clipped in X and Y.
+    inline ClipPlanes getClipPlanes(const Rect<float>& viewport, const float guardBand) noexcept
+    {
+        const auto halfWidth = viewport.size.v[0] / 2.0F;
+        const auto halfHeight = viewport.size.v[1] / 2.0F;
+
+        // the guard band in normalized device coordinates
+        const auto left = (-guardBand - viewport.position.v[0] - halfWidth) / halfWidth;
+        const auto right = (guardBand - viewport.position.v[0] - halfWidth) / halfWidth;
+        const auto bottom = (-guardBand - viewport.position.v[1] - halfHeight) / halfHeight;
+        const auto top = (guardBand - viewport.position.v[1] - halfHeight) / halfHeight;
+
+        return {
+            Vector<float, 4>{0.0F, 0.0F, 1.0F, 0.0F}, // z >= 0
+            Vector<float, 4>{1.0F, 0.0F, 0.0F, -std::min(left, right)}, // x >= minX * w
+            Vector<float, 4>{-1.0F, 0.0F, 0.0F, std::max(left, right)}, // x <= maxX * w
+            Vector<float, 4>{0.0F, 1.0F, 0.0F, -std::min(bottom, top)}, // y >= minY * w
+            Vector<float, 4>{0.0F, -1.0F, 0.0F, std::max(bottom, top)} // y <= maxY * w
+        };
+    }
+
+    // bits of the view frustum planes that the position is outside of
+    inline std::uint32_t getOutCode(const Vector<float, 4>& position) noexcept
+    {
+        const auto w = position.v[3];
+
+        return (position.v[0] < -w ? 0x01U : 0U) |
+            (position.v[0] > w ? 0x02U : 0U) |
+            (position.v[1] < -w ? 0x04U : 0U) |
+            (position.v[1] > w ? 0x08U : 0U) |
+            (position.v[2] < 0.0F ? 0x10U : 0U) |
+            (position.v[2] > w ? 0x20U : 0U);
+    }
+
+    // members that are not components of the varyings are taken from a
+    template <class T>
+    T interpolate(const T& a, const T& b, const float t) noexcept
+    {
+        const auto componentsA = Varyings<T>::getComponents(a);
+        const auto componentsB = Varyings<T>::getComponents(b);
+
+        std::array<float, Varyings<T>::componentCount> components;
+        for (std::size_t i = 0; i < components.size(); ++i)
+            components[i] = componentsA[i] + (componentsB[i] - componentsA[i]) * t;
+
+        T result = a;
+        result.position = a.position + (b.position - a.position) * t;
+        Varyings<T>::setComponents(result, components);
+        return result;
+    }
+
+    // Culls the triangle against the view frustum and clips it against the planes in clip space.
+    // Returns the number of vertices of the resulting convex polygon (less than 3 if nothing is left of it).
+    template <class T>
+    std::size_t clipTriangle(const std::array<T, 3>& vertices,
+                             const ClipPlanes& planes,
+                             std::array<T, maxClippedVertexCount>& polygon)
+    {
+        if (getOutCode(vertices[0].position) &
+            getOutCode(vertices[1].position) &
+            getOutCode(vertices[2].position))
+            return 0;
+
+        polygon[0] = vertices[0];
+        polygon[1] = vertices[1];
+        polygon[2] = vertices[2];
+        std::size_t vertexCount = 3;
+
+        for (const auto& plane : planes)
+        {
+            std::array<float, maxClippedVertexCount> distances;
+            bool inside = true;
+
+            for (std::size_t i = 0; i < vertexCount; ++i)
+            {
+                distances[i] = plane.dot(polygon[i].position);
+                if (distances[i] < 0.0F) inside = false;
+            }
+
+            if (inside) continue;
+
+            // Sutherland-Hodgman
+            std::array<T, maxClippedVertexCount> clipped;
+            std::size_t clippedCount = 0;
+
+            // a convex polygon crosses a plane at most twice, the bounds checks only guard against rounding errors
+            for (std::size_t i = 0; i < vertexCount && clippedCount < maxClippedVertexCount; ++i)
+            {
+                const auto next = (i + 1) % vertexCount;
+
+                if (distances[i] >= 0.0F)
+                    clipped[clippedCount++] = polygon[i];
+
+                if ((distances[i] >= 0.0F) != (distances[next] >= 0.0F) && clippedCount < maxClippedVertexCount)
+                    clipped[clippedCount++] = interpolate(polygon[i], polygon[next],
+                                                          distances[i] / (distances[i] - distances[next]));
+            }
+
+            if (clippedCount < 3) return 0;
+
+            polygon = clipped;
+            vertexCount = clippedCount;
+        }
+
+        return vertexCount;
+    }
+}
+
+#endif
@@ -0,0 +1,322 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_COMMANDBUFFER_HPP
+#define SR_COMMANDBUFFER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "AlignedBuffer.hpp"
+#include "BlendState.hpp"
+#include "DepthState.hpp"
+#include "Matrix.hpp"
+#include "RasterizerState.hpp"
+#include "Rect.hpp"
+#include "RenderError.hpp"
+#include "Renderer.hpp"
+#include "Sampler.hpp"
+#include "StencilState.hpp"
+#include "Texture.hpp"
+#include "Vertex.hpp"
+
+namespace sr
+{
+    // A draw with the state that was set when it was recorded. The shaders are copied into an allocation that
+    // the draws recorded with them share, whose address identifies them when the draws are sorted by state.
+    struct DrawCommand final
+    {
+        Texture* frameBuffer = nullptr;
+        Texture* depthBuffer = nullptr;
+        Texture* stencilBuffer = nullptr;
+        std::shared_ptr<const void> shaders;
+        // drawTriangles, binTriangles, overlapsTile and rasterizeTile with the types of the shaders, the binned
+        // draw is null if there is nothing to draw
+        void (*draw)(const DrawCommand& command) = nullptr;
+        std::shared_ptr<const void> (*bin)(const DrawCommand& command, Texture& frameBuffer, Texture& depthBuffer) = nullptr;
+        bool (*overlapsTile)(const void* binnedDraw, std::size_t tile) = nullptr;
+        void (*rasterizeTile)(const void* binnedDraw, std::size_t tile, TileMemory* tileMemory) = nullptr;
+        std::array<const Sampler*, 2> samplers{};
+        std::array<const Texture*, 2> textures{};
+        Rect<float> viewport;
+        Rect<float> scissorRect{0.0F, 0.0F, 1.0F, 1.0F};
+        BlendState blendState;
+        DepthState depthState;
+        StencilState stencilState;
+        RasterizerState rasterizerState;
+        Span<const std::size_t> indices;
+        Span<const Vertex> vertices;
+        Matrix<float, 4> modelViewProjection;
+        // range of the depths of the vertices in normalized device coordinates
+        float nearestDepth = 0.0F;
+        float farthestDepth = 0.0F;
+    };
+
+    // Records draws instead of running them, so that submit() can reorder them. The states are set once and apply
+    // to all draws recorded after them, the render targets can be left unset for draws that are submitted in a
+    // render pass. The textures, indices and vertices are referenced, so they have to stay alive and unchanged
+    // until the buffer is submitted. A command buffer is not synchronized, but separate buffers can be recorded
+    // concurrently (e.g. one per thread of a scene traversal).
+    class CommandBuffer final
+    {
+    public:
+        // the stencil buffer can be the depth buffer itself
+        void setRenderTargets(Texture& frameBuffer, Texture& depthBuffer, Texture& stencilBuffer) noexcept
+        {
+            state.frameBuffer = &frameBuffer;
+            state.depthBuffer = &depthBuffer;
+            state.stencilBuffer = &stencilBuffer;
+        }
+
+        void setRenderTargets(Texture& frameBuffer, Texture& depthBuffer) noexcept
+        {
+            setRenderTargets(frameBuffer, depthBuffer, depthBuffer);
+        }
+
+        // the shaders can be any callables that drawTriangles takes, they are copied
+        template <class VertexShaderType, class FragmentShaderType>
+        void setShaders(const VertexShaderType& vertexShader, const FragmentShaderType& fragmentShader)
+        {
+            using Shaders = std::pair<std::decay_t<VertexShaderType>, std::decay_t<FragmentShaderType>>;
+
+            state.shaders = std::make_shared<const Shaders>(vertexShader, fragmentShader);
+            state.draw = [](const DrawCommand& command) {
+                const auto& shaders = *static_cast<const Shaders*>(command.shaders.get());
+
+                drawTriangles(*command.frameBuffer,
+                              *command.depthBuffer,
+                              *command.stencilBuffer,
+                              shaders.first,
+                              shaders.second,
+                              command.samplers,
+                              command.textures,
+                              command.viewport,
+                              command.scissorRect,
+                              command.blendState,
+                              command.depthState,
+                              command.stencilState,
+                              command.rasterizerState,
+                              command.indices,
+                              command.vertices,
+                              command.modelViewProjection);
+            };
+
+            using Draw = BinnedDraw<VertexShaderResult<std::decay_t<VertexShaderType>>, std::decay_t<FragmentShaderType>>;
+
+            state.bin = [](const DrawCommand& command, Texture& frameBuffer, Texture& depthBuffer) {
+                const auto& shaders = *static_cast<const Shaders*>(command.shaders.get());
+
+                auto draw = std::make_shared<Draw>();
+                if (!binTriangles(*draw,
+                                  frameBuffer,
+                                  depthBuffer,
+                                  depthBuffer,
+                                  shaders.first,
+                                  shaders.second,
+                                  command.samplers,
+                                  command.textures,
+                                  command.viewport,
+                                  command.scissorRect,
+                                  command.blendState,
+                                  command.depthState,
+                                  command.stencilState,
+                                  command.rasterizerState,
+                                  command.indices,
+                                  command.vertices,
+                                  command.modelViewProjection))
+                    return std::shared_ptr<const void>{};
+
+                return std::shared_ptr<const void>{std::move(draw)};
+            };
+            state.overlapsTile = [](const void* binnedDraw, const std::size_t tile) noexcept {
+                return sr::overlapsTile(*static_cast<const Draw*>(binnedDraw), tile);
+            };
+            state.rasterizeTile = [](const void* binnedDraw, const std::size_t tile, TileMemory* tileMemory) {
+                sr::rasterizeTile(*static_cast<const Draw*>(binnedDraw), tile, tileMemory);
+            };
+        }
+
+        void setTextures(const std::array<const Sampler*, 2>& samplers,
+                         const std::array<const Texture*, 2>& textures) noexcept
+        {
+            state.samplers = samplers;
+            state.textures = textures;
+        }
+
+        void setViewport(const Rect<float>& viewport) noexcept { state.viewport = viewport; }
+        void setScissorRect(const Rect<float>& scissorRect) noexcept { state.scissorRect = scissorRect; }
+        void setBlendState(const BlendState& blendState) noexcept { state.blendState = blendState; }
+        void setDepthState(const DepthState& depthState) noexcept { state.depthState = depthState; }
+        void setStencilState(const StencilState& stencilState) noexcept { state.stencilState = stencilState; }
+        void setRasterizerState(const RasterizerState& rasterizerState) noexcept { state.rasterizerState = rasterizerState; }
+
+        // Records a draw of indexCount indices from firstIndex, which refer to the vertexCount vertices from
+        // firstVertex. The vertices are transformed by the matrix to find the depth that the draw is sorted by.
+        void drawIndexed(const std::vector<std::size_t>& indices,
+                         const std::size_t firstIndex,
+                         const std::size_t indexCount,
+                         const std::vector<Vertex>& vertices,
+                         const std::size_t firstVertex,
+                         const std::size_t vertexCount,
+                         const Matrix<float, 4>& modelViewProjection)
+        {
+            if (!state.draw)
+                throw RenderError{"Shaders must be set before drawing"};
+
+            if (firstIndex > indices.size() || indexCount > indices.size() - firstIndex)
+                throw RenderError{"Invalid index range"};
+
+            if (firstVertex > vertices.size() || vertexCount > vertices.size() - firstVertex)
+                throw RenderError{"Invalid vertex range"};
+
+            DrawCommand& command = commands.emplace_back(state);
+            command.indices = Span<const std::size_t>{indices.data() + firstIndex, indexCount};
+            command.vertices = Span<const Vertex>{vertices.data() + firstVertex, vertexCount};
+            command.modelViewProjection = modelViewProjection;
+            setDepthRange(command);
+        }
+
+        void drawIndexed(const std::vector<std::size_t>& indices,
+                         const std::vector<Vertex>& vertices,
+                         const Matrix<float, 4>& modelViewProjection)
+        {
+            drawIndexed(indices, 0, indices.size(), vertices, 0, vertices.size(), modelViewProjection);
+        }
+
+        const std::vector<DrawCommand>& getCommands() const noexcept { return commands; }
+
+        // removes the recorded draws and restores the default state
+        void reset() noexcept
+        {
+            commands.clear();
+            state = DrawCommand{};
+        }
+
+    private:
+        // vertices behind the eye make the draw the nearest, because it reaches the near plane
+        static void setDepthRange(DrawCommand& command) noexcept
+        {
+            command.nearestDepth = std::numeric_limits<float>::infinity();
+            command.farthestDepth = -std::numeric_limits<float>::infinity();
+
+            for (const auto& vertex : command.vertices)
+            {
+                const auto position = command.modelViewProjection * vertex.position;
+                if (position.v[3] <= 0.0F)
+                    command.nearestDepth = -std::numeric_limits<float>::infinity();
+                else
+                {
+                    command.nearestDepth = std::min(command.nearestDepth, position.v[2] / position.v[3]);
+                    command.farthestDepth = std::max(command.farthestDepth, position.v[2] / position.v[3]);
+                }
+            }
+        }
+
+        DrawCommand state;
+        std::vector<DrawCommand> commands;
+    };
+
+    // Opaque draws test and write depth without blending or stencil operations, so their order only matters
+    // for pixels of equal depth.
+    inline bool isOpaque(const DrawCommand& command) noexcept
+    {
+        return !command.blendState.enabled &&
+            command.depthState.read && command.depthState.write &&
+            !command.stencilState.enabled;
+    }
+
+    // whether the draw samples one of the render targets of the other draw
+    inline bool samplesRenderTarget(const DrawCommand& command, const DrawCommand& other) noexcept
+    {
+        return std::any_of(command.textures.begin(), command.textures.end(), [&other](const Texture* texture) noexcept {
+            return texture && (texture == other.frameBuffer || texture == other.depthBuffer || texture == other.stencilBuffer);
+        });
+    }
+
+    // whether the ranges of the vertex depths of the draws overlap, so that they can have equal depths
+    inline bool overlapsDepthRange(const DrawCommand& command, const DrawCommand& other) noexcept
+    {
+        return command.nearestDepth <= other.farthestDepth && other.nearestDepth <= command.farthestDepth;
+    }
+
+    // The draws of the command buffers in their order, where every run of consecutive opaque draws into the same
+    // render targets is sorted front-to-back, so that hierarchical Z rejects the triangles behind the nearer
+    // draws, and then by shaders and textures. The depth test passes for equal depths, so a draw is never moved
+    // before an earlier draw whose depth range overlaps its own (e.g. coplanar draws and decals keep their order).
+    // A run ends before a draw that samples its render targets, and the other draws stay in place, so draws
+    // that render to a texture stay before the draws that sample it.
+    inline std::vector<const DrawCommand*> getSortedCommands(const std::vector<const CommandBuffer*>& commandBuffers)
+    {
+        std::vector<const DrawCommand*> commands;
+        for (const auto commandBuffer : commandBuffers)
+            for (const auto& command : commandBuffer->getCommands())
+                commands.push_back(&command);
+
+        // the addresses are only compared for grouping, with std::less because they are not in one array
+        const auto isBefore = [](const DrawCommand* a, const DrawCommand* b) noexcept {
+            const std::less<const void*> less;
+            if (a->nearestDepth != b->nearestDepth) return a->nearestDepth < b->nearestDepth;
+            if (a->shaders != b->shaders) return less(a->shaders.get(), b->shaders.get());
+            if (a->textures[0] != b->textures[0]) return less(a->textures[0], b->textures[0]);
+            return less(a->textures[1], b->textures[1]);
+        };
+
+        std::vector<const DrawCommand*> run;
+        for (auto first = commands.begin(); first != commands.end();)
+        {
+            const auto last = std::find_if(first, commands.end(), [first](const DrawCommand* command) noexcept {
+                return !isOpaque(*command) ||
+                    command->frameBuffer != (*first)->frameBuffer ||
+                    command->depthBuffer != (*first)->depthBuffer ||
+                    samplesRenderTarget(*command, **first);
+            });
+
+            // every draw is inserted before the first draw that sorts after it, but after the draws that it overlaps
+            run.clear();
+            for (auto command = first; command != last; ++command)
+            {
+                auto earliest = run.begin();
+                for (auto other = run.begin(); other != run.end(); ++other)
+                    if (overlapsDepthRange(**command, **other)) earliest = other + 1;
+
+                run.insert(std::find_if(earliest, run.end(), [command, &isBefore](const DrawCommand* other) noexcept {
+                    return isBefore(*command, other);
+                }), *command);
+            }
+            std::copy(run.begin(), run.end(), first);
+
+            first = (last == first) ? first + 1 : last;
+        }
+
+        return commands;
+    }
+
+    // Runs the sorted draws into the render targets that they were recorded with. Every draw runs its triangles
+    // and tiles on the thread pool. Draws whose vertex depths overlap keep their order, because the later one
+    // wins where their depths are equal, but depth formats that round nearby depths to the same value can still
+    // see draws that are close to each other in the other order.
+    inline void submit(const std::vector<const CommandBuffer*>& commandBuffers)
+    {
+        for (const auto command : getSortedCommands(commandBuffers))
+        {
+            if (!command->frameBuffer)
+                throw RenderError{"Render targets must be set before submitting"};
+
+            command->draw(*command);
+        }
+    }
+
+    inline void submit(const CommandBuffer& commandBuffer)
+    {
+        submit(std::vector<const CommandBuffer*>{&commandBuffer});
+    }
+}
+
+#endif
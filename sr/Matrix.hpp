@@ -9,6 +9,7 @@
 #include <array>
 #include <cassert>
 #include <cmath>
+#include "Constants.hpp"
 #include "Vector.hpp"
 
 namespace sr
@@ -5,26 +5,44 @@
 #ifndef SR_PIXELFORMAT_HPP
 #define SR_PIXELFORMAT_HPP
 
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 
 namespace sr
 {
+    // The block-compressed formats store 4x4 pixel blocks in row-major order: BC1 (RGB with 1-bit alpha), BC3
+    // (RGB with BC4 alpha), BC4 (single channel, sampled like r8) and ETC2 RGB8. The depth buffer formats are
+    // float32, depth16 (16-bit unsigned normalized) and d24s8 (24-bit unsigned normalized depth in the low bits
+    // and 8-bit stencil in the high bits of 32-bit pixels). The stencil buffer formats are stencil8 and d24s8.
     enum class PixelFormat
     {
         r8,
         a8,
         rgba8,
-        float32
+        float32,
+        bc1,
+        bc3,
+        bc4,
+        etc2,
+        depth16,
+        d24s8,
+        stencil8
     };
 
+    // bytes of a pixel, 0 for the block-compressed formats
     inline std::size_t getPixelSize(const PixelFormat pixelFormat) noexcept
     {
         switch (pixelFormat)
         {
         case PixelFormat::r8:
         case PixelFormat::a8:
+        case PixelFormat::stencil8:
             return sizeof(std::uint8_t) * 1;
+        case PixelFormat::depth16:
+            return sizeof(std::uint16_t);
         case PixelFormat::rgba8:
+        case PixelFormat::d24s8:
             return sizeof(std::uint8_t) * 4;
         case PixelFormat::float32:
             return sizeof(float);
@@ -32,6 +50,75 @@ namespace sr
             return 0;
         }
     }
+
+    inline bool isDepthFormat(const PixelFormat pixelFormat) noexcept
+    {
+        return pixelFormat == PixelFormat::float32 ||
+            pixelFormat == PixelFormat::depth16 ||
+            pixelFormat == PixelFormat::d24s8;
+    }
+
+    inline bool isStencilFormat(const PixelFormat pixelFormat) noexcept
+    {
+        return pixelFormat == PixelFormat::stencil8 || pixelFormat == PixelFormat::d24s8;
+    }
+
+    // byte of the stencil inside of a pixel of a stencil buffer format, the pixels of d24s8 are little-endian
+    constexpr std::size_t getStencilOffset(const PixelFormat pixelFormat) noexcept
+    {
+        return pixelFormat == PixelFormat::d24s8 ? 3 : 0;
+    }
+
+    // the stored value of depth 1 of the unsigned normalized depth formats, 0 for the others
+    constexpr std::uint32_t getDepthMax(const PixelFormat pixelFormat) noexcept
+    {
+        return pixelFormat == PixelFormat::depth16 ? 0xFFFFU :
+            pixelFormat == PixelFormat::d24s8 ? 0xFFFFFFU : 0U;
+    }
+
+    // The depth as the value that a depth buffer of the format stores, which is what the depth tests compare:
+    // the depth itself for float32 and the integer (exact in a float) rounded to nearest even for the unsigned
+    // normalized formats. Adding 0.5 and truncating would overflow the 24 bits of d24s8 at depth 1, because the
+    // sum is not representable. The SIMD kernels evaluate the same expression.
+    inline float quantizeDepth(const PixelFormat pixelFormat, const float depth) noexcept
+    {
+        const auto depthMax = getDepthMax(pixelFormat);
+        if (depthMax == 0) return depth;
+
+        // NaN becomes 0
+        const auto clamped = depth > 0.0F ? (depth < 1.0F ? depth : 1.0F) : 0.0F;
+        return std::nearbyint(clamped * static_cast<float>(depthMax));
+    }
+
+    // bytes of a 4x4 block, 0 for the uncompressed formats
+    inline std::size_t getBlockSize(const PixelFormat pixelFormat) noexcept
+    {
+        switch (pixelFormat)
+        {
+        case PixelFormat::bc1:
+        case PixelFormat::bc4:
+        case PixelFormat::etc2:
+            return 8;
+        case PixelFormat::bc3:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    inline bool isBlockCompressed(const PixelFormat pixelFormat) noexcept
+    {
+        return getBlockSize(pixelFormat) > 0;
+    }
+
+    // bytes of an image of the given size, the blocks of the block-compressed formats cover partial blocks
+    inline std::size_t getDataSize(const PixelFormat pixelFormat, const std::size_t width, const std::size_t height) noexcept
+    {
+        if (isBlockCompressed(pixelFormat))
+            return ((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(pixelFormat);
+
+        return width * height * getPixelSize(pixelFormat);
+    }
 }
 
 #endif
@@ -0,0 +1,887 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_PIXELKERNELS_HPP
+#define SR_PIXELKERNELS_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include "BlendState.hpp"
+#include "Color.hpp"
+#include "DepthState.hpp"
+#include "RenderError.hpp"
+#include "Sampler.hpp"
+#include "Shader.hpp"
+#include "Simd.hpp"
+#include "StencilState.hpp"
+#include "Texture.hpp"
+#include "TriangleSetup.hpp"
+
+namespace sr
+{
+    // render targets, states and the fragment shader (any callable) shared by all pixels of a draw call
+    template <class FragmentShaderType>
+    struct PixelPipeline final
+    {
+        std::uint32_t* frameBufferData;
+        std::size_t frameBufferWidth;
+        std::size_t frameBufferSampleStride; // pixels between the planes of the samples
+        void* depthBufferData;
+        std::size_t depthBufferWidth;
+        std::size_t depthBufferSampleStride;
+        PixelFormat depthBufferFormat;
+        std::uint8_t* stencilBufferData; // the stencil of the first pixel, null if the stencil test is disabled
+        std::size_t stencilBufferWidth;
+        std::size_t stencilBufferSampleStride;
+        std::size_t stencilPixelSize;
+        const FragmentShaderType& fragmentShader;
+        const std::array<const Sampler*, 2>& samplers;
+        const std::array<const Texture*, 2>& textures;
+        const BlendState& blendState;
+        const DepthState& depthState;
+        const StencilState& stencilState;
+        std::size_t sampleCount; // all render targets have the same sample count
+    };
+
+    // pixel kernels work on aligned 4x4 blocks, pixel (x, y) of a block is bit y * 4 + x of its masks
+    constexpr std::size_t pixelBlockSize = 4;
+    constexpr std::size_t pixelBlockPixelCount = pixelBlockSize * pixelBlockSize;
+
+    // shades the pixels of the block at (blockX, blockY) that are set in the mask,
+    // testing them against the edges of the triangle first if testCoverage is set
+    template <class T, class FragmentShaderType>
+    using BlockShader = void(*)(const TriangleSetup<Varyings<T>::componentCount>& triangle,
+                                const PixelPipeline<FragmentShaderType>& pipeline,
+                                std::size_t blockX,
+                                std::size_t blockY,
+                                std::uint32_t mask,
+                                bool testCoverage);
+
+    // coordinates of the pixels inside of a block
+    alignas(64) inline constexpr float blockPixelXs[pixelBlockPixelCount]{
+        0.0F, 1.0F, 2.0F, 3.0F, 0.0F, 1.0F, 2.0F, 3.0F, 0.0F, 1.0F, 2.0F, 3.0F, 0.0F, 1.0F, 2.0F, 3.0F
+    };
+    alignas(64) inline constexpr float blockPixelYs[pixelBlockPixelCount]{
+        0.0F, 0.0F, 0.0F, 0.0F, 1.0F, 1.0F, 1.0F, 1.0F, 2.0F, 2.0F, 2.0F, 2.0F, 3.0F, 3.0F, 3.0F, 3.0F
+    };
+
+    // The scalar kernel is the reference implementation. The SIMD kernels evaluate the same expressions in
+    // the same order (the planes are stepped from the block origin), so all of them produce
+    // bit-identical results.
+    template <std::size_t componentCount>
+    std::uint32_t getCoverageMask(const TriangleSetup<componentCount>& triangle,
+                                  std::array<std::int64_t, 3> rowEdges) noexcept
+    {
+        std::uint32_t mask = 0;
+
+        for (std::size_t y = 0; y < pixelBlockSize; ++y)
+        {
+            auto edges = rowEdges;
+
+            for (std::size_t x = 0; x < pixelBlockSize; ++x)
+            {
+                if (edges[0] >= triangle.edgeThresholds[0] &&
+                    edges[1] >= triangle.edgeThresholds[1] &&
+                    edges[2] >= triangle.edgeThresholds[2])
+                    mask |= 1U << (y * pixelBlockSize + x);
+
+                edges[0] += triangle.edgeStepsX[0];
+                edges[1] += triangle.edgeStepsX[1];
+                edges[2] += triangle.edgeStepsX[2];
+            }
+
+            rowEdges[0] += triangle.edgeStepsY[0];
+            rowEdges[1] += triangle.edgeStepsY[1];
+            rowEdges[2] += triangle.edgeStepsY[2];
+        }
+
+        return mask;
+    }
+
+    // values of the planes of a triangle at the origin of a block
+    template <std::size_t componentCount>
+    struct BlockPlanes final
+    {
+        float depth;
+        float inverseW;
+        std::array<float, componentCount> components;
+    };
+
+    template <std::size_t componentCount>
+    BlockPlanes<componentCount> getBlockPlanes(const TriangleSetup<componentCount>& triangle,
+                                               const std::array<std::int64_t, 3>& edges) noexcept
+    {
+        const std::array<float, 3> barycentrics{
+            static_cast<float>(edges[0]) * triangle.inverseArea,
+            static_cast<float>(edges[1]) * triangle.inverseArea,
+            static_cast<float>(edges[2]) * triangle.inverseArea
+        };
+
+        const auto getValue = [&barycentrics](const Plane& plane) noexcept {
+            return plane.vertexValues[0] * barycentrics[0] +
+                plane.vertexValues[1] * barycentrics[1] +
+                plane.vertexValues[2] * barycentrics[2];
+        };
+
+        BlockPlanes<componentCount> blockPlanes;
+        blockPlanes.depth = getValue(triangle.depthPlane);
+        blockPlanes.inverseW = getValue(triangle.inverseWPlane);
+        for (std::size_t component = 0; component < componentCount; ++component)
+            blockPlanes.components[component] = getValue(triangle.planes[component]);
+
+        return blockPlanes;
+    }
+
+    // the interpolated components of a pixel, with the window coordinates of its center, its depth and 1/w as position
+    template <class T>
+    T getFragmentShaderInput(const std::array<float, Varyings<T>::componentCount>& components,
+                             const std::size_t screenX,
+                             const std::size_t screenY,
+                             const float depth,
+                             const float inverseW)
+    {
+        T input{};
+        input.position = Vector<float, 4>{static_cast<float>(screenX) + 0.5F, static_cast<float>(screenY) + 0.5F, depth, inverseW};
+        Varyings<T>::setComponents(input, components);
+        return input;
+    }
+
+    // perspective-correct components of the varyings at a pixel of a block, also used for the helper pixels of quads
+    template <std::size_t componentCount>
+    std::array<float, componentCount> getPixelComponents(const TriangleSetup<componentCount>& triangle,
+                                                         const BlockPlanes<componentCount>& blockPlanes,
+                                                         const std::size_t pixel) noexcept
+    {
+        const auto x = blockPixelXs[pixel];
+        const auto y = blockPixelYs[pixel];
+
+        const auto inverseW = blockPlanes.inverseW + unfused(x * triangle.inverseWPlane.stepX) + unfused(y * triangle.inverseWPlane.stepY);
+        const auto w = 1.0F / inverseW;
+
+        std::array<float, componentCount> components;
+        for (std::size_t component = 0; component < componentCount; ++component)
+        {
+            const auto& plane = triangle.planes[component];
+            components[component] = (blockPlanes.components[component] + unfused(x * plane.stepX) + unfused(y * plane.stepY)) * w;
+        }
+
+        return components;
+    }
+
+    // whether the fragment shader takes the derivatives of its input as its second parameter
+    template <class T, class FragmentShaderType>
+    inline constexpr bool usesDerivatives = std::is_invocable_v<const FragmentShaderType&,
+                                                                const T&,
+                                                                const Derivatives<T>&,
+                                                                const std::array<const Sampler*, 2>&,
+                                                                const std::array<const Texture*, 2>&>;
+
+    // the 2x2 quads of a block are aligned, so the horizontal neighbor of a pixel differs in bit 0 of its index
+    // and the vertical one in bit 2
+    constexpr std::size_t getQuadLeft(const std::size_t pixel) noexcept { return pixel & ~std::size_t{1}; }
+    constexpr std::size_t getQuadRight(const std::size_t pixel) noexcept { return pixel | std::size_t{1}; }
+    constexpr std::size_t getQuadTop(const std::size_t pixel) noexcept { return pixel & ~pixelBlockSize; }
+    constexpr std::size_t getQuadBottom(const std::size_t pixel) noexcept { return pixel | pixelBlockSize; }
+
+    // fine derivatives: the differences inside of the row and the column of the pixel in its quad
+    template <class T>
+    Derivatives<T> getDerivatives(const TriangleSetup<Varyings<T>::componentCount>& triangle,
+                                  const std::array<float, Varyings<T>::componentCount>& left,
+                                  const std::array<float, Varyings<T>::componentCount>& right,
+                                  const std::array<float, Varyings<T>::componentCount>& top,
+                                  const std::array<float, Varyings<T>::componentCount>& bottom)
+    {
+        std::array<float, Varyings<T>::componentCount> ddx;
+        std::array<float, Varyings<T>::componentCount> ddy;
+        for (std::size_t component = 0; component < ddx.size(); ++component)
+        {
+            ddx[component] = right[component] - left[component];
+            ddy[component] = bottom[component] - top[component];
+        }
+
+        // depth and 1/w are linear in screen space
+        Derivatives<T> derivatives{};
+        derivatives.ddx.position = Vector<float, 4>{1.0F, 0.0F, triangle.depthPlane.stepX, triangle.inverseWPlane.stepX};
+        derivatives.ddy.position = Vector<float, 4>{0.0F, 1.0F, triangle.depthPlane.stepY, triangle.inverseWPlane.stepY};
+        Varyings<T>::setComponents(derivatives.ddx, ddx);
+        Varyings<T>::setComponents(derivatives.ddy, ddy);
+        return derivatives;
+    }
+
+    // the stored depth of a pixel of a depth buffer as the value that quantizeDepth returns
+    inline float readDepth(const void* data, const PixelFormat pixelFormat, const std::size_t index) noexcept
+    {
+        switch (pixelFormat)
+        {
+            case PixelFormat::depth16:
+                return static_cast<float>(static_cast<const std::uint16_t*>(data)[index]);
+            case PixelFormat::d24s8:
+                return static_cast<float>(static_cast<const std::uint32_t*>(data)[index] & 0x00FFFFFFU);
+            default:
+                return static_cast<const float*>(data)[index];
+        }
+    }
+
+    // stores a depth returned by quantizeDepth, keeping the stencil of d24s8
+    inline void writeDepth(void* data, const PixelFormat pixelFormat, const std::size_t index, const float depth) noexcept
+    {
+        switch (pixelFormat)
+        {
+            case PixelFormat::depth16:
+                static_cast<std::uint16_t*>(data)[index] = static_cast<std::uint16_t>(depth);
+                break;
+            case PixelFormat::d24s8:
+            {
+                auto& pixel = static_cast<std::uint32_t*>(data)[index];
+                pixel = (pixel & 0xFF000000U) | static_cast<std::uint32_t>(depth);
+                break;
+            }
+            default:
+                static_cast<float*>(data)[index] = depth;
+        }
+    }
+
+    template <class FragmentShaderType>
+    std::uint8_t* getStencilPixel(const PixelPipeline<FragmentShaderType>& pipeline,
+                                  const std::size_t screenX,
+                                  const std::size_t screenY,
+                                  const std::size_t sample) noexcept
+    {
+        return pipeline.stencilBufferData +
+            (screenY * pipeline.stencilBufferWidth + screenX + sample * pipeline.stencilBufferSampleStride) * pipeline.stencilPixelSize;
+    }
+
+    // offset of a sample from the center of its pixel in pixels
+    inline std::array<float, 2> getSampleOffset(const std::size_t sampleCount, const std::size_t sample) noexcept
+    {
+        const auto position = getSamplePosition(sampleCount, sample);
+        return {static_cast<float>(position[0]) / 16.0F, static_cast<float>(position[1]) / 16.0F};
+    }
+
+    // Tests the covered samples of a pixel (the bits of sampleMask) and shades the pixel once if any of them pass,
+    // at its center. The color is written to the samples that passed.
+    template <class T, class FragmentShaderType>
+    void shadePixel(const TriangleSetup<Varyings<T>::componentCount>& triangle,
+                    const PixelPipeline<FragmentShaderType>& pipeline,
+                    const BlockPlanes<Varyings<T>::componentCount>& blockPlanes,
+                    const std::size_t blockX,
+                    const std::size_t blockY,
+                    const std::size_t pixel,
+                    const std::uint32_t sampleMask)
+    {
+        const auto x = blockPixelXs[pixel];
+        const auto y = blockPixelYs[pixel];
+        const auto screenX = blockX + pixel % pixelBlockSize;
+        const auto screenY = blockY + pixel / pixelBlockSize;
+        const auto& stencilState = pipeline.stencilState;
+
+        std::uint32_t passedSamples = 0;
+
+        for (std::size_t sample = 0; sample < pipeline.sampleCount; ++sample)
+        {
+            if (!(sampleMask & (1U << sample))) continue;
+
+            // clamped, so that the depth never leaves the range of the triangle because of rounding errors
+            const auto offset = getSampleOffset(pipeline.sampleCount, sample);
+            const auto sampleDepth = std::clamp(blockPlanes.depth + unfused((x + offset[0]) * triangle.depthPlane.stepX) + unfused((y + offset[1]) * triangle.depthPlane.stepY),
+                                                triangle.minDepth, triangle.maxDepth);
+
+            const auto depthIndex = screenY * pipeline.depthBufferWidth + screenX + sample * pipeline.depthBufferSampleStride;
+            const auto testDepth = quantizeDepth(pipeline.depthBufferFormat, sampleDepth);
+            const auto stencilPixel = pipeline.stencilBufferData ? getStencilPixel(pipeline, screenX, screenY, sample) : nullptr;
+
+            if (stencilPixel && !testStencil(stencilState, *stencilPixel))
+            {
+                *stencilPixel = getStencilResult(stencilState, stencilState.failOperation, *stencilPixel);
+                continue; // discard the sample
+            }
+
+            if (pipeline.depthState.read &&
+                readDepth(pipeline.depthBufferData, pipeline.depthBufferFormat, depthIndex) < testDepth)
+            {
+                if (stencilPixel)
+                    *stencilPixel = getStencilResult(stencilState, stencilState.depthFailOperation, *stencilPixel);
+                continue; // discard the sample
+            }
+
+            if (pipeline.depthState.write)
+                writeDepth(pipeline.depthBufferData, pipeline.depthBufferFormat, depthIndex, testDepth);
+
+            if (stencilPixel)
+                *stencilPixel = getStencilResult(stencilState, stencilState.passOperation, *stencilPixel);
+
+            passedSamples |= 1U << sample;
+        }
+
+        if (!passedSamples) return; // discard the pixel
+
+        const auto depth = std::clamp(blockPlanes.depth + unfused(x * triangle.depthPlane.stepX) + unfused(y * triangle.depthPlane.stepY),
+                                      triangle.minDepth, triangle.maxDepth);
+        const auto inverseW = blockPlanes.inverseW + unfused(x * triangle.inverseWPlane.stepX) + unfused(y * triangle.inverseWPlane.stepY);
+        const auto components = getPixelComponents(triangle, blockPlanes, pixel);
+
+        const auto psInput = getFragmentShaderInput<T>(components, screenX, screenY, depth, inverseW);
+
+        Color srcColor;
+        if constexpr (usesDerivatives<T, FragmentShaderType>)
+        {
+            // the neighbors are interpolated even if they are not covered or fail the depth test
+            const auto derivatives = getDerivatives<T>(triangle,
+                                                       getPixelComponents(triangle, blockPlanes, getQuadLeft(pixel)),
+                                                       getPixelComponents(triangle, blockPlanes, getQuadRight(pixel)),
+                                                       getPixelComponents(triangle, blockPlanes, getQuadTop(pixel)),
+                                                       getPixelComponents(triangle, blockPlanes, getQuadBottom(pixel)));
+            srcColor = pipeline.fragmentShader(psInput, derivatives, pipeline.samplers, pipeline.textures);
+        }
+        else
+            srcColor = pipeline.fragmentShader(psInput, pipeline.samplers, pipeline.textures);
+
+        const auto& blendState = pipeline.blendState;
+
+        for (std::size_t sample = 0; sample < pipeline.sampleCount; ++sample)
+        {
+            if (!(passedSamples & (1U << sample))) continue;
+
+            const auto colorPixel = &pipeline.frameBufferData[screenY * pipeline.frameBufferWidth + screenX + sample * pipeline.frameBufferSampleStride];
+
+            if (blendState.enabled)
+            {
+                const auto destPixel = reinterpret_cast<std::uint8_t*>(colorPixel);
+                const Color destColor{destPixel[0], destPixel[1], destPixel[2], destPixel[3]};
+
+                // alpha blend
+                const Color resultColor{
+                    getValue(blendState.colorOperation,
+                             unfused(srcColor.r * getValue(blendState.colorBlendSource, srcColor.r, srcColor.a, destColor.r, destColor.a, blendState.blendFactor.r)),
+                             unfused(destColor.r * getValue(blendState.colorBlendDest, srcColor.r, srcColor.a, destColor.r, destColor.a, blendState.blendFactor.r))),
+                    getValue(blendState.colorOperation,
+                             unfused(srcColor.g * getValue(blendState.colorBlendSource, srcColor.g, srcColor.a, destColor.g, destColor.a, blendState.blendFactor.g)),
+                             unfused(destColor.g * getValue(blendState.colorBlendDest, srcColor.g, srcColor.a, destColor.g, destColor.a, blendState.blendFactor.g))),
+                    getValue(blendState.colorOperation,
+                             unfused(srcColor.b * getValue(blendState.colorBlendSource, srcColor.b, srcColor.a, destColor.b, destColor.a, blendState.blendFactor.b)),
+                             unfused(destColor.b * getValue(blendState.colorBlendDest, srcColor.b, srcColor.a, destColor.b, destColor.a, blendState.blendFactor.b))),
+                    getValue(blendState.alphaOperation,
+                             unfused(srcColor.a * getValue(blendState.alphaBlendSource, srcColor.a, srcColor.a, destColor.a, destColor.a, blendState.blendFactor.a)),
+                             unfused(destColor.a * getValue(blendState.alphaBlendDest, srcColor.a, srcColor.a, destColor.a, destColor.a, blendState.blendFactor.a)))
+                };
+
+                *colorPixel = resultColor.getIntValueRaw();
+            }
+            else
+                *colorPixel = srcColor.getIntValueRaw();
+        }
+    }
+
+    // Covered pixels of a block for every sample. Blocks whose coverage does not have to be tested are covered
+    // at all of their samples, because the rasterizer classifies blocks by the extent of the samples.
+    template <std::size_t componentCount>
+    std::array<std::uint32_t, maxSampleCount> getSampleMasks(const TriangleSetup<componentCount>& triangle,
+                                                             const std::array<std::int64_t, 3>& edges,
+                                                             const std::size_t sampleCount,
+                                                             const std::uint32_t mask,
+                                                             const bool testCoverage) noexcept
+    {
+        std::array<std::uint32_t, maxSampleCount> sampleMasks{};
+
+        for (std::size_t sample = 0; sample < sampleCount; ++sample)
+            sampleMasks[sample] = testCoverage ? mask & getCoverageMask(triangle, getSampleEdges(triangle, edges, sampleCount, sample)) : mask;
+
+        return sampleMasks;
+    }
+
+    template <class T, class FragmentShaderType>
+    void shadeBlock(const TriangleSetup<Varyings<T>::componentCount>& triangle,
+                    const PixelPipeline<FragmentShaderType>& pipeline,
+                    const std::size_t blockX,
+                    const std::size_t blockY,
+                    const std::uint32_t mask,
+                    const bool testCoverage)
+    {
+        const auto edges = getEdges(triangle, blockX, blockY);
+        const auto sampleMasks = getSampleMasks(triangle, edges, pipeline.sampleCount, mask, testCoverage);
+
+        const auto blockPlanes = getBlockPlanes(triangle, edges);
+
+        for (std::size_t pixel = 0; pixel < pixelBlockPixelCount; ++pixel)
+        {
+            std::uint32_t sampleMask = 0;
+            for (std::size_t sample = 0; sample < pipeline.sampleCount; ++sample)
+                if (sampleMasks[sample] & (1U << pixel)) sampleMask |= 1U << sample;
+
+            if (sampleMask)
+                shadePixel<T>(triangle, pipeline, blockPlanes, blockX, blockY, pixel, sampleMask);
+        }
+    }
+
+    // copies the pixels of a block to and from the aligned arrays that the SIMD kernels operate on
+    template <class T>
+    void loadBlock(T* block,
+                   const T* data,
+                   const std::size_t width,
+                   const std::size_t blockX,
+                   const std::size_t blockY,
+                   const std::uint32_t mask) noexcept
+    {
+        for (std::size_t y = 0; y < pixelBlockSize; ++y)
+        {
+            const auto rowMask = (mask >> (y * pixelBlockSize)) & 0x0FU;
+            const auto row = data + (blockY + y) * width + blockX;
+
+            if (rowMask == 0x0FU)
+                std::memcpy(block + y * pixelBlockSize, row, pixelBlockSize * sizeof(T));
+            else if (rowMask)
+                for (std::size_t x = 0; x < pixelBlockSize; ++x)
+                    if (rowMask & (1U << x)) block[y * pixelBlockSize + x] = row[x];
+        }
+    }
+
+    template <class T>
+    void storeBlock(const T* block,
+                    T* data,
+                    const std::size_t width,
+                    const std::size_t blockX,
+                    const std::size_t blockY,
+                    const std::uint32_t mask) noexcept
+    {
+        for (std::size_t y = 0; y < pixelBlockSize; ++y)
+        {
+            const auto rowMask = (mask >> (y * pixelBlockSize)) & 0x0FU;
+            const auto row = data + (blockY + y) * width + blockX;
+
+            if (rowMask == 0x0FU)
+                std::memcpy(row, block + y * pixelBlockSize, pixelBlockSize * sizeof(T));
+            else if (rowMask)
+                for (std::size_t x = 0; x < pixelBlockSize; ++x)
+                    if (rowMask & (1U << x)) row[x] = block[y * pixelBlockSize + x];
+        }
+    }
+
+    // The SIMD kernels test the depths of a block as the floats that quantizeDepth returns. The pixels of d24s8
+    // are loaded as well, so that storing the depths keeps their stencil.
+    template <PixelFormat depthFormat>
+    void loadDepthBlock(float* depths,
+                        std::uint32_t* pixels,
+                        const void* data,
+                        const std::size_t width,
+                        const std::size_t blockX,
+                        const std::size_t blockY,
+                        const std::uint32_t mask) noexcept
+    {
+        if constexpr (depthFormat == PixelFormat::depth16)
+        {
+            alignas(64) std::uint16_t values[pixelBlockPixelCount]{};
+            loadBlock(values, static_cast<const std::uint16_t*>(data), width, blockX, blockY, mask);
+            for (std::size_t pixel = 0; pixel < pixelBlockPixelCount; ++pixel)
+                depths[pixel] = static_cast<float>(values[pixel]);
+        }
+        else if constexpr (depthFormat == PixelFormat::d24s8)
+        {
+            loadBlock(pixels, static_cast<const std::uint32_t*>(data), width, blockX, blockY, mask);
+            for (std::size_t pixel = 0; pixel < pixelBlockPixelCount; ++pixel)
+                depths[pixel] = static_cast<float>(pixels[pixel] & 0x00FFFFFFU);
+        }
+        else
+            loadBlock(depths, static_cast<const float*>(data), width, blockX, blockY, mask);
+    }
+
+    template <PixelFormat depthFormat>
+    void storeDepthBlock(const float* depths,
+                         std::uint32_t* pixels,
+                         void* data,
+                         const std::size_t width,
+                         const std::size_t blockX,
+                         const std::size_t blockY,
+                         const std::uint32_t mask) noexcept
+    {
+        if constexpr (depthFormat == PixelFormat::depth16)
+        {
+            alignas(64) std::uint16_t values[pixelBlockPixelCount];
+            for (std::size_t pixel = 0; pixel < pixelBlockPixelCount; ++pixel)
+                values[pixel] = static_cast<std::uint16_t>(depths[pixel]);
+            storeBlock(values, static_cast<std::uint16_t*>(data), width, blockX, blockY, mask);
+        }
+        else if constexpr (depthFormat == PixelFormat::d24s8)
+        {
+            for (std::size_t pixel = 0; pixel < pixelBlockPixelCount; ++pixel)
+                pixels[pixel] = (pixels[pixel] & 0xFF000000U) | static_cast<std::uint32_t>(depths[pixel]);
+            storeBlock(pixels, static_cast<std::uint32_t*>(data), width, blockX, blockY, mask);
+        }
+        else
+            storeBlock(depths, static_cast<float*>(data), width, blockX, blockY, mask);
+    }
+
+    // The SIMD kernels run the stencil test of a sample of a block before its depth test and return the mask of
+    // the pixels that pass it. The stencils are 8-bit, so they are tested pixel by pixel with the function of the state.
+    template <class FragmentShaderType>
+    std::uint32_t testStencilBlock(const PixelPipeline<FragmentShaderType>& pipeline,
+                                   std::uint8_t* stencils,
+                                   const std::size_t blockX,
+                                   const std::size_t blockY,
+                                   const std::size_t sample,
+                                   const std::uint32_t mask)
+    {
+        std::uint32_t stencilMask = 0;
+
+        for (std::size_t pixel = 0; pixel < pixelBlockPixelCount; ++pixel)
+            if (mask & (1U << pixel))
+            {
+                stencils[pixel] = *getStencilPixel(pipeline, blockX + pixel % pixelBlockSize, blockY + pixel / pixelBlockSize, sample);
+                if (testStencil(pipeline.stencilState, stencils[pixel])) stencilMask |= 1U << pixel;
+            }
+
+        return stencilMask;
+    }
+
+    // stores the results of the operations of the covered pixels, picked by the outcome of the stencil and the
+    // depth test
+    template <class FragmentShaderType>
+    void updateStencilBlock(const PixelPipeline<FragmentShaderType>& pipeline,
+                            const std::uint8_t* stencils,
+                            const std::size_t blockX,
+                            const std::size_t blockY,
+                            const std::size_t sample,
+                            const std::uint32_t mask,
+                            const std::uint32_t stencilMask,
+                            const std::uint32_t depthMask)
+    {
+        const auto& stencilState = pipeline.stencilState;
+        if (stencilState.writeMask == 0) return;
+
+        for (std::size_t pixel = 0; pixel < pixelBlockPixelCount; ++pixel)
+            if (mask & (1U << pixel))
+            {
+                const auto operation = !(stencilMask & (1U << pixel)) ? stencilState.failOperation :
+                    !(depthMask & (1U << pixel)) ? stencilState.depthFailOperation :
+                    stencilState.passOperation;
+
+                *getStencilPixel(pipeline, blockX + pixel % pixelBlockSize, blockY + pixel / pixelBlockSize, sample) =
+                    getStencilResult(stencilState, operation, stencils[pixel]);
+            }
+    }
+
+    // runs the fragment shader for a single pixel of a block whose components were interpolated by a SIMD kernel
+    template <class T, class FragmentShaderType>
+    Color runFragmentShader(const TriangleSetup<Varyings<T>::componentCount>& triangle,
+                            const PixelPipeline<FragmentShaderType>& pipeline,
+                            const float (&components)[Varyings<T>::componentCount][pixelBlockPixelCount],
+                            const std::size_t blockX,
+                            const std::size_t blockY,
+                            const float depth,
+                            const float inverseW,
+                            const std::size_t pixel)
+    {
+        const auto getComponents = [&components](const std::size_t blockPixel) noexcept {
+            std::array<float, Varyings<T>::componentCount> pixelComponents;
+            for (std::size_t component = 0; component < pixelComponents.size(); ++component)
+                pixelComponents[component] = components[component][blockPixel];
+            return pixelComponents;
+        };
+
+        const auto psInput = getFragmentShaderInput<T>(getComponents(pixel),
+                                                       blockX + pixel % pixelBlockSize,
+                                                       blockY + pixel / pixelBlockSize,
+                                                       depth,
+                                                       inverseW);
+
+        if constexpr (usesDerivatives<T, FragmentShaderType>)
+            return pipeline.fragmentShader(psInput,
+                                           getDerivatives<T>(triangle,
+                                                             getComponents(getQuadLeft(pixel)),
+                                                             getComponents(getQuadRight(pixel)),
+                                                             getComponents(getQuadTop(pixel)),
+                                                             getComponents(getQuadBottom(pixel))),
+                                           pipeline.samplers,
+                                           pipeline.textures);
+        else
+            return pipeline.fragmentShader(psInput, pipeline.samplers, pipeline.textures);
+    }
+
+    struct BlendMode final
+    {
+        BlendState::Factor colorBlendSource;
+        BlendState::Factor colorBlendDest;
+        BlendState::Operation colorOperation;
+        BlendState::Factor alphaBlendSource;
+        BlendState::Factor alphaBlendDest;
+        BlendState::Operation alphaOperation;
+    };
+
+    // Common blend states that the SIMD kernels are compiled for, so that their blend factors and operations are
+    // resolved at compile time. The other blend states take the generic path that reads them from the pipeline.
+    inline constexpr std::array<BlendMode, 5> blendModes{{
+        // replace
+        {BlendState::Factor::one, BlendState::Factor::zero, BlendState::Operation::add,
+         BlendState::Factor::one, BlendState::Factor::zero, BlendState::Operation::add},
+        // alpha
+        {BlendState::Factor::srcAlpha, BlendState::Factor::invSrcAlpha, BlendState::Operation::add,
+         BlendState::Factor::srcAlpha, BlendState::Factor::invSrcAlpha, BlendState::Operation::add},
+        // alpha, accumulating the coverage in the alpha channel
+        {BlendState::Factor::srcAlpha, BlendState::Factor::invSrcAlpha, BlendState::Operation::add,
+         BlendState::Factor::one, BlendState::Factor::one, BlendState::Operation::add},
+        // premultiplied alpha
+        {BlendState::Factor::one, BlendState::Factor::invSrcAlpha, BlendState::Operation::add,
+         BlendState::Factor::one, BlendState::Factor::invSrcAlpha, BlendState::Operation::add},
+        // additive
+        {BlendState::Factor::one, BlendState::Factor::one, BlendState::Operation::add,
+         BlendState::Factor::one, BlendState::Factor::one, BlendState::Operation::add}
+    }};
+
+    // kernel variants besides the ones in blendModes
+    constexpr std::size_t disabledBlendMode = blendModes.size();
+    constexpr std::size_t genericBlendMode = blendModes.size() + 1;
+    constexpr std::size_t blendModeCount = blendModes.size() + 2;
+
+    inline std::size_t getBlendMode(const BlendState& blendState) noexcept
+    {
+        if (!blendState.enabled) return disabledBlendMode;
+
+        for (std::size_t i = 0; i < blendModes.size(); ++i)
+            if (blendState.colorBlendSource == blendModes[i].colorBlendSource &&
+                blendState.colorBlendDest == blendModes[i].colorBlendDest &&
+                blendState.colorOperation == blendModes[i].colorOperation &&
+                blendState.alphaBlendSource == blendModes[i].alphaBlendSource &&
+                blendState.alphaBlendDest == blendModes[i].alphaBlendDest &&
+                blendState.alphaOperation == blendModes[i].alphaOperation)
+                return i;
+
+        return genericBlendMode;
+    }
+
+    // the blend state of a kernel variant, known at compile time unless it is the generic one
+    template <std::size_t blendMode>
+    inline BlendMode getKernelBlendMode(const BlendState& blendState) noexcept
+    {
+        if constexpr (blendMode < blendModes.size())
+            return blendModes[blendMode];
+        else
+            return BlendMode{
+                blendState.colorBlendSource,
+                blendState.colorBlendDest,
+                blendState.colorOperation,
+                blendState.alphaBlendSource,
+                blendState.alphaBlendDest,
+                blendState.alphaOperation
+            };
+    }
+}
+
+// The SIMD kernels share their implementation (PixelKernels.inl), which is compiled once per instruction set
+// with the matching target options, so that the CPU can be detected at runtime instead of at compile time.
+#ifdef SR_SIMD_X86
+#  if defined(__clang__)
+#    pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#  elif defined(__GNUC__)
+#    pragma GCC push_options
+#    pragma GCC target("sse4.1")
+#  endif
+namespace sr::sse41
+{
+    constexpr std::size_t laneCount = 4;
+    constexpr std::size_t int64LaneCount = 2;
+
+    using Float = __m128;
+    using Int = __m128i;
+    using Int64 = __m128i;
+
+    inline Float set(const float value) noexcept { return _mm_set1_ps(value); }
+    inline Float load(const float* data) noexcept { return _mm_load_ps(data); }
+    inline void store(float* data, const Float value) noexcept { _mm_store_ps(data, value); }
+    inline Float add(const Float a, const Float b) noexcept { return _mm_add_ps(a, b); }
+    inline Float sub(const Float a, const Float b) noexcept { return _mm_sub_ps(a, b); }
+    inline Float mul(const Float a, const Float b) noexcept
+    {
+        auto product = _mm_mul_ps(a, b);
+#ifdef __GNUC__
+        __asm__("" : "+x"(product)); // see unfused
+#endif
+        return product;
+    }
+    inline Float div(const Float a, const Float b) noexcept { return _mm_div_ps(a, b); }
+    // same results as std::min and std::max, also for NaNs
+    inline Float min(const Float a, const Float b) noexcept { return _mm_min_ps(b, a); }
+    inline Float max(const Float a, const Float b) noexcept { return _mm_max_ps(b, a); }
+    inline std::uint32_t lessThan(const Float a, const Float b) noexcept { return static_cast<std::uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(a, b))); }
+
+    inline Int getLaneMask(const std::uint32_t mask) noexcept
+    {
+        const auto laneBits = _mm_setr_epi32(1, 2, 4, 8);
+        return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(static_cast<int>(mask)), laneBits), laneBits);
+    }
+
+    inline Float select(const std::uint32_t mask, const Float a, const Float b) noexcept { return _mm_blendv_ps(b, a, _mm_castsi128_ps(getLaneMask(mask))); }
+
+    inline Int setInt(const std::uint32_t value) noexcept { return _mm_set1_epi32(static_cast<int>(value)); }
+    inline Int loadInt(const std::uint32_t* data) noexcept { return _mm_load_si128(reinterpret_cast<const __m128i*>(data)); }
+    inline void storeInt(std::uint32_t* data, const Int value) noexcept { _mm_store_si128(reinterpret_cast<__m128i*>(data), value); }
+    inline Int andInt(const Int a, const Int b) noexcept { return _mm_and_si128(a, b); }
+    inline Int orInt(const Int a, const Int b) noexcept { return _mm_or_si128(a, b); }
+    template <int shift> Int shiftLeft(const Int value) noexcept { return _mm_slli_epi32(value, shift); }
+    template <int shift> Int shiftRight(const Int value) noexcept { return _mm_srli_epi32(value, shift); }
+    inline Float toFloat(const Int value) noexcept { return _mm_cvtepi32_ps(value); }
+    inline Int truncate(const Float value) noexcept { return _mm_cvttps_epi32(value); }
+    inline Int round(const Float value) noexcept { return _mm_cvtps_epi32(value); }
+    inline Int selectInt(const std::uint32_t mask, const Int a, const Int b) noexcept { return _mm_blendv_epi8(b, a, getLaneMask(mask)); }
+
+    inline Int64 setInt64(const std::int64_t value) noexcept { return _mm_set1_epi64x(value); }
+    inline Int64 loadInt64(const std::int64_t* data) noexcept { return _mm_load_si128(reinterpret_cast<const __m128i*>(data)); }
+    inline Int64 addInt64(const Int64 a, const Int64 b) noexcept { return _mm_add_epi64(a, b); }
+    inline std::uint32_t negative(const Int64 value) noexcept { return static_cast<std::uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(value))); }
+
+#  include "PixelKernels.inl"
+}
+#  if defined(__clang__)
+#    pragma clang attribute pop
+#    pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#  elif defined(__GNUC__)
+#    pragma GCC pop_options
+#    pragma GCC push_options
+#    pragma GCC target("avx2")
+#  endif
+namespace sr::avx2
+{
+    constexpr std::size_t laneCount = 8;
+    constexpr std::size_t int64LaneCount = 4;
+
+    using Float = __m256;
+    using Int = __m256i;
+    using Int64 = __m256i;
+
+    inline Float set(const float value) noexcept { return _mm256_set1_ps(value); }
+    inline Float load(const float* data) noexcept { return _mm256_load_ps(data); }
+    inline void store(float* data, const Float value) noexcept { _mm256_store_ps(data, value); }
+    inline Float add(const Float a, const Float b) noexcept { return _mm256_add_ps(a, b); }
+    inline Float sub(const Float a, const Float b) noexcept { return _mm256_sub_ps(a, b); }
+    inline Float mul(const Float a, const Float b) noexcept
+    {
+        auto product = _mm256_mul_ps(a, b);
+#ifdef __GNUC__
+        __asm__("" : "+x"(product)); // see unfused
+#endif
+        return product;
+    }
+    inline Float div(const Float a, const Float b) noexcept { return _mm256_div_ps(a, b); }
+    inline Float min(const Float a, const Float b) noexcept { return _mm256_min_ps(b, a); }
+    inline Float max(const Float a, const Float b) noexcept { return _mm256_max_ps(b, a); }
+    inline std::uint32_t lessThan(const Float a, const Float b) noexcept { return static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ))); }
+
+    inline Int getLaneMask(const std::uint32_t mask) noexcept
+    {
+        const auto laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(mask)), laneBits), laneBits);
+    }
+
+    inline Float select(const std::uint32_t mask, const Float a, const Float b) noexcept { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(getLaneMask(mask))); }
+
+    inline Int setInt(const std::uint32_t value) noexcept { return _mm256_set1_epi32(static_cast<int>(value)); }
+    inline Int loadInt(const std::uint32_t* data) noexcept { return _mm256_load_si256(reinterpret_cast<const __m256i*>(data)); }
+    inline void storeInt(std::uint32_t* data, const Int value) noexcept { _mm256_store_si256(reinterpret_cast<__m256i*>(data), value); }
+    inline Int andInt(const Int a, const Int b) noexcept { return _mm256_and_si256(a, b); }
+    inline Int orInt(const Int a, const Int b) noexcept { return _mm256_or_si256(a, b); }
+    template <int shift> Int shiftLeft(const Int value) noexcept { return _mm256_slli_epi32(value, shift); }
+    template <int shift> Int shiftRight(const Int value) noexcept { return _mm256_srli_epi32(value, shift); }
+    inline Float toFloat(const Int value) noexcept { return _mm256_cvtepi32_ps(value); }
+    inline Int truncate(const Float value) noexcept { return _mm256_cvttps_epi32(value); }
+    inline Int round(const Float value) noexcept { return _mm256_cvtps_epi32(value); }
+    inline Int selectInt(const std::uint32_t mask, const Int a, const Int b) noexcept { return _mm256_blendv_epi8(b, a, getLaneMask(mask)); }
+
+    inline Int64 setInt64(const std::int64_t value) noexcept { return _mm256_set1_epi64x(value); }
+    inline Int64 loadInt64(const std::int64_t* data) noexcept { return _mm256_load_si256(reinterpret_cast<const __m256i*>(data)); }
+    inline Int64 addInt64(const Int64 a, const Int64 b) noexcept { return _mm256_add_epi64(a, b); }
+    inline std::uint32_t negative(const Int64 value) noexcept { return static_cast<std::uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(value))); }
+
+#  include "PixelKernels.inl"
+}
+#  if defined(__clang__)
+#    pragma clang attribute pop
+#    pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#  elif defined(__GNUC__)
+#    pragma GCC pop_options
+#    pragma GCC push_options
+#    pragma GCC target("avx512f")
+#  endif
+namespace sr::avx512
+{
+    constexpr std::size_t laneCount = 16;
+    constexpr std::size_t int64LaneCount = 8;
+
+    using Float = __m512;
+    using Int = __m512i;
+    using Int64 = __m512i;
+
+    inline Float set(const float value) noexcept { return _mm512_set1_ps(value); }
+    inline Float load(const float* data) noexcept { return _mm512_load_ps(data); }
+    inline void store(float* data, const Float value) noexcept { _mm512_store_ps(data, value); }
+    inline Float add(const Float a, const Float b) noexcept { return _mm512_add_ps(a, b); }
+    inline Float sub(const Float a, const Float b) noexcept { return _mm512_sub_ps(a, b); }
+    inline Float mul(const Float a, const Float b) noexcept
+    {
+        auto product = _mm512_mul_ps(a, b);
+#ifdef __GNUC__
+        __asm__("" : "+x"(product)); // see unfused
+#endif
+        return product;
+    }
+    inline Float div(const Float a, const Float b) noexcept { return _mm512_div_ps(a, b); }
+    // the zero-masked forms avoid the false uninitialized warnings of some GCC versions about _mm512_undefined
+    inline Float min(const Float a, const Float b) noexcept { return _mm512_maskz_min_ps(0xFFFFU, b, a); }
+    inline Float max(const Float a, const Float b) noexcept { return _mm512_maskz_max_ps(0xFFFFU, b, a); }
+    inline std::uint32_t lessThan(const Float a, const Float b) noexcept { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    inline Float select(const std::uint32_t mask, const Float a, const Float b) noexcept { return _mm512_mask_blend_ps(static_cast<__mmask16>(mask), b, a); }
+
+    inline Int setInt(const std::uint32_t value) noexcept { return _mm512_set1_epi32(static_cast<int>(value)); }
+    inline Int loadInt(const std::uint32_t* data) noexcept { return _mm512_load_si512(data); }
+    inline void storeInt(std::uint32_t* data, const Int value) noexcept { _mm512_store_si512(data, value); }
+    inline Int andInt(const Int a, const Int b) noexcept { return _mm512_and_si512(a, b); }
+    inline Int orInt(const Int a, const Int b) noexcept { return _mm512_or_si512(a, b); }
+    template <int shift> Int shiftLeft(const Int value) noexcept { return _mm512_maskz_slli_epi32(0xFFFFU, value, shift); }
+    template <int shift> Int shiftRight(const Int value) noexcept { return _mm512_maskz_srli_epi32(0xFFFFU, value, shift); }
+    inline Float toFloat(const Int value) noexcept { return _mm512_maskz_cvtepi32_ps(0xFFFFU, value); }
+    inline Int truncate(const Float value) noexcept { return _mm512_maskz_cvttps_epi32(0xFFFFU, value); }
+    inline Int round(const Float value) noexcept { return _mm512_maskz_cvtps_epi32(0xFFFFU, value); }
+    inline Int selectInt(const std::uint32_t mask, const Int a, const Int b) noexcept { return _mm512_mask_blend_epi32(static_cast<__mmask16>(mask), b, a); }
+
+    inline Int64 setInt64(const std::int64_t value) noexcept { return _mm512_set1_epi64(value); }
+    inline Int64 loadInt64(const std::int64_t* data) noexcept { return _mm512_load_si512(data); }
+    inline Int64 addInt64(const Int64 a, const Int64 b) noexcept { return _mm512_add_epi64(a, b); }
+    inline std::uint32_t negative(const Int64 value) noexcept { return _mm512_cmplt_epi64_mask(value, _mm512_setzero_si512()); }
+
+#  include "PixelKernels.inl"
+}
+#  if defined(__clang__)
+#    pragma clang attribute pop
+#  elif defined(__GNUC__)
+#    pragma GCC pop_options
+#  endif
+#endif
+
+namespace sr
+{
+    // Picks the kernel that is specialized for the depth buffer format, the depth and the blend state. Most of the
+    // states are checked once per draw call here instead of for every pixel, the scalar reference kernel is the only
+    // one that checks them itself.
+    template <class T, class FragmentShaderType>
+    BlockShader<T, FragmentShaderType> getBlockShader(const SimdWidth simdWidth,
+                                                      const BlendState& blendState,
+                                                      const PixelFormat depthFormat,
+                                                      const DepthState& depthState) noexcept
+    {
+        const auto blendMode = getBlendMode(blendState);
+
+        switch (getSupportedSimdWidth(simdWidth))
+        {
+#ifdef SR_SIMD_X86
+            case SimdWidth::avx512: return avx512::getBlockShader<T, FragmentShaderType>(depthFormat, depthState.read, depthState.write, blendMode);
+            case SimdWidth::avx2: return avx2::getBlockShader<T, FragmentShaderType>(depthFormat, depthState.read, depthState.write, blendMode);
+            case SimdWidth::sse41: return sse41::getBlockShader<T, FragmentShaderType>(depthFormat, depthState.read, depthState.write, blendMode);
+#endif
+            default: return shadeBlock<T, FragmentShaderType>;
+        }
+    }
+}
+
+#endif
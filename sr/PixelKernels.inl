@@ -0,0 +1,345 @@
+//
+//  SoftwareRenderer
+//
+
+// Generic SIMD pixel kernel, included by PixelKernels.hpp inside of the namespace of every instruction set
+// that defines laneCount, int64LaneCount, the Float, Int and Int64 vector types and their operations.
+
+constexpr std::size_t groupCount = pixelBlockPixelCount / laneCount;
+constexpr std::uint32_t groupMask = (1U << laneCount) - 1U;
+
+template <std::size_t componentCount>
+std::uint32_t getBlockCoverage(const TriangleSetup<componentCount>& triangle,
+                               const std::array<std::int64_t, 3>& edges) noexcept
+{
+    std::uint32_t outside = 0;
+
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        // edge function minus the threshold, so that its sign tells whether a pixel is outside of the edge
+        alignas(64) std::int64_t laneEdges[int64LaneCount];
+        for (std::size_t lane = 0; lane < int64LaneCount; ++lane)
+            laneEdges[lane] = edges[i] - triangle.edgeThresholds[i] +
+                triangle.edgeStepsX[i] * static_cast<std::int64_t>(lane % pixelBlockSize) +
+                triangle.edgeStepsY[i] * static_cast<std::int64_t>(lane / pixelBlockSize);
+
+        const auto first = loadInt64(laneEdges);
+
+        for (std::size_t pixel = 0; pixel < pixelBlockPixelCount; pixel += int64LaneCount)
+        {
+            const auto offset = triangle.edgeStepsX[i] * static_cast<std::int64_t>(pixel % pixelBlockSize) +
+                triangle.edgeStepsY[i] * static_cast<std::int64_t>(pixel / pixelBlockSize);
+            outside |= negative(addInt64(first, setInt64(offset))) << pixel;
+        }
+    }
+
+    return ~outside & 0xFFFFU;
+}
+
+inline Float getBlendFactor(const BlendState::Factor factor,
+                            const Float srcColor,
+                            const Float srcAlpha,
+                            const Float destColor,
+                            const Float destAlpha,
+                            const Float blendFactor)
+{
+    switch (factor)
+    {
+        case BlendState::Factor::zero: return set(0.0F);
+        case BlendState::Factor::one: return set(1.0F);
+        case BlendState::Factor::srcColor: return srcColor;
+        case BlendState::Factor::invSrcColor: return sub(set(1.0F), srcColor);
+        case BlendState::Factor::srcAlpha: return srcAlpha;
+        case BlendState::Factor::invSrcAlpha: return sub(set(1.0F), srcAlpha);
+        case BlendState::Factor::destAlpha: return destAlpha;
+        case BlendState::Factor::invDestAlpha: return sub(set(1.0F), destAlpha);
+        case BlendState::Factor::destColor: return destColor;
+        case BlendState::Factor::invDestColor: return sub(set(1.0F), destColor);
+        case BlendState::Factor::srcAlphaSat: return min(srcAlpha, sub(set(1.0F), destAlpha));
+        case BlendState::Factor::blendFactor: return blendFactor;
+        case BlendState::Factor::invBlendFactor: return sub(set(1.0F), blendFactor);
+        default: throw RenderError{"Invalid blend factor"};
+    }
+}
+
+inline Float getBlendResult(const BlendState::Operation operation,
+                            const Float a,
+                            const Float b)
+{
+    switch (operation)
+    {
+        case BlendState::Operation::add: return min(max(add(a, b), set(0.0F)), set(1.0F));
+        case BlendState::Operation::subtract: return min(max(sub(a, b), set(0.0F)), set(1.0F));
+        case BlendState::Operation::reverseSubtract: return min(max(sub(b, a), set(0.0F)), set(1.0F));
+        case BlendState::Operation::min: return min(a, b);
+        case BlendState::Operation::max: return max(a, b);
+        default: throw RenderError{"Invalid blend operation"};
+    }
+}
+
+inline Float unpackChannel(const Int pixels) noexcept
+{
+    return div(toFloat(andInt(pixels, setInt(0xFFU))), set(255.0F));
+}
+
+inline Int packChannel(const Float value) noexcept
+{
+    return andInt(truncate(mul(value, set(255.0F))), setInt(0xFFU));
+}
+
+// the depth values of the format as quantizeDepth computes them
+template <PixelFormat depthFormat>
+inline Float quantizeDepth(const Float depth) noexcept
+{
+    if constexpr (getDepthMax(depthFormat) == 0)
+        return depth;
+    else
+    {
+        const auto clamped = min(max(set(0.0F), depth), set(1.0F));
+        return toFloat(round(mul(clamped, set(static_cast<float>(getDepthMax(depthFormat))))));
+    }
+}
+
+// the depth buffer format, the depth state and the blend mode (an index into blendModes or one of the other
+// variants) are template parameters, so that the branches on them and the blend factors are resolved at compile time
+template <class T, class FragmentShaderType, PixelFormat depthFormat, bool depthRead, bool depthWrite, std::size_t blendMode>
+void shadeBlock(const TriangleSetup<Varyings<T>::componentCount>& triangle,
+                const PixelPipeline<FragmentShaderType>& pipeline,
+                const std::size_t blockX,
+                const std::size_t blockY,
+                const std::uint32_t mask,
+                const bool testCoverage)
+{
+    const auto edges = getEdges(triangle, blockX, blockY);
+    const auto blockPlanes = getBlockPlanes(triangle, edges);
+
+    // every sample is tested against its own plane of the render targets, the pixels with a passing sample are
+    // shaded once
+    std::uint32_t sampleMasks[maxSampleCount]{};
+    std::uint32_t shadeMask = 0;
+
+    for (std::size_t sample = 0; sample < pipeline.sampleCount; ++sample)
+    {
+        auto sampleMask = testCoverage ?
+            mask & getBlockCoverage(triangle, getSampleEdges(triangle, edges, pipeline.sampleCount, sample)) :
+            mask;
+        if (!sampleMask) continue;
+
+        // the pixels that fail the stencil test are neither depth tested nor shaded
+        const auto coverageMask = sampleMask;
+        alignas(64) std::uint8_t stencils[pixelBlockPixelCount]{};
+        if (pipeline.stencilBufferData)
+            sampleMask = testStencilBlock(pipeline, stencils, blockX, blockY, sample, sampleMask);
+        const auto stencilMask = sampleMask;
+
+        alignas(64) float depths[pixelBlockPixelCount]{};
+        alignas(64) std::uint32_t depthPixels[pixelBlockPixelCount]{};
+        void* depthBufferData = nullptr;
+        if constexpr (depthRead || depthWrite)
+        {
+            depthBufferData = static_cast<std::uint8_t*>(pipeline.depthBufferData) +
+                sample * pipeline.depthBufferSampleStride * getPixelSize(depthFormat);
+            loadDepthBlock<depthFormat>(depths, depthPixels, depthBufferData, pipeline.depthBufferWidth,
+                                        blockX, blockY, sampleMask);
+        }
+
+        const auto sampleOffset = getSampleOffset(pipeline.sampleCount, sample);
+
+        for (std::size_t group = 0; group < groupCount; ++group)
+        {
+            const auto offset = group * laneCount;
+            const auto x = add(load(blockPixelXs + offset), set(sampleOffset[0]));
+            const auto y = add(load(blockPixelYs + offset), set(sampleOffset[1]));
+
+            const auto depth = min(max(add(add(set(blockPlanes.depth), mul(x, set(triangle.depthPlane.stepX))),
+                                           mul(y, set(triangle.depthPlane.stepY))),
+                                       set(triangle.minDepth)),
+                                   set(triangle.maxDepth));
+
+            auto laneMask = (sampleMask >> offset) & groupMask;
+            const auto storedDepth = load(depths + offset);
+            const auto testDepth = quantizeDepth<depthFormat>(depth);
+
+            if constexpr (depthRead)
+                laneMask &= ~lessThan(storedDepth, testDepth);
+
+            if constexpr (depthWrite)
+                store(depths + offset, select(laneMask, testDepth, storedDepth));
+
+            sampleMask = (sampleMask & ~(groupMask << offset)) | (laneMask << offset);
+        }
+
+        if constexpr (depthWrite)
+            if (sampleMask)
+                storeDepthBlock<depthFormat>(depths, depthPixels, depthBufferData, pipeline.depthBufferWidth,
+                                             blockX, blockY, sampleMask);
+
+        // after the depths, because the stored pixels of d24s8 have the stencils from before the test
+        if (pipeline.stencilBufferData)
+            updateStencilBlock(pipeline, stencils, blockX, blockY, sample, coverageMask, stencilMask, sampleMask);
+
+        sampleMasks[sample] = sampleMask;
+        shadeMask |= sampleMask;
+    }
+
+    if (!shadeMask) return;
+
+    // the depth at the centers of the pixels and the reciprocal of the interpolated 1/w
+    alignas(64) float fragmentDepths[pixelBlockPixelCount];
+    alignas(64) float inverseWs[pixelBlockPixelCount];
+    alignas(64) float ws[pixelBlockPixelCount];
+
+    for (std::size_t group = 0; group < groupCount; ++group)
+    {
+        const auto offset = group * laneCount;
+        const auto x = load(blockPixelXs + offset);
+        const auto y = load(blockPixelYs + offset);
+
+        store(fragmentDepths + offset,
+              min(max(add(add(set(blockPlanes.depth), mul(x, set(triangle.depthPlane.stepX))),
+                          mul(y, set(triangle.depthPlane.stepY))),
+                      set(triangle.minDepth)),
+                  set(triangle.maxDepth)));
+
+        const auto inverseW = add(add(set(blockPlanes.inverseW), mul(x, set(triangle.inverseWPlane.stepX))),
+                                  mul(y, set(triangle.inverseWPlane.stepY)));
+        store(inverseWs + offset, inverseW);
+        store(ws + offset, div(set(1.0F), inverseW));
+    }
+
+    // perspective-correct components of the varyings in structure-of-arrays layout
+    alignas(64) float components[Varyings<T>::componentCount][pixelBlockPixelCount];
+
+    for (std::size_t group = 0; group < groupCount; ++group)
+    {
+        const auto offset = group * laneCount;
+        const auto x = load(blockPixelXs + offset);
+        const auto y = load(blockPixelYs + offset);
+        const auto w = load(ws + offset);
+
+        for (std::size_t component = 0; component < Varyings<T>::componentCount; ++component)
+        {
+            const auto& plane = triangle.planes[component];
+            store(components[component] + offset,
+                  mul(add(add(set(blockPlanes.components[component]), mul(x, set(plane.stepX))),
+                          mul(y, set(plane.stepY))),
+                      w));
+        }
+    }
+
+    // the fragment shader takes a single pixel, the components of all pixels of the block are interpolated,
+    // so the uncovered ones are the helper pixels of the quads for the derivatives
+    alignas(64) float srcColors[4][pixelBlockPixelCount]{};
+
+    for (std::size_t pixel = 0; pixel < pixelBlockPixelCount; ++pixel)
+        if (shadeMask & (1U << pixel))
+        {
+            const auto srcColor = runFragmentShader<T>(triangle, pipeline, components, blockX, blockY,
+                                                       fragmentDepths[pixel], inverseWs[pixel], pixel);
+            srcColors[0][pixel] = srcColor.r;
+            srcColors[1][pixel] = srcColor.g;
+            srcColors[2][pixel] = srcColor.b;
+            srcColors[3][pixel] = srcColor.a;
+        }
+
+    constexpr bool blendEnabled = blendMode != disabledBlendMode;
+
+    // the color is blended with and written to every sample that passed
+    for (std::size_t sample = 0; sample < pipeline.sampleCount; ++sample)
+    {
+        const auto sampleMask = sampleMasks[sample];
+        if (!sampleMask) continue;
+
+        const auto frameBufferData = pipeline.frameBufferData + sample * pipeline.frameBufferSampleStride;
+        alignas(64) std::uint32_t colors[pixelBlockPixelCount]{};
+
+        if constexpr (blendEnabled)
+            loadBlock(colors, frameBufferData, pipeline.frameBufferWidth, blockX, blockY, sampleMask);
+
+        for (std::size_t group = 0; group < groupCount; ++group)
+        {
+            const auto offset = group * laneCount;
+
+            Float result[4]{
+                load(srcColors[0] + offset),
+                load(srcColors[1] + offset),
+                load(srcColors[2] + offset),
+                load(srcColors[3] + offset)
+            };
+
+            if constexpr (blendEnabled)
+            {
+                const auto& blendState = pipeline.blendState;
+                const auto mode = getKernelBlendMode<blendMode>(blendState);
+
+                const auto pixels = loadInt(colors + offset);
+                const Float destColor[4]{
+                    unpackChannel(pixels),
+                    unpackChannel(shiftRight<8>(pixels)),
+                    unpackChannel(shiftRight<16>(pixels)),
+                    unpackChannel(shiftRight<24>(pixels))
+                };
+                const Float blendFactor[4]{
+                    set(blendState.blendFactor.r),
+                    set(blendState.blendFactor.g),
+                    set(blendState.blendFactor.b),
+                    set(blendState.blendFactor.a)
+                };
+
+                // alpha blend
+                const auto srcAlpha = result[3];
+                for (std::size_t channel = 0; channel < 3; ++channel)
+                    result[channel] = getBlendResult(mode.colorOperation,
+                                                     mul(result[channel], getBlendFactor(mode.colorBlendSource, result[channel], srcAlpha, destColor[channel], destColor[3], blendFactor[channel])),
+                                                     mul(destColor[channel], getBlendFactor(mode.colorBlendDest, result[channel], srcAlpha, destColor[channel], destColor[3], blendFactor[channel])));
+
+                result[3] = getBlendResult(mode.alphaOperation,
+                                           mul(srcAlpha, getBlendFactor(mode.alphaBlendSource, srcAlpha, srcAlpha, destColor[3], destColor[3], blendFactor[3])),
+                                           mul(destColor[3], getBlendFactor(mode.alphaBlendDest, srcAlpha, srcAlpha, destColor[3], destColor[3], blendFactor[3])));
+            }
+
+            storeInt(colors + offset, orInt(orInt(packChannel(result[0]),
+                                                  shiftLeft<8>(packChannel(result[1]))),
+                                            orInt(shiftLeft<16>(packChannel(result[2])),
+                                                  shiftLeft<24>(packChannel(result[3])))));
+        }
+
+        storeBlock(colors, frameBufferData, pipeline.frameBufferWidth, blockX, blockY, sampleMask);
+    }
+}
+
+template <class T, class FragmentShaderType, PixelFormat depthFormat, bool depthRead, bool depthWrite, std::size_t... blendModeIndices>
+constexpr std::array<BlockShader<T, FragmentShaderType>, sizeof...(blendModeIndices)> getBlockShaders(std::index_sequence<blendModeIndices...>) noexcept
+{
+    return {shadeBlock<T, FragmentShaderType, depthFormat, depthRead, depthWrite, blendModeIndices>...};
+}
+
+template <class T, class FragmentShaderType>
+BlockShader<T, FragmentShaderType> getBlockShader(const PixelFormat depthFormat,
+                                                  const bool depthRead,
+                                                  const bool depthWrite,
+                                                  const std::size_t blendMode) noexcept
+{
+    using BlendModeIndices = std::make_index_sequence<blendModeCount>;
+
+    // the format does not matter without depth reads and writes, so those kernels exist only once
+    static constexpr std::array<std::array<BlockShader<T, FragmentShaderType>, blendModeCount>, 10> blockShaders{
+        getBlockShaders<T, FragmentShaderType, PixelFormat::float32, false, false>(BlendModeIndices{}),
+        getBlockShaders<T, FragmentShaderType, PixelFormat::float32, false, true>(BlendModeIndices{}),
+        getBlockShaders<T, FragmentShaderType, PixelFormat::float32, true, false>(BlendModeIndices{}),
+        getBlockShaders<T, FragmentShaderType, PixelFormat::float32, true, true>(BlendModeIndices{}),
+        getBlockShaders<T, FragmentShaderType, PixelFormat::depth16, false, true>(BlendModeIndices{}),
+        getBlockShaders<T, FragmentShaderType, PixelFormat::depth16, true, false>(BlendModeIndices{}),
+        getBlockShaders<T, FragmentShaderType, PixelFormat::depth16, true, true>(BlendModeIndices{}),
+        getBlockShaders<T, FragmentShaderType, PixelFormat::d24s8, false, true>(BlendModeIndices{}),
+        getBlockShaders<T, FragmentShaderType, PixelFormat::d24s8, true, false>(BlendModeIndices{}),
+        getBlockShaders<T, FragmentShaderType, PixelFormat::d24s8, true, true>(BlendModeIndices{})
+    };
+
+    const std::size_t depthMode = (depthRead ? 2 : 0) + (depthWrite ? 1 : 0);
+    const std::size_t formatOffset = depthMode == 0 ? 0 :
+        depthFormat == PixelFormat::depth16 ? 3 :
+        depthFormat == PixelFormat::d24s8 ? 6 : 0;
+
+    return blockShaders[formatOffset + depthMode][blendMode];
+}
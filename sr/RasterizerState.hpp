@@ -0,0 +1,36 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_RASTERIZERSTATE_HPP
+#define SR_RASTERIZERSTATE_HPP
+
+#include <cstdint>
+
+namespace sr
+{
+    class RasterizerState final
+    {
+    public:
+        enum class CullMode
+        {
+            none,
+            front,
+            back
+        };
+
+        // winding of the front-facing triangles in viewport coordinates (x to the right, y up)
+        enum class FrontFace
+        {
+            clockwise,
+            counterClockwise
+        };
+
+        // number of fractional bits of the fixed-point vertex positions (1 to 16)
+        std::uint32_t subpixelBits = 8;
+        RasterizerState::CullMode cullMode = RasterizerState::CullMode::none;
+        RasterizerState::FrontFace frontFace = RasterizerState::FrontFace::counterClockwise;
+    };
+}
+
+#endif
@@ -0,0 +1,180 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_RENDERPASS_HPP
+#define SR_RENDERPASS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "AlignedBuffer.hpp"
+#include "Color.hpp"
+#include "CommandBuffer.hpp"
+#include "RenderError.hpp"
+#include "Renderer.hpp"
+#include "Texture.hpp"
+#include "ThreadPool.hpp"
+
+namespace sr
+{
+    // The render targets of a sequence of draws and what happens to their contents at the start (load action)
+    // and at the end (store action) of it. The depth attachment (with its stencil) is only read from the texture
+    // for LoadAction::load and only written back to it for StoreAction::store, in between it stays in the tile
+    // memory of the threads. For LoadAction::dontCare the tile memory starts with clearDepth and clearStencil
+    // without clearing the texture, so that the depth tests do not depend on the tiles rendered before. The
+    // color attachment is always rendered into its texture, StoreAction::discard only tells that its contents
+    // are not needed.
+    class RenderPass final
+    {
+    public:
+        enum class LoadAction
+        {
+            clear,
+            load,
+            dontCare
+        };
+
+        enum class StoreAction
+        {
+            store,
+            discard
+        };
+
+        struct ColorAttachment final
+        {
+            Texture* texture = nullptr;
+            LoadAction loadAction = LoadAction::load;
+            StoreAction storeAction = StoreAction::store;
+            Color clearColor;
+        };
+
+        struct DepthAttachment final
+        {
+            Texture* texture = nullptr;
+            LoadAction loadAction = LoadAction::load;
+            StoreAction storeAction = StoreAction::store;
+            float clearDepth = 1.0F;
+            std::uint8_t clearStencil = 0;
+        };
+
+        ColorAttachment colorAttachment;
+        DepthAttachment depthAttachment;
+    };
+
+    // Runs the sorted draws of the command buffers into the attachments of the render pass, ignoring the render
+    // targets that they were recorded with. All draws are binned first and then every tile runs all of them
+    // before the next one starts, so the depth of a tile is loaded and stored once per pass instead of once per
+    // draw. The stencil test uses the depth attachment, which has to be d24s8 for it.
+    inline void submit(const RenderPass& renderPass, const std::vector<const CommandBuffer*>& commandBuffers)
+    {
+        const auto& colorAttachment = renderPass.colorAttachment;
+        const auto& depthAttachment = renderPass.depthAttachment;
+
+        if (!colorAttachment.texture || !depthAttachment.texture)
+            throw RenderError{"Render passes must have color and depth attachments"};
+
+        auto& frameBuffer = *colorAttachment.texture;
+        auto& depthBuffer = *depthAttachment.texture;
+
+        if (frameBuffer.getPixelFormat() != PixelFormat::rgba8)
+            throw RenderError{"Invalid frame buffer format"};
+
+        if (!isDepthFormat(depthBuffer.getPixelFormat()))
+            throw RenderError{"Invalid depth buffer format"};
+
+        if (frameBuffer.getLayout() != Texture::Layout::linear || depthBuffer.getLayout() != Texture::Layout::linear)
+            throw RenderError{"Render targets must have the linear layout"};
+
+        if (depthBuffer.getWidth() != frameBuffer.getWidth() ||
+            depthBuffer.getHeight() != frameBuffer.getHeight() ||
+            depthBuffer.getSampleCount() != frameBuffer.getSampleCount())
+            throw RenderError{"The attachments of a render pass must have the same size and sample count"};
+
+        const auto tileCountX = (frameBuffer.getWidth() + tileSize - 1) / tileSize;
+        const auto tileCountY = (frameBuffer.getHeight() + tileSize - 1) / tileSize;
+        const auto tileCount = tileCountX * tileCountY;
+
+        auto& tileDepthRanges = depthBuffer.getTileDepthRanges();
+        if (tileDepthRanges.size() != tileCount)
+            tileDepthRanges.assign(tileCount, Texture::DepthRange{});
+
+        // clears only record the clear value, the tiles are written when they are rendered or stored
+        if (colorAttachment.loadAction == RenderPass::LoadAction::clear)
+            fastClear(frameBuffer, colorAttachment.clearColor);
+        if (depthAttachment.loadAction == RenderPass::LoadAction::clear)
+            fastClear(depthBuffer, depthAttachment.clearDepth, depthAttachment.clearStencil);
+
+        const bool loadDepth = depthAttachment.loadAction != RenderPass::LoadAction::dontCare;
+        const bool storeDepth = depthAttachment.storeAction == RenderPass::StoreAction::store;
+
+        // the tiles are stored concurrently, so the version of the data is updated once before
+        if (storeDepth) depthBuffer.getRenderTargetData();
+
+        std::vector<std::pair<const DrawCommand*, std::shared_ptr<const void>>> draws;
+        for (const auto command : getSortedCommands(commandBuffers))
+            if (auto binnedDraw = command->bin(*command, frameBuffer, depthBuffer))
+                draws.emplace_back(command, std::move(binnedDraw));
+
+        if (draws.empty()) return;
+
+        const auto depthFormat = depthBuffer.getPixelFormat();
+        const auto pixelSize = getPixelSize(depthFormat);
+        const auto tileMemorySize = tileSize * tileSize * pixelSize * depthBuffer.getSampleCount();
+
+        auto& threadPool = getThreadPool();
+        std::vector<TileMemory> tileMemories(threadPool.getThreadCount());
+        for (auto& tileMemory : tileMemories)
+            tileMemory.depthData.allocate(tileMemorySize);
+
+        // the tile that every tile memory starts with if the depth is not loaded, filled once
+        AlignedBuffer clearedTileData;
+        if (!loadDepth)
+        {
+            clearedTileData.allocate(tileMemorySize);
+            const auto pixel = getDepthPixel(depthFormat, depthAttachment.clearDepth, depthAttachment.clearStencil);
+            for (std::size_t offset = 0; offset < tileMemorySize; offset += pixelSize)
+                std::memcpy(clearedTileData.getData() + offset, pixel.data(), pixelSize);
+        }
+        const auto clearedTileDepthRange = getClearDepthRange(depthFormat, depthAttachment.clearDepth);
+
+        threadPool.parallelFor(tileCount, [&](const std::size_t tile, const std::size_t threadIndex) {
+            // the tiles that no draw reaches keep their contents (or their pending clear)
+            if (std::none_of(draws.begin(), draws.end(), [tile](const auto& draw) noexcept {
+                return draw.first->overlapsTile(draw.second.get(), tile);
+            }))
+                return;
+
+            auto& tileMemory = tileMemories[threadIndex];
+            if (loadDepth)
+            {
+                depthBuffer.readTile(tile, tileMemory.depthData.getData());
+                tileMemory.depthRange = tileDepthRanges[tile];
+            }
+            else
+            {
+                std::memcpy(tileMemory.depthData.getData(), clearedTileData.getData(), tileMemorySize);
+                tileMemory.depthRange = clearedTileDepthRange;
+            }
+
+            for (const auto& draw : draws)
+                draw.first->rasterizeTile(draw.second.get(), tile, &tileMemory);
+
+            if (storeDepth)
+            {
+                depthBuffer.writeTile(tile, tileMemory.depthData.getData());
+                tileDepthRanges[tile] = tileMemory.depthRange;
+            }
+        });
+    }
+
+    inline void submit(const RenderPass& renderPass, const CommandBuffer& commandBuffer)
+    {
+        submit(renderPass, std::vector<const CommandBuffer*>{&commandBuffer});
+    }
+}
+
+#endif
@@ -8,21 +8,767 @@
 #include <cassert>
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <limits>
+#include <type_traits>
+#include <vector>
+#include "AlignedBuffer.hpp"
 #include "BlendState.hpp"
+#include "Clipping.hpp"
 #include "Color.hpp"
 #include "DepthState.hpp"
 #include "Matrix.hpp"
+#include "PixelKernels.hpp"
+#include "RasterizerState.hpp"
 #include "Rect.hpp"
 #include "RenderError.hpp"
 #include "Sampler.hpp"
 #include "Shader.hpp"
+#include "Statistics.hpp"
+#include "StencilState.hpp"
 #include "Texture.hpp"
+#include "ThreadPool.hpp"
+#include "TriangleSetup.hpp"
 #include "Vector.hpp"
 #include "Vertex.hpp"
 
 namespace sr
 {
+    // number of vertices that are shaded by a single job
+    constexpr std::size_t verticesPerChunk = 1024;
+
+    // number of triangles that are clipped, set up and binned by a single job
+    constexpr std::size_t trianglesPerChunk = 256;
+
+    // visible triangles of a chunk and their indices sorted by the tile they overlap
+    template <std::size_t componentCount>
+    struct TriangleBins final
+    {
+        std::vector<TriangleSetup<componentCount>> triangles;
+        std::vector<std::uint32_t> tileOffsets;
+        std::vector<std::uint32_t> indices;
+    };
+
+    enum class Coverage
+    {
+        none,
+        partial,
+        full
+    };
+
+    // per-thread counterparts of Statistics, flushed once per tile
+    struct BlockCounters final
+    {
+        std::uint64_t accepted = 0;
+        std::uint64_t rejected = 0;
+        std::uint64_t partial = 0;
+
+        void flush(Statistics::Blocks& blocks) noexcept
+        {
+            blocks.accepted += accepted;
+            blocks.rejected += rejected;
+            blocks.partial += partial;
+        }
+    };
+
+    // edge functions are linear, so their extremes over a block are at its corners, widened by the extent
+    // of the samples of multisampled render targets
+    template <std::size_t componentCount>
+    Coverage getCoverage(const TriangleSetup<componentCount>& triangle,
+                         const std::array<std::int64_t, 3>& edges,
+                         const std::size_t width,
+                         const std::size_t height,
+                         const std::size_t sampleCount) noexcept
+    {
+        auto coverage = Coverage::full;
+
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            const auto offsetX = triangle.edgeStepsX[i] * static_cast<std::int64_t>(width - 1);
+            const auto offsetY = triangle.edgeStepsY[i] * static_cast<std::int64_t>(height - 1);
+            const auto sampleExtent = sampleCount > 1 ?
+                (std::abs(triangle.edgeStepsX[i]) + std::abs(triangle.edgeStepsY[i])) / 16 * maxSampleOffset : 0;
+            const auto minEdge = edges[i] + std::min(offsetX, std::int64_t(0)) + std::min(offsetY, std::int64_t(0)) - sampleExtent;
+            const auto maxEdge = edges[i] + std::max(offsetX, std::int64_t(0)) + std::max(offsetY, std::int64_t(0)) + sampleExtent;
+
+            if (maxEdge < triangle.edgeThresholds[i]) return Coverage::none;
+            if (minEdge < triangle.edgeThresholds[i]) coverage = Coverage::partial;
+        }
+
+        return coverage;
+    }
+
+    // mask of the pixels of the block at (blockX, blockY) that are inside of [minX, maxX] x [minY, maxY]
+    inline std::uint32_t getBlockMask(const std::size_t blockX,
+                                      const std::size_t blockY,
+                                      const std::size_t minX,
+                                      const std::size_t minY,
+                                      const std::size_t maxX,
+                                      const std::size_t maxY) noexcept
+    {
+        std::uint32_t rowMask = 0;
+        for (std::size_t x = 0; x < pixelBlockSize; ++x)
+            if (blockX + x >= minX && blockX + x <= maxX) rowMask |= 1U << x;
+
+        std::uint32_t mask = 0;
+        for (std::size_t y = 0; y < pixelBlockSize; ++y)
+            if (blockY + y >= minY && blockY + y <= maxY) mask |= rowMask << (y * pixelBlockSize);
+
+        return mask;
+    }
+
+    // rasterizes the triangle hierarchically: 8x8 blocks and then 4x4 blocks that are shaded by the pixel kernel,
+    // skipping the blocks that are outside of the triangle and shading fully covered blocks without coverage tests
+    template <class T, class FragmentShaderType>
+    void rasterizeTriangle(const TriangleSetup<Varyings<T>::componentCount>& triangle,
+                           const PixelPipeline<FragmentShaderType>& pipeline,
+                           const BlockShader<T, FragmentShaderType> blockShader,
+                           const std::size_t minX,
+                           const std::size_t minY,
+                           const std::size_t maxX,
+                           const std::size_t maxY,
+                           std::array<BlockCounters, 2>& blockCounters)
+    {
+        constexpr std::size_t blockSize = 8;
+
+        for (auto blockY = minY & ~(blockSize - 1); blockY <= maxY; blockY += blockSize)
+            for (auto blockX = minX & ~(blockSize - 1); blockX <= maxX; blockX += blockSize)
+            {
+                const auto blockMinX = std::max(blockX, minX);
+                const auto blockMinY = std::max(blockY, minY);
+                const auto blockMaxX = std::min(blockX + blockSize - 1, maxX);
+                const auto blockMaxY = std::min(blockY + blockSize - 1, maxY);
+
+                const auto coverage = getCoverage(triangle, getEdges(triangle, blockMinX, blockMinY),
+                                                  blockMaxX - blockMinX + 1, blockMaxY - blockMinY + 1,
+                                                  pipeline.sampleCount);
+
+                if (coverage == Coverage::none)
+                {
+                    ++blockCounters[0].rejected;
+                    continue;
+                }
+
+                if (coverage == Coverage::full)
+                    ++blockCounters[0].accepted;
+                else
+                    ++blockCounters[0].partial;
+
+                for (auto subBlockY = blockY; subBlockY <= blockMaxY; subBlockY += pixelBlockSize)
+                    for (auto subBlockX = blockX; subBlockX <= blockMaxX; subBlockX += pixelBlockSize)
+                    {
+                        const auto subBlockMinX = std::max(subBlockX, blockMinX);
+                        const auto subBlockMinY = std::max(subBlockY, blockMinY);
+                        const auto subBlockMaxX = std::min(subBlockX + pixelBlockSize - 1, blockMaxX);
+                        const auto subBlockMaxY = std::min(subBlockY + pixelBlockSize - 1, blockMaxY);
+
+                        if (subBlockMinX > subBlockMaxX || subBlockMinY > subBlockMaxY) continue;
+
+                        const auto mask = getBlockMask(subBlockX, subBlockY, subBlockMinX, subBlockMinY, subBlockMaxX, subBlockMaxY);
+
+                        if (coverage == Coverage::full)
+                        {
+                            blockShader(triangle, pipeline, subBlockX, subBlockY, mask, false);
+                            continue;
+                        }
+
+                        switch (getCoverage(triangle, getEdges(triangle, subBlockMinX, subBlockMinY),
+                                            subBlockMaxX - subBlockMinX + 1, subBlockMaxY - subBlockMinY + 1,
+                                            pipeline.sampleCount))
+                        {
+                            case Coverage::none:
+                                ++blockCounters[1].rejected;
+                                break;
+                            case Coverage::full:
+                                ++blockCounters[1].accepted;
+                                blockShader(triangle, pipeline, subBlockX, subBlockY, mask, false);
+                                break;
+                            case Coverage::partial:
+                                ++blockCounters[1].partial;
+                                blockShader(triangle, pipeline, subBlockX, subBlockY, mask, true);
+                                break;
+                        }
+                    }
+            }
+    }
+
+    // range of the depths of all samples in the rectangle, NaNs make it unbounded because they pass every depth test
+    template <class FragmentShaderType>
+    Texture::DepthRange getDepthRange(const PixelPipeline<FragmentShaderType>& pipeline,
+                                      const std::size_t minX,
+                                      const std::size_t minY,
+                                      const std::size_t maxX,
+                                      const std::size_t maxY) noexcept
+    {
+        Texture::DepthRange depthRange;
+
+        for (std::size_t sample = 0; sample < pipeline.sampleCount; ++sample)
+            for (auto y = minY; y <= maxY; ++y)
+                for (auto x = minX; x <= maxX; ++x)
+                {
+                    const auto depth = readDepth(pipeline.depthBufferData, pipeline.depthBufferFormat,
+                                                 y * pipeline.depthBufferWidth + x + sample * pipeline.depthBufferSampleStride);
+                    depthRange.nearest = std::min(depthRange.nearest, depth);
+                    depthRange.farthest = std::max(depthRange.farthest, depth);
+                    if (std::isnan(depth))
+                        return {-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+                }
+
+        return depthRange;
+    }
+
+    // the type of the varyings that the vertex shader returns
+    template <class VertexShaderType>
+    using VertexShaderResult = std::decay_t<std::invoke_result_t<const VertexShaderType&, const Matrix<float, 4>&, const Vertex&>>;
+
+    // The depth (and the stencil of d24s8) of the tile that a thread renders in a render pass. Its rows are tileSize
+    // pixels long and its samples are planes of tileSize * tileSize pixels.
+    struct TileMemory final
+    {
+        AlignedBuffer depthData;
+        Texture::DepthRange depthRange;
+    };
+
+    // A draw call whose triangles are set up and binned into tiles, so that every tile can be rasterized on its
+    // own. The states and the fragment shader are referenced, so they have to outlive it.
+    template <class T, class FragmentShaderType>
+    struct BinnedDraw final
+    {
+        Texture* frameBuffer = nullptr;
+        Texture* depthBuffer = nullptr;
+        Texture* stencilBuffer = nullptr;
+        std::uint32_t* frameBufferData = nullptr;
+        void* depthBufferData = nullptr;
+        std::uint8_t* stencilBufferData = nullptr; // the stencil of the first pixel, null if the stencil test is disabled
+        const FragmentShaderType* fragmentShader = nullptr;
+        const std::array<const Sampler*, 2>* samplers = nullptr;
+        const std::array<const Texture*, 2>* textures = nullptr;
+        const BlendState* blendState = nullptr;
+        const DepthState* depthState = nullptr;
+        const StencilState* stencilState = nullptr;
+        BlockShader<T, FragmentShaderType> blockShader = nullptr;
+        BlockShader<T, FragmentShaderType> acceptedBlockShader = nullptr;
+        std::size_t width = 0;
+        std::size_t height = 0;
+        std::size_t tileCountX = 0;
+        std::size_t tileCount = 0;
+        std::size_t sampleCount = 1;
+        bool hierarchicalZ = false;
+        bool hierarchicalZReject = false;
+        bool stencilTiled = false;
+        std::vector<TriangleBins<Varyings<T>::componentCount>> bins;
+    };
+
+    // Validates the draw call, shades its vertices and sets up and bins its triangles. Returns false if
+    // nothing can be drawn.
+    template <class VertexShaderType, class FragmentShaderType>
+    bool binTriangles(BinnedDraw<VertexShaderResult<VertexShaderType>, FragmentShaderType>& draw,
+                      Texture& frameBuffer,
+                      Texture& depthBuffer,
+                      Texture& stencilBuffer,
+                      const VertexShaderType& vertexShader,
+                      const FragmentShaderType& fragmentShader,
+                      const std::array<const Sampler*, 2>& samplers,
+                      const std::array<const Texture*, 2>& textures,
+                      const Rect<float>& viewport,
+                      const Rect<float>& scissorRect,
+                      const BlendState& blendState,
+                      const DepthState& depthState,
+                      const StencilState& stencilState,
+                      const RasterizerState& rasterizerState,
+                      const Span<const std::size_t>& indices,
+                      const Span<const Vertex>& vertices,
+                      const Matrix<float, 4>& modelViewProjection)
+    {
+        using T = VertexShaderResult<VertexShaderType>;
+        constexpr auto componentCount = Varyings<T>::componentCount;
+
+        const auto width = frameBuffer.getWidth();
+        const auto height = frameBuffer.getHeight();
+        if (width == 0 || height == 0) return false;
+        if (viewport.size.v[0] == 0.0F || viewport.size.v[1] == 0.0F) return false;
+
+        if (rasterizerState.subpixelBits < 1 || rasterizerState.subpixelBits > 16)
+            throw RenderError{"Invalid subpixel precision"};
+
+        // the pixel kernels address the render targets by rows
+        if (frameBuffer.getLayout() != Texture::Layout::linear || depthBuffer.getLayout() != Texture::Layout::linear)
+            throw RenderError{"Render targets must have the linear layout"};
+
+        if (!isDepthFormat(depthBuffer.getPixelFormat()))
+            throw RenderError{"Invalid depth buffer format"};
+
+        if (stencilState.enabled)
+        {
+            if (!isStencilFormat(stencilBuffer.getPixelFormat()))
+                throw RenderError{"Invalid stencil buffer format"};
+
+            if (stencilBuffer.getLayout() != Texture::Layout::linear)
+                throw RenderError{"Render targets must have the linear layout"};
+        }
+
+        // the samples of all render targets are in planes of the same size
+        const auto sampleCount = frameBuffer.getSampleCount();
+        if (sampleCount > 1)
+        {
+            if (depthBuffer.getSampleCount() != sampleCount ||
+                depthBuffer.getWidth() != width || depthBuffer.getHeight() != height ||
+                (stencilState.enabled && (stencilBuffer.getSampleCount() != sampleCount ||
+                                          stencilBuffer.getWidth() != width || stencilBuffer.getHeight() != height)))
+                throw RenderError{"Multisampled render targets must have the same size and sample count"};
+
+            // the sample positions are in 1/16 of a pixel
+            if (rasterizerState.subpixelBits < 4)
+                throw RenderError{"Invalid subpixel precision"};
+        }
+        else if (depthBuffer.getSampleCount() != 1 || (stencilState.enabled && stencilBuffer.getSampleCount() != 1))
+            throw RenderError{"Multisampled render targets must have the same size and sample count"};
+
+        // scissor rectangle in pixels
+        const Rect<std::size_t> scissor{
+            static_cast<std::size_t>(static_cast<float>(width - 1) * scissorRect.position.v[0]),
+            static_cast<std::size_t>(static_cast<float>(height - 1) * scissorRect.position.v[1]),
+            static_cast<std::size_t>(static_cast<float>(width - 1) * scissorRect.size.v[0]),
+            static_cast<std::size_t>(static_cast<float>(height - 1) * scissorRect.size.v[1])
+        };
+
+        const auto simdWidth = getSimdWidth();
+        const auto depthFormat = depthBuffer.getPixelFormat();
+
+        draw.frameBuffer = &frameBuffer;
+        draw.depthBuffer = &depthBuffer;
+        draw.stencilBuffer = &stencilBuffer;
+        draw.frameBufferData = reinterpret_cast<std::uint32_t*>(frameBuffer.getRenderTargetData().data());
+        draw.depthBufferData = depthBuffer.getRenderTargetData().data();
+        draw.stencilBufferData = stencilState.enabled ?
+            stencilBuffer.getRenderTargetData().data() + getStencilOffset(stencilBuffer.getPixelFormat()) :
+            nullptr;
+        draw.fragmentShader = &fragmentShader;
+        draw.samplers = &samplers;
+        draw.textures = &textures;
+        draw.blendState = &blendState;
+        draw.depthState = &depthState;
+        draw.stencilState = &stencilState;
+        draw.blockShader = getBlockShader<T, FragmentShaderType>(simdWidth, blendState, depthFormat, depthState);
+        draw.acceptedBlockShader = getBlockShader<T, FragmentShaderType>(simdWidth, blendState, depthFormat,
+                                                                         DepthState{false, depthState.write});
+        draw.width = width;
+        draw.height = height;
+        draw.sampleCount = sampleCount;
+
+        // half of the range of the fixed-point positions, so that the clipped vertices stay inside of it
+        const auto guardBand = static_cast<float>(std::int64_t(1) << (28 - rasterizerState.subpixelBits));
+        const auto clipPlanes = getClipPlanes(viewport, guardBand);
+
+        const auto tileCountX = (width + tileSize - 1) / tileSize;
+        const auto tileCountY = (height + tileSize - 1) / tileSize;
+        const auto tileCount = tileCountX * tileCountY;
+        draw.tileCountX = tileCountX;
+        draw.tileCount = tileCount;
+
+        // hierarchical Z: the depth ranges of the tiles reject the triangles that are behind them
+        draw.hierarchicalZ = depthBuffer.getWidth() == width && depthBuffer.getHeight() == height;
+        auto& tileDepthRanges = depthBuffer.getTileDepthRanges();
+        if (draw.hierarchicalZ && tileDepthRanges.size() != tileCount)
+            tileDepthRanges.assign(tileCount, Texture::DepthRange{});
+        else if (!draw.hierarchicalZ && depthState.write)
+            depthBuffer.resetTileDepthRanges();
+
+        // the tiles of a depth buffer of another size than the frame buffer do not match the tiles of the draw
+        if ((depthState.read || depthState.write) && !draw.hierarchicalZ)
+            depthBuffer.resolveClear();
+
+        draw.stencilTiled = stencilBuffer.getWidth() == width && stencilBuffer.getHeight() == height;
+        if (stencilState.enabled && !draw.stencilTiled)
+            stencilBuffer.resolveClear();
+
+        // the stencil operations of the pixels that fail the depth test have to run, so those triangles can't
+        // be rejected by their depth alone
+        draw.hierarchicalZReject = !writesStencilOnFail(stencilState);
+
+        const auto triangleCount = indices.size() / 3;
+        const auto chunkCount = (triangleCount + trianglesPerChunk - 1) / trianglesPerChunk;
+
+        auto& bins = draw.bins;
+        bins.resize(chunkCount);
+        ThreadPool& threadPool = getThreadPool();
+
+        // post-transform vertex cache: every vertex that the triangles refer to is shaded once per draw call
+        constexpr auto unusedSlot = std::numeric_limits<std::uint32_t>::max();
+        std::vector<std::uint32_t> vertexSlots(vertices.size(), unusedSlot);
+        std::vector<std::uint32_t> slotVertices;
+
+        for (std::size_t i = 0; i < triangleCount * 3; ++i)
+        {
+            const auto index = indices[i];
+            if (index >= vertices.size())
+                throw RenderError{"Invalid vertex index"};
+
+            auto& slot = vertexSlots[index];
+            if (slot == unusedSlot)
+            {
+                slot = static_cast<std::uint32_t>(slotVertices.size());
+                slotVertices.push_back(static_cast<std::uint32_t>(index));
+            }
+        }
+
+        std::vector<T> vsOutputCache(slotVertices.size());
+        const auto vertexChunkCount = (slotVertices.size() + verticesPerChunk - 1) / verticesPerChunk;
+
+        threadPool.parallelFor(vertexChunkCount, [&](const std::size_t chunk, std::size_t) {
+            const auto firstSlot = chunk * verticesPerChunk;
+            const auto lastSlot = std::min(firstSlot + verticesPerChunk, slotVertices.size());
+
+            for (auto slot = firstSlot; slot < lastSlot; ++slot)
+                vsOutputCache[slot] = vertexShader(modelViewProjection, vertices[slotVertices[slot]]);
+        });
+
+        Statistics& statistics = getStatistics();
+        statistics.vertexCache.hits += triangleCount * 3 - slotVertices.size();
+        statistics.vertexCache.misses += slotVertices.size();
+
+        // front end: clip, set up and bin the triangles into tiles
+        threadPool.parallelFor(chunkCount, [&](const std::size_t chunk, std::size_t) {
+            const auto firstTriangle = chunk * trianglesPerChunk;
+            const auto lastTriangle = std::min(firstTriangle + trianglesPerChunk, triangleCount);
+
+            auto& chunkBins = bins[chunk];
+            chunkBins.triangles.clear();
+            chunkBins.triangles.reserve(lastTriangle - firstTriangle);
+
+            std::array<T, maxClippedVertexCount> polygon;
+            TriangleSetup<componentCount> triangle;
+
+            for (auto t = firstTriangle; t < lastTriangle; ++t)
+            {
+                const std::array<T, 3> vsOutputs{
+                    vsOutputCache[vertexSlots[indices[t * 3 + 0]]],
+                    vsOutputCache[vertexSlots[indices[t * 3 + 1]]],
+                    vsOutputCache[vertexSlots[indices[t * 3 + 2]]]
+                };
+
+                const auto vertexCount = clipTriangle(vsOutputs, clipPlanes, polygon);
+
+                // the clipped polygon is convex, so it is split into a triangle fan
+                for (std::size_t i = 2; i < vertexCount; ++i)
+                {
+                    setupTriangle<T>(triangle, {polygon[0], polygon[i - 1], polygon[i]}, viewport, scissor, rasterizerState, sampleCount);
+                    if (triangle.visible) chunkBins.triangles.push_back(triangle);
+                }
+            }
+
+            // counting sort of the triangles by tile keeps the submission order inside every tile
+            chunkBins.tileOffsets.assign(tileCount + 1, 0);
+
+            for (const auto& chunkTriangle : chunkBins.triangles)
+                for (auto tileY = chunkTriangle.minY / tileSize; tileY <= chunkTriangle.maxY / tileSize; ++tileY)
+                    for (auto tileX = chunkTriangle.minX / tileSize; tileX <= chunkTriangle.maxX / tileSize; ++tileX)
+                        ++chunkBins.tileOffsets[tileY * tileCountX + tileX + 1];
+
+            for (std::size_t tile = 0; tile < tileCount; ++tile)
+                chunkBins.tileOffsets[tile + 1] += chunkBins.tileOffsets[tile];
+
+            chunkBins.indices.resize(chunkBins.tileOffsets[tileCount]);
+            std::vector<std::uint32_t> positions(chunkBins.tileOffsets.begin(), chunkBins.tileOffsets.end() - 1);
+
+            for (std::size_t i = 0; i < chunkBins.triangles.size(); ++i)
+            {
+                const auto& chunkTriangle = chunkBins.triangles[i];
+
+                for (auto tileY = chunkTriangle.minY / tileSize; tileY <= chunkTriangle.maxY / tileSize; ++tileY)
+                    for (auto tileX = chunkTriangle.minX / tileSize; tileX <= chunkTriangle.maxX / tileSize; ++tileX)
+                        chunkBins.indices[positions[tileY * tileCountX + tileX]++] = static_cast<std::uint32_t>(i);
+            }
+        });
+
+        return true;
+    }
+
+    // whether any triangle of the binned draw overlaps the tile
+    template <class T, class FragmentShaderType>
+    bool overlapsTile(const BinnedDraw<T, FragmentShaderType>& draw, const std::size_t tile) noexcept
+    {
+        constexpr auto componentCount = Varyings<T>::componentCount;
+
+        return std::any_of(draw.bins.begin(), draw.bins.end(), [tile](const TriangleBins<componentCount>& chunkBins) noexcept {
+            return chunkBins.tileOffsets[tile] != chunkBins.tileOffsets[tile + 1];
+        });
+    }
+
+    // Rasterizes the triangles of a binned draw that overlap the tile, in submission order. The depth buffer
+    // (and the stencil buffer if it is the same texture) is read from and written to the tile memory if it is given.
+    template <class T, class FragmentShaderType>
+    void rasterizeTile(const BinnedDraw<T, FragmentShaderType>& draw,
+                       const std::size_t tile,
+                       TileMemory* tileMemory)
+    {
+        if (!overlapsTile(draw, tile)) return;
+
+        const auto tileMinX = (tile % draw.tileCountX) * tileSize;
+        const auto tileMinY = (tile / draw.tileCountX) * tileSize;
+        const auto tileMaxX = std::min(tileMinX + tileSize, draw.width) - 1;
+        const auto tileMaxY = std::min(tileMinY + tileSize, draw.height) - 1;
+
+        auto& frameBuffer = *draw.frameBuffer;
+        auto& depthBuffer = *draw.depthBuffer;
+        auto& stencilBuffer = *draw.stencilBuffer;
+        const auto& depthState = *draw.depthState;
+        const auto& stencilState = *draw.stencilState;
+        const auto depthFormat = depthBuffer.getPixelFormat();
+        const bool depthUsed = depthState.read || depthState.write;
+        const bool stencilInTileMemory = tileMemory && &stencilBuffer == &depthBuffer;
+
+        // fast-cleared tiles are written before the first triangle that reaches them, the others stay cleared
+        frameBuffer.resolveClear(tile);
+        if (depthUsed && draw.hierarchicalZ && !tileMemory) depthBuffer.resolveClear(tile);
+        if (stencilState.enabled && draw.stencilTiled && !stencilInTileMemory) stencilBuffer.resolveClear(tile);
+
+        // the pointers into the tile memory are offset by the origin of the tile, so that the kernels address it
+        // with the coordinates of the render target
+        const auto depthPixelSize = getPixelSize(depthFormat);
+        const auto tileMemoryData = tileMemory ?
+            tileMemory->depthData.getData() - (tileMinY * tileSize + tileMinX) * depthPixelSize : nullptr;
+        const auto stencilFormat = stencilBuffer.getPixelFormat();
+
+        const PixelPipeline<FragmentShaderType> pipeline{
+            draw.frameBufferData,
+            draw.width,
+            draw.width * draw.height,
+            tileMemory ? static_cast<void*>(tileMemoryData) : draw.depthBufferData,
+            tileMemory ? tileSize : depthBuffer.getWidth(),
+            tileMemory ? tileSize * tileSize : draw.width * draw.height,
+            depthFormat,
+            stencilInTileMemory && stencilState.enabled ? tileMemoryData + getStencilOffset(stencilFormat) :
+                draw.stencilBufferData,
+            stencilInTileMemory ? tileSize : stencilBuffer.getWidth(),
+            stencilInTileMemory ? tileSize * tileSize : draw.width * draw.height,
+            getPixelSize(stencilFormat),
+            *draw.fragmentShader,
+            *draw.samplers,
+            *draw.textures,
+            *draw.blendState,
+            depthState,
+            stencilState,
+            draw.sampleCount
+        };
+
+        // triangles in front of everything in a tile pass the depth test without reading the depth buffer
+        const DepthState acceptedDepthState{false, depthState.write};
+        const PixelPipeline<FragmentShaderType> acceptedPipeline{
+            pipeline.frameBufferData,
+            pipeline.frameBufferWidth,
+            pipeline.frameBufferSampleStride,
+            pipeline.depthBufferData,
+            pipeline.depthBufferWidth,
+            pipeline.depthBufferSampleStride,
+            pipeline.depthBufferFormat,
+            pipeline.stencilBufferData,
+            pipeline.stencilBufferWidth,
+            pipeline.stencilBufferSampleStride,
+            pipeline.stencilPixelSize,
+            pipeline.fragmentShader,
+            pipeline.samplers,
+            pipeline.textures,
+            pipeline.blendState,
+            acceptedDepthState,
+            stencilState,
+            pipeline.sampleCount
+        };
+
+        std::array<BlockCounters, 2> blockCounters;
+        std::uint64_t hierarchicalZRejected = 0;
+        std::uint64_t hierarchicalZAccepted = 0;
+
+        Texture::DepthRange* tileDepthRange = tileMemory ? &tileMemory->depthRange :
+            draw.hierarchicalZ ? &depthBuffer.getTileDepthRanges()[tile] : nullptr;
+        bool depthRangeRefreshed = false;
+
+        for (const auto& chunkBins : draw.bins)
+            for (auto i = chunkBins.tileOffsets[tile]; i < chunkBins.tileOffsets[tile + 1]; ++i)
+            {
+                const auto& triangle = chunkBins.triangles[chunkBins.indices[i]];
+                const PixelPipeline<FragmentShaderType>* trianglePipeline = &pipeline;
+                auto triangleBlockShader = draw.blockShader;
+
+                // the ranges hold the values that the depth buffer stores
+                const auto minDepth = quantizeDepth(depthFormat, triangle.minDepth);
+                const auto maxDepth = quantizeDepth(depthFormat, triangle.maxDepth);
+
+                if (tileDepthRange && depthState.read)
+                {
+                    // the range is unknown until the tile is read for the first time
+                    if (tileDepthRange->nearest > tileDepthRange->farthest)
+                        *tileDepthRange = getDepthRange(pipeline, tileMinX, tileMinY, tileMaxX, tileMaxY);
+                    // a stale farthest depth is read again (at most once per draw) only if it could reject the triangle
+                    else if (tileDepthRange->stale && !depthRangeRefreshed && draw.hierarchicalZReject &&
+                             minDepth > tileDepthRange->nearest && minDepth <= tileDepthRange->farthest)
+                    {
+                        *tileDepthRange = getDepthRange(pipeline, tileMinX, tileMinY, tileMaxX, tileMaxY);
+                        depthRangeRefreshed = true;
+                    }
+
+                    // the interpolated depths are clamped to the range of the triangle, so the tests are exact
+                    if (minDepth > tileDepthRange->farthest && draw.hierarchicalZReject)
+                    {
+                        ++hierarchicalZRejected;
+                        continue;
+                    }
+
+                    if (maxDepth <= tileDepthRange->nearest)
+                    {
+                        ++hierarchicalZAccepted;
+                        trianglePipeline = &acceptedPipeline;
+                        triangleBlockShader = draw.acceptedBlockShader;
+                    }
+                }
+
+                rasterizeTriangle<T>(triangle,
+                                     *trianglePipeline,
+                                     triangleBlockShader,
+                                     std::max(triangle.minX, tileMinX),
+                                     std::max(triangle.minY, tileMinY),
+                                     std::min(triangle.maxX, tileMaxX),
+                                     std::min(triangle.maxY, tileMaxY),
+                                     blockCounters);
+
+                // widen the range by the depths that the triangle could have written
+                if (depthState.write && tileDepthRange &&
+                    tileDepthRange->nearest <= tileDepthRange->farthest)
+                {
+                    tileDepthRange->nearest = std::min(tileDepthRange->nearest, minDepth);
+                    if (!depthState.read)
+                        tileDepthRange->farthest = std::max(tileDepthRange->farthest, maxDepth);
+                    else
+                    {
+                        // the depth test only lets nearer depths through, so the farthest depth stays a bound, and
+                        // every sample of a tile that the triangle covers completely ends up at most at its depth
+                        tileDepthRange->stale = true;
+                        if (!stencilState.enabled &&
+                            triangle.minX <= tileMinX && triangle.minY <= tileMinY &&
+                            triangle.maxX >= tileMaxX && triangle.maxY >= tileMaxY &&
+                            getCoverage(triangle, getEdges(triangle, tileMinX, tileMinY),
+                                        tileMaxX - tileMinX + 1, tileMaxY - tileMinY + 1,
+                                        pipeline.sampleCount) == Coverage::full)
+                            tileDepthRange->farthest = std::min(tileDepthRange->farthest, maxDepth);
+                    }
+                }
+            }
+
+        Statistics& statistics = getStatistics();
+        blockCounters[0].flush(statistics.blocks8x8);
+        blockCounters[1].flush(statistics.blocks4x4);
+        statistics.hierarchicalZ.rejected += hierarchicalZRejected;
+        statistics.hierarchicalZ.accepted += hierarchicalZAccepted;
+    }
+
+    // The shaders can be any callables with the signatures of VertexShader and FragmentShader (e.g. lambdas that
+    // capture their uniforms), so that they are inlined into the pixel kernels. They are called concurrently
+    // from the threads of the thread pool. The vertex shader can return any type that Varyings describes,
+    // the fragment shader takes the same type. The stencil buffer (stencil8 or d24s8, which can be the depth
+    // buffer itself) is only accessed if the stencil test is enabled. The indices refer to the given range
+    // of vertices.
+    template <class VertexShaderType, class FragmentShaderType>
+    void drawTriangles(Texture& frameBuffer,
+                       Texture& depthBuffer,
+                       Texture& stencilBuffer,
+                       const VertexShaderType& vertexShader,
+                       const FragmentShaderType& fragmentShader,
+                       const std::array<const Sampler*, 2>& samplers,
+                       const std::array<const Texture*, 2>& textures,
+                       const Rect<float>& viewport,
+                       const Rect<float>& scissorRect,
+                       const BlendState& blendState,
+                       const DepthState& depthState,
+                       const StencilState& stencilState,
+                       const RasterizerState& rasterizerState,
+                       const Span<const std::size_t>& indices,
+                       const Span<const Vertex>& vertices,
+                       const Matrix<float, 4>& modelViewProjection)
+    {
+        BinnedDraw<VertexShaderResult<VertexShaderType>, FragmentShaderType> draw;
+        if (!binTriangles(draw, frameBuffer, depthBuffer, stencilBuffer, vertexShader, fragmentShader,
+                          samplers, textures, viewport, scissorRect, blendState, depthState, stencilState,
+                          rasterizerState, indices, vertices, modelViewProjection))
+            return;
+
+        // back end: rasterize every tile on its own
+        getThreadPool().parallelFor(draw.tileCount, [&draw](const std::size_t tile, std::size_t) {
+            rasterizeTile(draw, tile, nullptr);
+        });
+    }
+
+    template <class VertexShaderType, class FragmentShaderType>
+    void drawTriangles(Texture& frameBuffer,
+                       Texture& depthBuffer,
+                       Texture& stencilBuffer,
+                       const VertexShaderType& vertexShader,
+                       const FragmentShaderType& fragmentShader,
+                       const std::array<const Sampler*, 2>& samplers,
+                       const std::array<const Texture*, 2>& textures,
+                       const Rect<float>& viewport,
+                       const Rect<float>& scissorRect,
+                       const BlendState& blendState,
+                       const DepthState& depthState,
+                       const StencilState& stencilState,
+                       const RasterizerState& rasterizerState,
+                       const std::vector<std::size_t>& indices,
+                       const std::vector<Vertex>& vertices,
+                       const Matrix<float, 4>& modelViewProjection)
+    {
+        drawTriangles(frameBuffer,
+                      depthBuffer,
+                      stencilBuffer,
+                      vertexShader,
+                      fragmentShader,
+                      samplers,
+                      textures,
+                      viewport,
+                      scissorRect,
+                      blendState,
+                      depthState,
+                      stencilState,
+                      rasterizerState,
+                      Span<const std::size_t>{indices.data(), indices.size()},
+                      Span<const Vertex>{vertices.data(), vertices.size()},
+                      modelViewProjection);
+    }
+
+    template <class VertexShaderType, class FragmentShaderType>
+    void drawTriangles(Texture& frameBuffer,
+                       Texture& depthBuffer,
+                       const VertexShaderType& vertexShader,
+                       const FragmentShaderType& fragmentShader,
+                       const std::array<const Sampler*, 2>& samplers,
+                       const std::array<const Texture*, 2>& textures,
+                       const Rect<float>& viewport,
+                       const Rect<float>& scissorRect,
+                       const BlendState& blendState,
+                       const DepthState& depthState,
+                       const RasterizerState& rasterizerState,
+                       const std::vector<std::size_t>& indices,
+                       const std::vector<Vertex>& vertices,
+                       const Matrix<float, 4>& modelViewProjection)
+    {
+        drawTriangles(frameBuffer,
+                      depthBuffer,
+                      depthBuffer,
+                      vertexShader,
+                      fragmentShader,
+                      samplers,
+                      textures,
+                      viewport,
+                      scissorRect,
+                      blendState,
+                      depthState,
+                      StencilState{},
+                      rasterizerState,
+                      indices,
+                      vertices,
+                      modelViewProjection);
+    }
+
     inline void drawTriangles(Texture& frameBuffer,
                               Texture& depthBuffer,
                               VertexShader vertexShader,
@@ -33,153 +779,119 @@ namespace sr
                               const Rect<float>& scissorRect,
                               const BlendState& blendState,
                               const DepthState& depthState,
+                              const RasterizerState& rasterizerState,
                               const std::vector<std::size_t>& indices,
                               const std::vector<Vertex>& vertices,
                               const Matrix<float, 4>& modelViewProjection)
     {
-        const auto frameBufferData = reinterpret_cast<std::uint32_t*>(frameBuffer.getData().data());
-        const auto depthBufferData = reinterpret_cast<float*>(depthBuffer.getData().data());
-
-        for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
-        {
-            const std::array<VertexShaderOutput, 3> vsOutputs{
-                vertexShader(modelViewProjection, vertices[indices[i + 0]]),
-                vertexShader(modelViewProjection, vertices[indices[i + 1]]),
-                vertexShader(modelViewProjection, vertices[indices[i + 2]])
-            };
-
-            std::array<Vector<float, 4>, 3> ndcPositions{
-                vsOutputs[0].position,
-                vsOutputs[1].position,
-                vsOutputs[2].position
-            };
-
-            // transform to normalized device coordinates
-            for (sr::Vector<float, 4>& ndcPosition : ndcPositions)
-                ndcPosition /= ndcPosition.v[3];
-
-            std::array<Vector<float, 2>, 3> viewportPositions{
-                Vector<float, 2>{ndcPositions[0].v[0], ndcPositions[0].v[1]},
-                Vector<float, 2>{ndcPositions[1].v[0], ndcPositions[1].v[1]},
-                Vector<float, 2>{ndcPositions[2].v[0], ndcPositions[2].v[1]}
-            };
-
-            Vector<float, 2> screenMin{
-                std::numeric_limits<float>::infinity(),
-                std::numeric_limits<float>::infinity()
-            };
-            Vector<float, 2> screenMax{
-                -std::numeric_limits<float>::infinity(),
-                -std::numeric_limits<float>::infinity()
-            };
-
-            for (auto& viewportPosition : viewportPositions)
-            {
-                // transform to viewport coordinates
-                viewportPosition.v[0] = viewportPosition.v[0] * viewport.size.v[0] / 2.0F + viewport.position.v[0] + viewport.size.v[0] / 2.0F; // xndc * width / 2 + x + width / 2
-                viewportPosition.v[1] = viewportPosition.v[1] * viewport.size.v[1] / 2.0F + viewport.position.v[1] + viewport.size.v[1] / 2.0F;  // yndc * height / 2 + y + height / 2
-                //viewportPosition.v[2] = viewportPosition.v[2] * (1.0F - 0.0F) / 2.0F + (1.0F + 0.0F) / 2.0F; // zndc * (far - near) / 2 + (far + near) / 2
-
-                if (viewportPosition.v[0] < screenMin.v[0]) screenMin.v[0] = viewportPosition.v[0];
-                if (viewportPosition.v[0] > screenMax.v[0]) screenMax.v[0] = viewportPosition.v[0];
-                if (viewportPosition.v[1] < screenMin.v[1]) screenMin.v[1] = viewportPosition.v[1];
-                if (viewportPosition.v[1] > screenMax.v[1]) screenMax.v[1] = viewportPosition.v[1];
-            }
-
-            screenMin.v[0] = std::clamp(screenMin.v[0], 0.0F, static_cast<float>(frameBuffer.getWidth() - 1) * scissorRect.position.v[0]);
-            screenMax.v[0] = std::clamp(screenMax.v[0], 0.0F, static_cast<float>(frameBuffer.getWidth() - 1) * (scissorRect.position.v[0] + scissorRect.size.v[0]));
-            screenMin.v[1] = std::clamp(screenMin.v[1], 0.0F, static_cast<float>(frameBuffer.getHeight() - 1) * scissorRect.position.v[1]);
-            screenMax.v[1] = std::clamp(screenMax.v[1], 0.0F, static_cast<float>(frameBuffer.getHeight() - 1) * (scissorRect.position.v[1] + scissorRect.size.v[1]));
-
-            const auto v0 = viewportPositions[1] - viewportPositions[0];
-            const auto v1 = viewportPositions[2] - viewportPositions[0];
-            const auto den = v0.v[0] * v1.v[1] - v1.v[0] * v0.v[1];
-
-            for (auto screenY = static_cast<std::size_t>(screenMin.v[1]); screenY <= static_cast<std::size_t>(screenMax.v[1]); ++screenY)
-                for (auto screenX = static_cast<std::size_t>(screenMin.v[0]); screenX <= static_cast<std::size_t>(screenMax.v[0]); ++screenX)
-                {
-                    const Vector<float, 2> p{
-                        static_cast<float>(screenX),
-                        static_cast<float>(screenY)
-                    };
-
-                    const auto v2 = p - viewportPositions[0];
+        drawTriangles<VertexShader*, FragmentShader*>(frameBuffer,
+                                                      depthBuffer,
+                                                      vertexShader,
+                                                      fragmentShader,
+                                                      samplers,
+                                                      textures,
+                                                      viewport,
+                                                      scissorRect,
+                                                      blendState,
+                                                      depthState,
+                                                      rasterizerState,
+                                                      indices,
+                                                      vertices,
+                                                      modelViewProjection);
+    }
 
-                    // calculate barycentric coordinates
-                    const auto v = (v2.v[0] * v1.v[1] - v1.v[0] * v2.v[1]) / den;
-                    const auto w = (v0.v[0] * v2.v[1] - v2.v[0] * v0.v[1]) / den;
+    // the function-pointer form without a rasterizer state, which draws with the default one
+    inline void drawTriangles(Texture& frameBuffer,
+                              Texture& depthBuffer,
+                              VertexShader vertexShader,
+                              FragmentShader fragmentShader,
+                              const std::array<const Sampler*, 2>& samplers,
+                              const std::array<const Texture*, 2>& textures,
+                              const Rect<float>& viewport,
+                              const Rect<float>& scissorRect,
+                              const BlendState& blendState,
+                              const DepthState& depthState,
+                              const std::vector<std::size_t>& indices,
+                              const std::vector<Vertex>& vertices,
+                              const Matrix<float, 4>& modelViewProjection)
+    {
+        drawTriangles(frameBuffer,
+                      depthBuffer,
+                      vertexShader,
+                      fragmentShader,
+                      samplers,
+                      textures,
+                      viewport,
+                      scissorRect,
+                      blendState,
+                      depthState,
+                      RasterizerState{},
+                      indices,
+                      vertices,
+                      modelViewProjection);
+    }
 
-                    if (v >= 0.0F && w >= 0.0F && v + w <= 1.0F)
-                    {
-                        const auto u = 1.0F - v - w;
+    // Averages the samples of a multisampled rgba8 render target into a single-sampled texture of the same size,
+    // rounding the same way as the downsampling of the mip maps. The pending fast clear of the source is written
+    // first, the one of the destination is dropped, because all of its pixels are overwritten.
+    inline void resolve(Texture& source, Texture& destination)
+    {
+        if (source.getPixelFormat() != PixelFormat::rgba8 || destination.getPixelFormat() != PixelFormat::rgba8)
+            throw RenderError{"Invalid pixel format"};
 
-                        Vector<float, 3> clip{
-                            u / vsOutputs[0].position.v[3],
-                            v / vsOutputs[1].position.v[3],
-                            w / vsOutputs[2].position.v[3]
-                        };
-                        clip /= (clip.v[0] + clip.v[1] + clip.v[2]);
+        if (source.getSampleCount() != maxSampleCount || destination.getSampleCount() != 1)
+            throw RenderError{"Invalid sample count"};
 
-                        const auto depth = ndcPositions[0].v[2] * clip.v[0] + ndcPositions[1].v[2] * clip.v[1] + ndcPositions[2].v[2] * clip.v[2];
+        if (source.getWidth() != destination.getWidth() || source.getHeight() != destination.getHeight())
+            throw RenderError{"Invalid texture size"};
 
-                        if (depthState.read && depthBufferData[screenY * depthBuffer.getWidth() + screenX] < depth)
-                            continue; // discard the pixel
+        if (destination.getLayout() != Texture::Layout::linear)
+            throw RenderError{"Render targets must have the linear layout"};
 
-                        if (depthState.write)
-                            depthBufferData[screenY * depthBuffer.getWidth() + screenX] = depth;
+        const auto width = source.getWidth();
+        const auto height = source.getHeight();
+        destination.discardClear();
+        const auto sourceData = source.getData().data();
+        const auto destinationData = destination.getRenderTargetData().data();
+        const auto planeSize = width * height * 4;
 
-                        VertexShaderOutput psInput;
-                        psInput.position = Vector<float, 4>{clip.v[0], clip.v[1], clip.v[2], 1.0F};
-                        psInput.color = Color{
-                            vsOutputs[0].color.r * clip.v[0] + vsOutputs[1].color.r * clip.v[1] + vsOutputs[2].color.r * clip.v[2],
-                            vsOutputs[0].color.g * clip.v[0] + vsOutputs[1].color.g * clip.v[1] + vsOutputs[2].color.g * clip.v[2],
-                            vsOutputs[0].color.b * clip.v[0] + vsOutputs[1].color.b * clip.v[1] + vsOutputs[2].color.b * clip.v[2],
-                            vsOutputs[0].color.a * clip.v[0] + vsOutputs[1].color.a * clip.v[1] + vsOutputs[2].color.a * clip.v[2]
-                        };
+        getThreadPool().parallelFor(height, [=](const std::size_t y, std::size_t) {
+            const auto row = sourceData + y * width * 4;
+            const auto result = destinationData + y * width * 4;
+            std::size_t x = 0;
 
-                        psInput.texCoords[0] = Vector<float, 2>{
-                            vsOutputs[0].texCoords[0].v[0] * clip.v[0] + vsOutputs[1].texCoords[0].v[0] * clip.v[1] + vsOutputs[2].texCoords[0].v[0] * clip.v[2],
-                            vsOutputs[0].texCoords[0].v[1] * clip.v[0] + vsOutputs[1].texCoords[0].v[1] * clip.v[1] + vsOutputs[2].texCoords[0].v[1] * clip.v[2]
-                        };
+#ifdef SR_SIMD_SSE2
+            // four RGBA pixels at once
+            const auto zero = _mm_setzero_si128();
+            const auto rounding = _mm_set1_epi16(2);
 
-                        psInput.texCoords[1] = Vector<float, 2>{
-                            vsOutputs[0].texCoords[1].v[0] * clip.v[0] + vsOutputs[1].texCoords[1].v[0] * clip.v[1] + vsOutputs[2].texCoords[1].v[0] * clip.v[2],
-                            vsOutputs[0].texCoords[1].v[1] * clip.v[0] + vsOutputs[1].texCoords[1].v[1] * clip.v[1] + vsOutputs[2].texCoords[1].v[1] * clip.v[2]
-                        };
+            for (; x + 4 <= width; x += 4)
+            {
+                auto sumsLow = rounding;
+                auto sumsHigh = rounding;
 
-                        psInput.normal = vsOutputs[0].normal * clip.v[0] + vsOutputs[1].normal * clip.v[1] + vsOutputs[2].normal * clip.v[2];
+                for (std::size_t sample = 0; sample < maxSampleCount; ++sample)
+                {
+                    const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + sample * planeSize + x * 4));
+                    sumsLow = _mm_add_epi16(sumsLow, _mm_unpacklo_epi8(pixels, zero));
+                    sumsHigh = _mm_add_epi16(sumsHigh, _mm_unpackhi_epi8(pixels, zero));
+                }
 
-                        const auto srcColor = fragmentShader(psInput, samplers, textures);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(result + x * 4),
+                                 _mm_packus_epi16(_mm_srli_epi16(sumsLow, 2), _mm_srli_epi16(sumsHigh, 2)));
+            }
+#endif
 
-                        if (blendState.enabled)
-                        {
-                            const auto pixel = reinterpret_cast<std::uint8_t*>(&frameBufferData[screenY * frameBuffer.getWidth() + screenX]);
-                            const Color destColor{pixel[0], pixel[1], pixel[2], pixel[3]};
-
-                            // alpha blend
-                            const Color resultColor{
-                                getValue(blendState.colorOperation,
-                                         srcColor.r * getValue(blendState.colorBlendSource, srcColor.r, srcColor.a, destColor.r, destColor.a, blendState.blendFactor.r),
-                                         destColor.r * getValue(blendState.colorBlendDest, srcColor.r, srcColor.a, destColor.r, destColor.a, blendState.blendFactor.r)),
-                                getValue(blendState.colorOperation,
-                                         srcColor.g * getValue(blendState.colorBlendSource, srcColor.g, srcColor.a, destColor.g, destColor.a, blendState.blendFactor.g),
-                                         destColor.g * getValue(blendState.colorBlendDest, srcColor.g, srcColor.a, destColor.g, destColor.a, blendState.blendFactor.g)),
-                                getValue(blendState.colorOperation,
-                                         srcColor.b * getValue(blendState.colorBlendSource, srcColor.b, srcColor.a, destColor.b, destColor.a, blendState.blendFactor.b),
-                                         destColor.b * getValue(blendState.colorBlendDest, srcColor.b, srcColor.a, destColor.b, destColor.a, blendState.blendFactor.b)),
-                                getValue(blendState.alphaOperation,
-                                         srcColor.a * getValue(blendState.alphaBlendSource, srcColor.a, srcColor.a, destColor.a, destColor.a, blendState.blendFactor.a),
-                                         destColor.a * getValue(blendState.alphaBlendDest, srcColor.a, srcColor.a, destColor.a, destColor.a, blendState.blendFactor.a))
-                            };
-
-                            frameBufferData[screenY * frameBuffer.getWidth() + screenX] = resultColor.getIntValueRaw();
-                        }
-                        else
-                            frameBufferData[screenY * frameBuffer.getWidth() + screenX] = srcColor.getIntValueRaw();
-                    }
+            for (; x < width; ++x)
+                for (std::size_t channel = 0; channel < 4; ++channel)
+                {
+                    unsigned int sum = 2;
+                    for (std::size_t sample = 0; sample < maxSampleCount; ++sample)
+                        sum += row[sample * planeSize + x * 4 + channel];
+                    result[x * 4 + channel] = static_cast<std::uint8_t>(sum / 4);
                 }
-        }
+        });
     }
 }
 
-#endif
+#endif
\ No newline at end of file
@@ -20,10 +20,14 @@ namespace sr
             mirror
         };
 
+        // point and linear read the base level, linearMipPoint and trilinear select the levels by the
+        // derivatives of the texture coordinates (the nearest one or the two nearest ones)
         enum class Filter
         {
             point,
-            linear
+            linear,
+            linearMipPoint,
+            trilinear
         };
 
         AddressMode addressModeX = AddressMode::clamp;
@@ -0,0 +1,476 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_SAMPLERBINDING_HPP
+#define SR_SAMPLERBINDING_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include "Color.hpp"
+#include "PixelFormat.hpp"
+#include "Sampler.hpp"
+#include "Simd.hpp"
+#include "Texture.hpp"
+#include "Vector.hpp"
+
+namespace sr
+{
+    // base level of an rgba8 texture and the address modes, for the batched sample kernels
+    struct BatchLevel final
+    {
+        const std::uint8_t* data;
+        std::int32_t width;
+        std::int32_t height;
+        std::int32_t blocksPerRow;
+        bool tiled;
+        Sampler::AddressMode addressModeX;
+        Sampler::AddressMode addressModeY;
+    };
+
+    // samples eight coordinates and stores the channels to colors[0..3]
+    using BatchSampler = void(*)(const BatchLevel& level, const float* us, const float* vs, float* const (&colors)[4]);
+}
+
+// The batched kernels are compiled with the AVX2 target options, so that the CPU can be detected at runtime. They
+// compute the same texel coordinates, weights and 8.8 fixed-point blends as SamplerBinding::sample, for eight
+// coordinates at once, and load the texels with gathers.
+#ifdef SR_SIMD_X86
+#  if defined(__clang__)
+#    pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#  elif defined(__GNUC__)
+#    pragma GCC push_options
+#    pragma GCC target("avx2")
+#  endif
+namespace sr::avx2
+{
+    // _mm256_mul_ps that is not fused with the next addition, so that the batches round like the single samples
+    // (see unfused)
+    inline __m256 mulUnfused(const __m256 a, const __m256 b) noexcept
+    {
+        auto product = _mm256_mul_ps(a, b);
+#ifdef __GNUC__
+        __asm__("" : "+x"(product));
+#endif
+        return product;
+    }
+
+    // like getTexelCoordinate
+    inline __m256i getTexelCoordinates(const __m256 positions) noexcept
+    {
+        const auto limit = _mm256_set1_ps(1073741824.0F);
+
+        // max returns its second operand for NaNs
+        const auto clamped = _mm256_min_ps(_mm256_max_ps(positions, _mm256_sub_ps(_mm256_setzero_ps(), limit)), limit);
+        return _mm256_cvttps_epi32(_mm256_floor_ps(clamped));
+    }
+
+    // like applyAddressMode, the size has to be a power of two for repeat and mirror
+    inline __m256i applyAddressMode(const Sampler::AddressMode addressMode,
+                                    const __m256i coordinates,
+                                    const std::int32_t size) noexcept
+    {
+        switch (addressMode)
+        {
+            case Sampler::AddressMode::repeat:
+                return _mm256_and_si256(coordinates, _mm256_set1_epi32(size - 1));
+            case Sampler::AddressMode::mirror:
+            {
+                // the second half of every period of 2 * size texels runs backwards
+                const auto periodMask = _mm256_set1_epi32(size * 2 - 1);
+                const auto period = _mm256_and_si256(coordinates, periodMask);
+                const auto backwards = _mm256_cmpeq_epi32(_mm256_and_si256(period, _mm256_set1_epi32(size)), _mm256_set1_epi32(size));
+                return _mm256_xor_si256(period, _mm256_and_si256(backwards, periodMask));
+            }
+            default:
+                return _mm256_max_epi32(_mm256_min_epi32(coordinates, _mm256_set1_epi32(size - 1)), _mm256_setzero_si256());
+        }
+    }
+
+    inline __m256i gatherTexels(const BatchLevel& level, const __m256i x, const __m256i y) noexcept
+    {
+        __m256i indices;
+        if (level.tiled)
+        {
+            const auto one = _mm256_set1_epi32(1);
+            const auto two = _mm256_set1_epi32(2);
+            const auto blocks = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(y, 2), _mm256_set1_epi32(level.blocksPerRow)),
+                                                 _mm256_srli_epi32(x, 2));
+            const auto texels = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(x, one),
+                                                                _mm256_slli_epi32(_mm256_and_si256(y, one), 1)),
+                                                _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, two), 1),
+                                                                _mm256_slli_epi32(_mm256_and_si256(y, two), 2)));
+            indices = _mm256_add_epi32(_mm256_slli_epi32(blocks, 4), texels);
+        }
+        else
+            indices = _mm256_add_epi32(_mm256_mullo_epi32(y, _mm256_set1_epi32(level.width)), x);
+
+        return _mm256_i32gather_epi32(reinterpret_cast<const int*>(level.data), indices, 4);
+    }
+
+    // like SamplerBinding::lerp
+    inline __m256i lerp(const __m256i a, const __m256i b, const __m256i weights) noexcept
+    {
+        const auto channelMask = _mm256_set1_epi32(0x00FF00FF);
+        const auto rounding = _mm256_set1_epi32(0x00800080);
+        const auto inverseWeights = _mm256_sub_epi32(_mm256_set1_epi32(256), weights);
+
+        const auto evenChannels = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(a, channelMask), inverseWeights),
+                                                                                      _mm256_mullo_epi32(_mm256_and_si256(b, channelMask), weights)),
+                                                                     rounding), 8);
+        const auto oddChannels = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 8), channelMask), inverseWeights),
+                                                                                     _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(b, 8), channelMask), weights)),
+                                                                    rounding), 8);
+
+        return _mm256_or_si256(_mm256_and_si256(evenChannels, channelMask),
+                               _mm256_slli_epi32(_mm256_and_si256(oddChannels, channelMask), 8));
+    }
+
+    inline void storeChannels(const __m256i texels, float* const (&colors)[4]) noexcept
+    {
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            const auto values = _mm256_and_si256(_mm256_srlv_epi32(texels, _mm256_set1_epi32(channel * 8)), _mm256_set1_epi32(0xFF));
+            _mm256_storeu_ps(colors[channel], _mm256_div_ps(_mm256_cvtepi32_ps(values), _mm256_set1_ps(255.0F)));
+        }
+    }
+
+    inline void samplePoint(const BatchLevel& level, const float* us, const float* vs, float* const (&colors)[4]) noexcept
+    {
+        const auto u = mulUnfused(_mm256_loadu_ps(us), _mm256_set1_ps(static_cast<float>(level.width)));
+        const auto v = mulUnfused(_mm256_loadu_ps(vs), _mm256_set1_ps(static_cast<float>(level.height)));
+
+        const auto x = applyAddressMode(level.addressModeX, getTexelCoordinates(u), level.width);
+        const auto y = applyAddressMode(level.addressModeY, getTexelCoordinates(v), level.height);
+
+        storeChannels(gatherTexels(level, x, y), colors);
+    }
+
+    inline void sampleLinear(const BatchLevel& level, const float* us, const float* vs, float* const (&colors)[4]) noexcept
+    {
+        const auto half = _mm256_set1_ps(0.5F);
+        const auto u = _mm256_sub_ps(mulUnfused(_mm256_loadu_ps(us), _mm256_set1_ps(static_cast<float>(level.width))), half);
+        const auto v = _mm256_sub_ps(mulUnfused(_mm256_loadu_ps(vs), _mm256_set1_ps(static_cast<float>(level.height))), half);
+
+        const auto textureX = getTexelCoordinates(u);
+        const auto textureY = getTexelCoordinates(v);
+        const auto one = _mm256_set1_epi32(1);
+        const auto x0 = applyAddressMode(level.addressModeX, textureX, level.width);
+        const auto x1 = applyAddressMode(level.addressModeX, _mm256_add_epi32(textureX, one), level.width);
+        const auto y0 = applyAddressMode(level.addressModeY, textureY, level.height);
+        const auto y1 = applyAddressMode(level.addressModeY, _mm256_add_epi32(textureY, one), level.height);
+
+        // weights of the second column and row in 8.8 fixed point, clamped like SamplerBinding::getFixedWeight
+        const auto fixedScale = _mm256_set1_ps(256.0F);
+        const auto maxWeight = _mm256_set1_ps(255.0F);
+        const auto getFixedWeights = [&](const __m256 positions, const __m256i coordinates) noexcept {
+            // max returns its second operand for NaNs
+            const auto weights = _mm256_mul_ps(_mm256_sub_ps(positions, _mm256_cvtepi32_ps(coordinates)), fixedScale);
+            return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(weights, _mm256_setzero_ps()), maxWeight));
+        };
+        const auto weightsX = getFixedWeights(u, textureX);
+        const auto weightsY = getFixedWeights(v, textureY);
+
+        storeChannels(lerp(lerp(gatherTexels(level, x0, y0), gatherTexels(level, x1, y0), weightsX),
+                           lerp(gatherTexels(level, x0, y1), gatherTexels(level, x1, y1), weightsX),
+                           weightsY),
+                      colors);
+    }
+}
+#  if defined(__clang__)
+#    pragma clang attribute pop
+#  elif defined(__GNUC__)
+#    pragma GCC pop_options
+#  endif
+#endif
+
+namespace sr
+{
+    // A texture bound to a sampler, for sampling it many times, e.g. from a fragment shader that captures the
+    // binding. The pixel format, the layout, the address modes and the filter are resolved once to a sample
+    // function that is specialized for them: repeated power-of-two textures wrap by masking the texel coordinates
+    // and rgba8 texels are blended with 8.8 fixed-point weights. The other cases sample like Texture::sample, as
+    // do rgba8 textures with a pending fast clear, whose data is not written yet (the non-const getData() or
+    // resolveClear() writes it). The texture must not be resized, cleared or destroyed while it is bound.
+    class SamplerBinding final
+    {
+    public:
+        SamplerBinding(const Texture& initTexture, const Sampler& initSampler):
+            texture{initTexture},
+            filter{initSampler.filter},
+            addressModeX{initSampler.addressModeX},
+            addressModeY{initSampler.addressModeY}
+        {
+            for (std::uint32_t level = 0; level < texture.getLevelCount(); ++level)
+            {
+                const auto width = texture.getLevelWidth(level);
+                const auto height = texture.getLevelHeight(level);
+                levels.push_back(Level{texture.getData(level).data(), level, width, height, (width + 3) / 4, width - 1, height - 1});
+            }
+
+            if (levels.empty())
+            {
+                levelSampler = sampleEmpty;
+                return;
+            }
+
+            const auto isPowerOfTwo = [](const std::size_t size) noexcept { return (size & (size - 1)) == 0; };
+
+            // the texels are read from the data, which does not have the pending clear
+            const bool rgba8 = texture.getPixelFormat() == PixelFormat::rgba8 && !texture.hasClearedTiles();
+            const bool tiled = texture.getLayout() == Texture::Layout::tiled;
+            const bool wrapByMask = addressModeX == Sampler::AddressMode::repeat &&
+                addressModeY == Sampler::AddressMode::repeat &&
+                isPowerOfTwo(texture.getWidth()) && isPowerOfTwo(texture.getHeight());
+            const bool point = filter == Sampler::Filter::point;
+
+            static const auto levelSamplers = getLevelSamplers(std::make_index_sequence<16>{});
+            levelSampler = levelSamplers[(rgba8 ? 8 : 0) + (tiled ? 4 : 0) + (wrapByMask ? 2 : 0) + (point ? 1 : 0)];
+
+#ifdef SR_SIMD_X86
+            // the batched kernels wrap by masking and clamp, other address modes need divisions
+            const auto isBatchAddressMode = [&isPowerOfTwo](const Sampler::AddressMode addressMode, const std::size_t size) noexcept {
+                return addressMode == Sampler::AddressMode::clamp || isPowerOfTwo(size);
+            };
+
+            if (rgba8 && getSimdWidth() >= SimdWidth::avx2 &&
+                isBatchAddressMode(addressModeX, texture.getWidth()) &&
+                isBatchAddressMode(addressModeY, texture.getHeight()) &&
+                texture.getWidth() * texture.getHeight() <= 0x20000000U) // the gather indices are 32-bit
+            {
+                batchLevel = BatchLevel{
+                    levels[0].data,
+                    static_cast<std::int32_t>(levels[0].width),
+                    static_cast<std::int32_t>(levels[0].height),
+                    static_cast<std::int32_t>(levels[0].blocksPerRow),
+                    tiled,
+                    addressModeX,
+                    addressModeY
+                };
+                batchSampler = point ? avx2::samplePoint : avx2::sampleLinear;
+            }
+#endif
+        }
+
+        // samples the base level, the mip filters are linear
+        Color sample(const Vector<float, 2>& coord) const
+        {
+            return levelSampler(*this, coord, levels.empty() ? nullptr : &levels[0]);
+        }
+
+        // samples the levels selected by the screen-space derivatives of the texture coordinates
+        Color sample(const Vector<float, 2>& coord,
+                     const Vector<float, 2>& ddx,
+                     const Vector<float, 2>& ddy) const
+        {
+            if (levels.empty()) return Color{};
+
+            return texture.sampleLevels(filter, ddx, ddy, [this, &coord](const std::uint32_t level) {
+                return levelSampler(*this, coord, &levels[level]);
+            });
+        }
+
+        // Samples the base level at count (4, 8 or 16) coordinates at once, like sample(coord), with the texture
+        // coordinates and the colors in structure-of-arrays layout. rgba8 textures whose sides are clamped or are
+        // powers of two use AVX2 gathers if the CPU supports them.
+        template <std::size_t count>
+        void sampleN(const float (&us)[count],
+                     const float (&vs)[count],
+                     float (&colors)[4][count]) const
+        {
+            static_assert(count == 4 || count == 8 || count == 16, "4, 8 or 16 coordinates are sampled at once");
+
+            if (batchSampler)
+            {
+                if constexpr (count == 4)
+                {
+                    // the upper lanes repeat the coordinates
+                    float batchUs[8];
+                    float batchVs[8];
+                    float batchColors[4][8];
+                    for (std::size_t i = 0; i < 8; ++i)
+                    {
+                        batchUs[i] = us[i % 4];
+                        batchVs[i] = vs[i % 4];
+                    }
+
+                    batchSampler(batchLevel, batchUs, batchVs, {batchColors[0], batchColors[1], batchColors[2], batchColors[3]});
+
+                    for (std::size_t channel = 0; channel < 4; ++channel)
+                        for (std::size_t i = 0; i < 4; ++i)
+                            colors[channel][i] = batchColors[channel][i];
+                }
+                else
+                    for (std::size_t offset = 0; offset < count; offset += 8)
+                        batchSampler(batchLevel, us + offset, vs + offset,
+                                     {colors[0] + offset, colors[1] + offset, colors[2] + offset, colors[3] + offset});
+            }
+            else
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    const auto color = sample(Vector<float, 2>{us[i], vs[i]});
+                    colors[0][i] = color.r;
+                    colors[1][i] = color.g;
+                    colors[2][i] = color.b;
+                    colors[3][i] = color.a;
+                }
+        }
+
+    private:
+        struct Level final
+        {
+            const std::uint8_t* data;
+            std::uint32_t index;
+            std::size_t width;
+            std::size_t height;
+            std::size_t blocksPerRow;
+            std::size_t maskX; // for power-of-two sides only
+            std::size_t maskY;
+        };
+
+        using LevelSampler = Color(*)(const SamplerBinding& binding, const Vector<float, 2>& coord, const Level* level);
+
+        static Color sampleEmpty(const SamplerBinding&, const Vector<float, 2>&, const Level*) noexcept
+        {
+            return Color{};
+        }
+
+        template <bool wrapByMask>
+        static std::size_t getTexelX(const SamplerBinding& binding, const Level& level, const std::int64_t coordinate) noexcept
+        {
+            if constexpr (wrapByMask)
+                return static_cast<std::size_t>(coordinate) & level.maskX;
+            else
+                return applyAddressMode(binding.addressModeX, coordinate, level.width);
+        }
+
+        template <bool wrapByMask>
+        static std::size_t getTexelY(const SamplerBinding& binding, const Level& level, const std::int64_t coordinate) noexcept
+        {
+            if constexpr (wrapByMask)
+                return static_cast<std::size_t>(coordinate) & level.maskY;
+            else
+                return applyAddressMode(binding.addressModeY, coordinate, level.height);
+        }
+
+        template <bool tiled>
+        static std::uint32_t getTexel(const Level& level, const std::size_t x, const std::size_t y) noexcept
+        {
+            const auto index = tiled ? getTiledTexelIndex(x, y, level.blocksPerRow) : y * level.width + x;
+
+            std::uint32_t texel;
+            std::memcpy(&texel, level.data + index * 4, sizeof(texel));
+            return texel;
+        }
+
+        static Color getColor(const std::uint32_t texel) noexcept
+        {
+            std::uint8_t channels[4];
+            std::memcpy(channels, &texel, sizeof(channels));
+            return Color{channels[0], channels[1], channels[2], channels[3]};
+        }
+
+        // a + (b - a) * weight / 256 for all four channels, two at a time in the 16-bit halves of an integer
+        static std::uint32_t lerp(const std::uint32_t a, const std::uint32_t b, const std::uint32_t weight) noexcept
+        {
+            const auto evenChannels = ((a & 0x00FF00FFU) * (256U - weight) + (b & 0x00FF00FFU) * weight + 0x00800080U) >> 8;
+            const auto oddChannels = (((a >> 8) & 0x00FF00FFU) * (256U - weight) + ((b >> 8) & 0x00FF00FFU) * weight + 0x00800080U) >> 8;
+            return (evenChannels & 0x00FF00FFU) | ((oddChannels & 0x00FF00FFU) << 8);
+        }
+
+        // The weight in 8.8 fixed point. It is only in [0, 1) if getTexelCoordinate did not clamp the position,
+        // so it is clamped too (NaNs to 0).
+        static std::uint32_t getFixedWeight(const float weight) noexcept
+        {
+            return static_cast<std::uint32_t>(std::min(255.0F, std::max(0.0F, weight * 256.0F)));
+        }
+
+        template <bool rgba8, bool tiled, bool wrapByMask, bool point>
+        static Color sampleLevel(const SamplerBinding& binding, const Vector<float, 2>& coord, const Level* level)
+        {
+            const auto u = unfused(coord.v[0] * static_cast<float>(level->width));
+            const auto v = unfused(coord.v[1] * static_cast<float>(level->height));
+
+            if constexpr (point)
+            {
+                const auto x = getTexelX<wrapByMask>(binding, *level, getTexelCoordinate(u));
+                const auto y = getTexelY<wrapByMask>(binding, *level, getTexelCoordinate(v));
+
+                if constexpr (rgba8)
+                    return getColor(getTexel<tiled>(*level, x, y));
+                else
+                    return binding.texture.getPixel(x, y, level->index);
+            }
+            else
+            {
+                const auto textureX = getTexelCoordinate(u - 0.5F);
+                const auto textureY = getTexelCoordinate(v - 0.5F);
+                const auto x0 = getTexelX<wrapByMask>(binding, *level, textureX);
+                const auto x1 = getTexelX<wrapByMask>(binding, *level, textureX + 1);
+                const auto y0 = getTexelY<wrapByMask>(binding, *level, textureY);
+                const auto y1 = getTexelY<wrapByMask>(binding, *level, textureY + 1);
+
+                // weights of the second column and row
+                const auto weightX = (u - 0.5F) - static_cast<float>(textureX);
+                const auto weightY = (v - 0.5F) - static_cast<float>(textureY);
+
+                if constexpr (rgba8)
+                {
+                    const auto fixedWeightX = getFixedWeight(weightX);
+                    const auto fixedWeightY = getFixedWeight(weightY);
+
+                    return getColor(lerp(lerp(getTexel<tiled>(*level, x0, y0), getTexel<tiled>(*level, x1, y0), fixedWeightX),
+                                         lerp(getTexel<tiled>(*level, x0, y1), getTexel<tiled>(*level, x1, y1), fixedWeightX),
+                                         fixedWeightY));
+                }
+                else
+                {
+                    const Color color[4] = {
+                        binding.texture.getPixel(x0, y0, level->index),
+                        binding.texture.getPixel(x1, y0, level->index),
+                        binding.texture.getPixel(x0, y1, level->index),
+                        binding.texture.getPixel(x1, y1, level->index)
+                    };
+
+                    const auto weightX0 = 1.0F - weightX;
+                    const auto weightY0 = 1.0F - weightY;
+
+                    // like Texture::sampleLevel
+                    const auto blend = [weightX0, weightY0, weightX, weightY](const float value0, const float value1, const float value2, const float value3) noexcept {
+                        return unfused(value0 * weightX0 * weightY0) + unfused(value1 * weightX * weightY0) +
+                            unfused(value2 * weightX0 * weightY) + unfused(value3 * weightX * weightY);
+                    };
+
+                    return Color{
+                        blend(color[0].r, color[1].r, color[2].r, color[3].r),
+                        blend(color[0].g, color[1].g, color[2].g, color[3].g),
+                        blend(color[0].b, color[1].b, color[2].b, color[3].b),
+                        blend(color[0].a, color[1].a, color[2].a, color[3].a)
+                    };
+                }
+            }
+        }
+
+        // index bits: rgba8, tiled, wrap by mask, point
+        template <std::size_t... indices>
+        static constexpr std::array<LevelSampler, sizeof...(indices)> getLevelSamplers(std::index_sequence<indices...>) noexcept
+        {
+            return {sampleLevel<(indices & 8U) != 0, (indices & 4U) != 0, (indices & 2U) != 0, (indices & 1U) != 0>...};
+        }
+
+        const Texture& texture;
+        Sampler::Filter filter;
+        Sampler::AddressMode addressModeX;
+        Sampler::AddressMode addressModeY;
+        std::vector<Level> levels;
+        LevelSampler levelSampler = nullptr;
+        BatchLevel batchLevel{};
+        BatchSampler batchSampler = nullptr;
+    };
+}
+
+#endif
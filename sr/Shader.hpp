@@ -6,6 +6,7 @@
 #define SR_SHADER_HPP
 
 #include <array>
+#include <cstddef>
 #include "Matrix.hpp"
 #include "Texture.hpp"
 #include "Vertex.hpp"
@@ -20,6 +21,55 @@ namespace sr
         Vector<float, 3> normal;
     };
 
+    // Describes the output type of a vertex shader to the renderer. The type has a Vector<float, 4> position member
+    // (the clip space position) and float components that are interpolated across the triangles, the specialization
+    // lists them. The fragment shader gets an instance of the same type with the interpolated components and with
+    // the window coordinates of the pixel center, the depth and 1/w in its position.
+    template <class T>
+    struct Varyings;
+
+    template <>
+    struct Varyings<VertexShaderOutput> final
+    {
+        static constexpr std::size_t componentCount = 11;
+
+        static std::array<float, componentCount> getComponents(const VertexShaderOutput& output) noexcept
+        {
+            return {
+                output.color.r,
+                output.color.g,
+                output.color.b,
+                output.color.a,
+                output.texCoords[0].v[0],
+                output.texCoords[0].v[1],
+                output.texCoords[1].v[0],
+                output.texCoords[1].v[1],
+                output.normal.v[0],
+                output.normal.v[1],
+                output.normal.v[2]
+            };
+        }
+
+        static void setComponents(VertexShaderOutput& output, const std::array<float, componentCount>& components) noexcept
+        {
+            output.color = Color{components[0], components[1], components[2], components[3]};
+            output.texCoords[0] = Vector<float, 2>{components[4], components[5]};
+            output.texCoords[1] = Vector<float, 2>{components[6], components[7]};
+            output.normal = Vector<float, 3>{components[8], components[9], components[10]};
+        }
+    };
+
+    // Screen-space derivatives of the fragment shader input, the differences to the horizontal and the vertical
+    // neighbor in the 2x2 quad of the pixel. Pixels are shaded in quads, so that neighbors that are not covered
+    // by the triangle (helper pixels) still have interpolated values. A fragment shader that takes them as its second
+    // parameter gets them, e.g. for selecting a mip level; the others don't pay for computing them.
+    template <class T>
+    struct Derivatives final
+    {
+        T ddx;
+        T ddy;
+    };
+
     using VertexShader = VertexShaderOutput(const Matrix<float, 4>& modelViewProjection,
                                             const Vertex& vertex);
 
@@ -0,0 +1,147 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_SIMD_HPP
+#define SR_SIMD_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define SR_SIMD_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#endif
+
+// SSE2 is part of x86-64, so code that needs nothing more does not have to check the CPU
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define SR_SIMD_SSE2 1
+#endif
+
+namespace sr
+{
+    // number of pixels that the pixel kernels process at once
+    enum class SimdWidth: std::uint32_t
+    {
+        scalar = 1,
+        sse41 = 4,
+        avx2 = 8,
+        avx512 = 16
+    };
+
+    // widest kernel supported by the CPU and the operating system
+    inline SimdWidth getMaxSimdWidth() noexcept
+    {
+#ifdef SR_SIMD_X86
+        static const SimdWidth maxSimdWidth = []() noexcept {
+            std::uint32_t registers1[4]{};
+            std::uint32_t registers7[4]{};
+#  if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            const auto maxLeaf = static_cast<std::uint32_t>(info[0]);
+            __cpuid(info, 1);
+            for (std::size_t i = 0; i < 4; ++i) registers1[i] = static_cast<std::uint32_t>(info[i]);
+            if (maxLeaf >= 7)
+            {
+                __cpuidex(info, 7, 0);
+                for (std::size_t i = 0; i < 4; ++i) registers7[i] = static_cast<std::uint32_t>(info[i]);
+            }
+#  else
+            const auto maxLeaf = __get_cpuid_max(0, nullptr);
+            __get_cpuid(1, &registers1[0], &registers1[1], &registers1[2], &registers1[3]);
+            if (maxLeaf >= 7)
+                __get_cpuid_count(7, 0, &registers7[0], &registers7[1], &registers7[2], &registers7[3]);
+#  endif
+            const bool sse41 = (registers1[2] & (1U << 19)) != 0;
+            const bool osxsave = (registers1[2] & (1U << 27)) != 0;
+            const bool avx = (registers1[2] & (1U << 28)) != 0;
+            const bool avx2 = (registers7[1] & (1U << 5)) != 0;
+            const bool avx512f = (registers7[1] & (1U << 16)) != 0;
+
+            // the operating system has to save the YMM and ZMM registers on context switches
+            std::uint64_t enabledStates = 0;
+            if (osxsave)
+            {
+#  if defined(_MSC_VER)
+                enabledStates = _xgetbv(0);
+#  else
+                std::uint32_t eax;
+                std::uint32_t edx;
+                __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+                enabledStates = (static_cast<std::uint64_t>(edx) << 32) | eax;
+#  endif
+            }
+
+            const bool ymmEnabled = (enabledStates & 0x06U) == 0x06U;
+            const bool zmmEnabled = (enabledStates & 0xE6U) == 0xE6U;
+
+            if (avx512f && zmmEnabled) return SimdWidth::avx512;
+            if (avx && avx2 && ymmEnabled) return SimdWidth::avx2;
+            if (sse41) return SimdWidth::sse41;
+            return SimdWidth::scalar;
+        }();
+
+        return maxSimdWidth;
+#else
+        return SimdWidth::scalar;
+#endif
+    }
+
+    // the widest supported kernel that is not wider than the given width
+    inline SimdWidth getSupportedSimdWidth(const SimdWidth simdWidth) noexcept
+    {
+        const auto maxSimdWidth = getMaxSimdWidth();
+
+        if (simdWidth >= SimdWidth::avx512 && maxSimdWidth >= SimdWidth::avx512) return SimdWidth::avx512;
+        if (simdWidth >= SimdWidth::avx2 && maxSimdWidth >= SimdWidth::avx2) return SimdWidth::avx2;
+        if (simdWidth >= SimdWidth::sse41 && maxSimdWidth >= SimdWidth::sse41) return SimdWidth::sse41;
+        return SimdWidth::scalar;
+    }
+
+    inline std::atomic<SimdWidth>& getSimdWidthOverride() noexcept
+    {
+        // the SR_SIMD_WIDTH environment variable (1, 4, 8 or 16) forces the kernel width, e.g. for A/B runs
+        static std::atomic<SimdWidth> simdWidth = []() noexcept {
+            const char* value = std::getenv("SR_SIMD_WIDTH");
+            if (!value) return getMaxSimdWidth();
+
+            const auto width = std::strtoul(value, nullptr, 10);
+            return getSupportedSimdWidth(static_cast<SimdWidth>(width));
+        }();
+
+        return simdWidth;
+    }
+
+    inline SimdWidth getSimdWidth() noexcept
+    {
+        return getSimdWidthOverride().load(std::memory_order_relaxed);
+    }
+
+    inline void setSimdWidth(const SimdWidth simdWidth) noexcept
+    {
+        getSimdWidthOverride() = getSupportedSimdWidth(simdWidth);
+    }
+
+    // Returns a product as it is, but hides it from the optimizer, so that it is rounded before it is added
+    // instead of being fused with the addition into an FMA, which rounds only once. The scalar and the SIMD
+    // kernels have to round the same way whatever -ffp-contract the code is built with, so the mul of every
+    // instruction set does the same.
+    inline float unfused(float value) noexcept
+    {
+#if defined(__GNUC__) && defined(SR_SIMD_SSE2)
+        __asm__("" : "+x"(value));
+#elif defined(__GNUC__) && defined(__aarch64__)
+        __asm__("" : "+w"(value));
+#endif
+        return value;
+    }
+}
+
+#endif
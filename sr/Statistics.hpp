@@ -0,0 +1,84 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_STATISTICS_HPP
+#define SR_STATISTICS_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace sr
+{
+    class Statistics final
+    {
+    public:
+        class Blocks final
+        {
+        public:
+            std::atomic<std::uint64_t> accepted{0}; // fully covered, pixels are shaded without coverage tests
+            std::atomic<std::uint64_t> rejected{0}; // fully outside of the triangle
+            std::atomic<std::uint64_t> partial{0}; // subdivided or tested per pixel
+
+            void reset() noexcept
+            {
+                accepted = 0;
+                rejected = 0;
+                partial = 0;
+            }
+        };
+
+        class VertexCache final
+        {
+        public:
+            std::atomic<std::uint64_t> hits{0}; // vertex references that reused an already shaded vertex
+            std::atomic<std::uint64_t> misses{0}; // vertex shader invocations
+
+            double getHitRate() const noexcept
+            {
+                const auto references = hits + misses;
+                return references ? static_cast<double>(hits) / static_cast<double>(references) : 0.0;
+            }
+
+            void reset() noexcept
+            {
+                hits = 0;
+                misses = 0;
+            }
+        };
+
+        class HierarchicalZ final
+        {
+        public:
+            std::atomic<std::uint64_t> rejected{0}; // triangle-tile pairs behind the farthest depth of the tile
+            std::atomic<std::uint64_t> accepted{0}; // triangle-tile pairs in front of the nearest depth, drawn without depth reads
+
+            void reset() noexcept
+            {
+                rejected = 0;
+                accepted = 0;
+            }
+        };
+
+        Blocks blocks8x8;
+        Blocks blocks4x4;
+        VertexCache vertexCache;
+        HierarchicalZ hierarchicalZ;
+
+        void reset() noexcept
+        {
+            blocks8x8.reset();
+            blocks4x4.reset();
+            vertexCache.reset();
+            hierarchicalZ.reset();
+        }
+    };
+
+    inline Statistics& getStatistics()
+    {
+        static Statistics statistics;
+        return statistics;
+    }
+}
+
+#endif
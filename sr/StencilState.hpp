@@ -0,0 +1,114 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_STENCILSTATE_HPP
+#define SR_STENCILSTATE_HPP
+
+#include <cstdint>
+#include "RenderError.hpp"
+
+namespace sr
+{
+    // The stencil test compares the reference with the stored value, both masked by readMask, as
+    // "reference function stored". It runs before the depth test and the fragment shader, the operation of its
+    // outcome (fail, pass with a failing depth test or pass) writes the bits of writeMask.
+    class StencilState final
+    {
+    public:
+        enum class Function
+        {
+            never,
+            less,
+            lessEqual,
+            greater,
+            greaterEqual,
+            equal,
+            notEqual,
+            always
+        };
+
+        enum class Operation
+        {
+            keep,
+            zero,
+            replace,
+            incrementSaturate,
+            decrementSaturate,
+            invert,
+            increment,
+            decrement
+        };
+
+        bool enabled = false;
+        std::uint8_t reference = 0;
+        std::uint8_t readMask = 0xFFU;
+        std::uint8_t writeMask = 0xFFU;
+        StencilState::Function function = StencilState::Function::always;
+        StencilState::Operation failOperation = StencilState::Operation::keep;
+        StencilState::Operation depthFailOperation = StencilState::Operation::keep;
+        StencilState::Operation passOperation = StencilState::Operation::keep;
+    };
+
+    inline bool getValue(const StencilState::Function function,
+                         const std::uint8_t reference,
+                         const std::uint8_t stored)
+    {
+        switch (function)
+        {
+            case StencilState::Function::never: return false;
+            case StencilState::Function::less: return reference < stored;
+            case StencilState::Function::lessEqual: return reference <= stored;
+            case StencilState::Function::greater: return reference > stored;
+            case StencilState::Function::greaterEqual: return reference >= stored;
+            case StencilState::Function::equal: return reference == stored;
+            case StencilState::Function::notEqual: return reference != stored;
+            case StencilState::Function::always: return true;
+            default: throw RenderError{"Invalid stencil function"};
+        }
+    }
+
+    inline std::uint8_t getValue(const StencilState::Operation operation,
+                                 const std::uint8_t reference,
+                                 const std::uint8_t stored)
+    {
+        switch (operation)
+        {
+            case StencilState::Operation::keep: return stored;
+            case StencilState::Operation::zero: return 0U;
+            case StencilState::Operation::replace: return reference;
+            case StencilState::Operation::incrementSaturate: return stored == 0xFFU ? stored : static_cast<std::uint8_t>(stored + 1U);
+            case StencilState::Operation::decrementSaturate: return stored == 0U ? stored : static_cast<std::uint8_t>(stored - 1U);
+            case StencilState::Operation::invert: return static_cast<std::uint8_t>(~stored);
+            case StencilState::Operation::increment: return static_cast<std::uint8_t>(stored + 1U);
+            case StencilState::Operation::decrement: return static_cast<std::uint8_t>(stored - 1U);
+            default: throw RenderError{"Invalid stencil operation"};
+        }
+    }
+
+    inline bool testStencil(const StencilState& stencilState, const std::uint8_t stored)
+    {
+        return getValue(stencilState.function,
+                        static_cast<std::uint8_t>(stencilState.reference & stencilState.readMask),
+                        static_cast<std::uint8_t>(stored & stencilState.readMask));
+    }
+
+    // the stored value after the operation, only the bits of the write mask change
+    inline std::uint8_t getStencilResult(const StencilState& stencilState,
+                                         const StencilState::Operation operation,
+                                         const std::uint8_t stored)
+    {
+        const auto result = getValue(operation, stencilState.reference, stored);
+        return static_cast<std::uint8_t>((stored & ~stencilState.writeMask) | (result & stencilState.writeMask));
+    }
+
+    // whether the stencil test writes the stencil buffer for pixels that fail the stencil or the depth test
+    inline bool writesStencilOnFail(const StencilState& stencilState) noexcept
+    {
+        return stencilState.enabled && stencilState.writeMask != 0 &&
+            (stencilState.failOperation != StencilState::Operation::keep ||
+             stencilState.depthFailOperation != StencilState::Operation::keep);
+    }
+}
+
+#endif
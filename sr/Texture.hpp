@@ -5,140 +5,458 @@
 #ifndef SR_TEXTURE_HPP
 #define SR_TEXTURE_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 #include <vector>
+#include "AlignedBuffer.hpp"
+#include "BlockCompression.hpp"
 #include "PixelFormat.hpp"
 #include "Sampler.hpp"
+#include "Simd.hpp"
 
 namespace sr
 {
+    // size of the screen-space tiles that are rasterized in parallel, the depth ranges of hierarchical Z and the
+    // fast clears of the render targets are tracked per tile
+    constexpr std::size_t tileSize = 64;
+
+    // index of texel (x, y) in a tiled level: row-major 4x4 blocks with the bits of x and y inside of the block
+    // interleaved (y1 x1 y0 x0)
+    constexpr std::size_t getTiledTexelIndex(const std::size_t x, const std::size_t y, const std::size_t blocksPerRow) noexcept
+    {
+        return ((y / 4) * blocksPerRow + x / 4) * 16 +
+            ((x & 1U) | ((y & 1U) << 1) | ((x & 2U) << 1) | ((y & 2U) << 2));
+    }
+
+    // integer texel coordinate of a position in texels, limited to a range that the address modes can handle
+    inline std::int64_t getTexelCoordinate(const float position) noexcept
+    {
+        // also maps NaNs to the lower limit
+        constexpr float limit = 1073741824.0F;
+        const auto clamped = std::min(limit, std::max(-limit, position));
+
+        // floor without a library call
+        const auto truncated = static_cast<std::int64_t>(clamped);
+        return clamped < static_cast<float>(truncated) ? truncated - 1 : truncated;
+    }
+
+    // maps a texel coordinate to the texels of a side of the given size
+    inline std::size_t applyAddressMode(const Sampler::AddressMode addressMode,
+                                        const std::int64_t coordinate,
+                                        const std::size_t size) noexcept
+    {
+        const auto count = static_cast<std::int64_t>(size);
+
+        switch (addressMode)
+        {
+            case Sampler::AddressMode::clamp:
+                return static_cast<std::size_t>(std::clamp(coordinate, std::int64_t{0}, count - 1));
+            case Sampler::AddressMode::repeat:
+            {
+                const auto result = coordinate % count;
+                return static_cast<std::size_t>(result < 0 ? result + count : result);
+            }
+            case Sampler::AddressMode::mirror:
+            {
+                auto result = coordinate % (count * 2);
+                if (result < 0) result += count * 2;
+                return static_cast<std::size_t>(result < count ? result : count * 2 - 1 - result);
+            }
+            default:
+                return 0;
+        }
+    }
+
     class Texture final
     {
     public:
+        // range of the depths stored in a tile of a depth buffer as the values of quantizeDepth, it is unknown if
+        // nearest is greater than farthest
+        struct DepthRange final
+        {
+            float nearest = std::numeric_limits<float>::infinity();
+            float farthest = -std::numeric_limits<float>::infinity();
+            // farthest is only a bound, because the depth test may have replaced the farthest depths with nearer ones
+            bool stale = false;
+        };
+
+        // Order of the texels of a level in memory. Tiled levels are made of 4x4 blocks (64 bytes of rgba8, a cache
+        // line) in row-major order, with the texels of each block in Morton order, so that samples along any
+        // direction stay in few cache lines. The data of tiled levels is padded to whole blocks. The blocks of the
+        // block-compressed formats are always in row-major order, so their textures have the linear layout.
+        enum class Layout
+        {
+            linear,
+            tiled
+        };
 
+        // Multisampled textures (render targets with 4 samples per pixel) have a single level in the linear
+        // layout, which stores the samples as consecutive planes of width * height pixels.
         Texture(const PixelFormat initPixelFormat = PixelFormat::rgba8,
                 const std::size_t initWidth = 0,
                 const std::size_t initHeight = 0,
-                const bool initMipMaps = false):
+                const bool initMipMaps = false,
+                const Layout initLayout = Layout::linear,
+                const std::size_t initSampleCount = 1):
             pixelFormat{initPixelFormat},
             width{initWidth},
             height{initHeight},
-            mipMaps{initMipMaps}
+            mipMaps{initMipMaps},
+            layout{isBlockCompressed(initPixelFormat) ? Layout::linear : initLayout},
+            sampleCount{initSampleCount}
         {
-            const auto pixelSize = getPixelSize(pixelFormat);
+            if (sampleCount != 1 &&
+                (sampleCount != 4 || mipMaps || layout != Layout::linear || isBlockCompressed(pixelFormat)))
+                throw std::runtime_error{"Invalid sample count"};
 
-            if (pixelSize > 0 && width > 0 && height > 0)
-            {
-                levels.push_back(std::vector<std::uint8_t>(width * height * pixelSize));
+            if (isValidPixelFormat() && width > 0 && height > 0)
+                allocateLevels();
+        }
 
-                if (mipMaps)
-                {
-                    std::size_t newWidth = width;
-                    std::size_t newHeight = height;
+        void resize(std::size_t newWidth, std::size_t newHeight)
+        {
+            width = newWidth;
+            height = newHeight;
 
-                    while (newWidth > 1 || newHeight > 1)
-                    {
-                        newWidth >>= 1;
-                        newHeight >>= 1;
+            if (!isValidPixelFormat())
+                throw std::runtime_error{"Invalid pixel format"};
 
-                        if (newWidth < 1) newWidth = 1;
-                        if (newHeight < 1) newHeight = 1;
+            tileDepthRanges.clear();
+            clearedTiles.clear();
+            allocateLevels();
+        }
 
-                        levels.push_back(std::vector<std::uint8_t>(newWidth * newHeight * pixelSize));
-                    }
-                }
+        auto getPixelFormat() const noexcept { return pixelFormat; }
+        auto getWidth() const noexcept { return width; }
+        auto getHeight() const noexcept { return height; }
+        auto getLayout() const noexcept { return layout; }
+        auto getSampleCount() const noexcept { return sampleCount; }
+
+        std::size_t getLevelCount() const noexcept
+        {
+            return levelOffsets.size();
+        }
+
+        std::size_t getLevelWidth(const std::uint32_t level) const noexcept
+        {
+            return std::max(width >> level, static_cast<std::size_t>(1U));
+        }
+
+        std::size_t getLevelHeight(const std::uint32_t level) const noexcept
+        {
+            return std::max(height >> level, static_cast<std::size_t>(1U));
+        }
+
+        // range of levels and the bias for the filters that select the level by the derivatives
+        auto getMinLOD() const noexcept { return minLOD; }
+        void setMinLOD(const std::uint32_t newMinLOD) noexcept { minLOD = newMinLOD; }
+        auto getMaxLOD() const noexcept { return maxLOD; }
+        void setMaxLOD(const std::uint32_t newMaxLOD) noexcept { maxLOD = newMaxLOD; }
+        auto getLODBias() const noexcept { return lodBias; }
+        void setLODBias(const float newLODBias) noexcept { lodBias = newLODBias; }
+
+        // The data of the level in the layout of the texture, the blocks of the block-compressed formats. All
+        // levels are in a single allocation and start at multiples of 64 bytes.
+        Span<std::uint8_t> getData(std::uint32_t level = 0)
+        {
+            if (level == 0) resolveClear();
+            return getUnresolvedData(level);
+        }
+
+        // the data without the pending fast clear, which only the non-const getData() and resolveClear() write
+        Span<const std::uint8_t> getData(std::uint32_t level = 0) const
+        {
+            return getLevelData(level);
+        }
+
+        // copy of the data of the level in the linear layout (the blocks of the block-compressed formats)
+        std::vector<std::uint8_t> getLinearData(std::uint32_t level = 0) const
+        {
+            const auto buffer = getLevelData(level);
+            std::vector<std::uint8_t> result;
+
+            if (layout == Layout::linear)
+                result.assign(buffer.begin(), buffer.end());
+            else
+            {
+                const auto pixelSize = getPixelSize(pixelFormat);
+                const auto levelWidth = getLevelWidth(level);
+                const auto levelHeight = getLevelHeight(level);
+
+                result.resize(levelWidth * levelHeight * pixelSize);
+                for (std::size_t y = 0; y < levelHeight; ++y)
+                    for (std::size_t x = 0; x < levelWidth; ++x)
+                        std::copy_n(&buffer[getTexelIndex(x, y, level) * pixelSize], pixelSize,
+                                    &result[(y * levelWidth + x) * pixelSize]);
             }
+
+            // the copy has the pending fast clear, the data is not written
+            if (level == 0)
+                for (std::size_t tile = 0; tile < clearedTiles.size(); ++tile)
+                    if (clearedTiles[tile]) writeClearTile(result.data(), Layout::linear, tile);
+
+            return result;
         }
 
-        void resize(std::size_t newWidth, std::size_t newHeight)
+        // sets the data of the level from the linear layout (the blocks of the block-compressed formats)
+        void setData(const std::vector<std::uint8_t>& buffer, std::uint32_t level = 0)
         {
-            width = newWidth;
-            height = newHeight;
+            if (!isValidPixelFormat())
+                throw std::runtime_error{"Invalid pixel format"};
 
             const auto pixelSize = getPixelSize(pixelFormat);
-            if (pixelSize == 0)
-                throw std::runtime_error{"Invalid pixel format"};
+            const auto levelWidth = getLevelWidth(level);
+            const auto levelHeight = getLevelHeight(level);
+
+            if (buffer.size() != getDataSize(pixelFormat, levelWidth, levelHeight) * sampleCount)
+                throw std::runtime_error{"Invalid buffer size"};
+
+            if (level >= getLevelCount())
+                throw std::runtime_error{"Invalid level"};
 
-            levels.clear();
-            levels.push_back(std::vector<std::uint8_t>(width * height * pixelSize));
+            // the whole level is overwritten
+            if (level == 0) clearedTiles.clear();
+            const auto data = getUnresolvedData(level);
 
-            if (mipMaps)
+            if (layout == Layout::linear)
+                std::copy(buffer.begin(), buffer.end(), data.begin());
+            else
             {
-                newWidth = width;
-                newHeight = height;
+                std::fill(data.begin(), data.end(), std::uint8_t{0});
 
-                while (newWidth > 1 || newHeight > 1)
-                {
-                    newWidth >>= 1;
-                    newHeight >>= 1;
+                for (std::size_t y = 0; y < levelHeight; ++y)
+                    for (std::size_t x = 0; x < levelWidth; ++x)
+                        std::copy_n(&buffer[(y * levelWidth + x) * pixelSize], pixelSize,
+                                    &data[getTexelIndex(x, y, level) * pixelSize]);
+            }
+
+            if (level == 0) tileDepthRanges.clear();
+        }
+
+        // fills every level below the base level with the 2x2 box filtered level above it
+        void generateMipMaps()
+        {
+            if (isBlockCompressed(pixelFormat))
+                throw std::runtime_error{"Mip maps of block-compressed textures are encoded with the base level"};
+
+            if (pixelFormat == PixelFormat::depth16 || pixelFormat == PixelFormat::d24s8 ||
+                pixelFormat == PixelFormat::stencil8)
+                throw std::runtime_error{"Mip maps of packed depth and stencil formats are not supported"};
+
+            if (getLevelCount() < 2) return;
 
-                    if (newWidth < 1) newWidth = 1;
-                    if (newHeight < 1) newHeight = 1;
+            const auto pixelSize = getPixelSize(pixelFormat);
+            auto source = getLinearData(0);
+
+            for (std::uint32_t level = 1; level < getLevelCount(); ++level)
+            {
+                const auto sourceWidth = getLevelWidth(level - 1);
+                const auto sourceHeight = getLevelHeight(level - 1);
+                const auto levelWidth = getLevelWidth(level);
+                const auto levelHeight = getLevelHeight(level);
+
+                std::vector<std::uint8_t> destination(levelWidth * levelHeight * pixelSize);
 
-                    levels.push_back(std::vector<std::uint8_t>(newWidth * newHeight * pixelSize));
+                for (std::size_t y = 0; y < levelHeight; ++y)
+                {
+                    // a side of length 1 is not halved
+                    const auto row0 = source.data() + std::min(y * 2, sourceHeight - 1) * sourceWidth * pixelSize;
+                    const auto row1 = source.data() + std::min(y * 2 + 1, sourceHeight - 1) * sourceWidth * pixelSize;
+                    const auto row = destination.data() + y * levelWidth * pixelSize;
+
+                    if (pixelFormat == PixelFormat::float32)
+                        downsampleRow(reinterpret_cast<const float*>(row0),
+                                      reinterpret_cast<const float*>(row1),
+                                      reinterpret_cast<float*>(row),
+                                      levelWidth, sourceWidth);
+                    else
+                        downsampleRow(row0, row1, row, levelWidth, sourceWidth, pixelSize);
                 }
+
+                setData(destination, level);
+                source = std::move(destination);
             }
         }
 
-        auto getPixelFormat() const noexcept { return pixelFormat; }
-        auto getWidth() const noexcept { return width; }
-        auto getHeight() const noexcept { return height; }
+        // Hierarchical Z: depth ranges of the tiles of a depth buffer, maintained by the renderer and by clear.
+        // The non-const getData() and getUnresolvedData() of the base level reset them, because the depths may be
+        // written through them.
+        std::vector<DepthRange>& getTileDepthRanges() noexcept
+        {
+            return tileDepthRanges;
+        }
 
-        std::size_t getLevelCount() const noexcept
+        void resetTileDepthRanges() noexcept
         {
-            return levels.size();
+            tileDepthRanges.clear();
         }
 
-        std::vector<std::uint8_t>& getData(std::uint32_t level = 0)
+        // Fast clear: records the clear value of the base level (the bytes of a pixel in the format of the
+        // texture) and marks all of its tiles as cleared instead of writing them. A cleared tile is written when
+        // the renderer first draws into it, by resolveClear() or by the first non-const getData() of the base
+        // level, so tiles that nothing draws into are only written if the data is read. getPixel() and
+        // getLinearData() read the clear value of the cleared tiles without writing them, the const getData()
+        // returns the tiles as they were before the clear.
+        void fastClear(const void* pixel)
         {
-            return levels[level];
+            const auto pixelSize = getPixelSize(pixelFormat);
+            if (pixelSize == 0 || pixelSize > clearPixel.size())
+                throw std::runtime_error{"Invalid pixel format"};
+
+            std::memcpy(clearPixel.data(), pixel, pixelSize);
+            if (getLevelCount() > 0)
+                clearedTiles.assign(getTileCountX() * getTileCountY(), 1);
         }
 
-        const std::vector<std::uint8_t>& getData(std::uint32_t level = 0) const
+        bool isTileCleared(const std::size_t tile) const noexcept
         {
-            return levels[level];
+            return !clearedTiles.empty() && clearedTiles[tile];
         }
 
-        void setData(const std::vector<std::uint8_t>& buffer, std::uint32_t level = 0)
+        bool hasClearedTiles() const noexcept
+        {
+            return std::any_of(clearedTiles.begin(), clearedTiles.end(), [](const std::uint8_t cleared) noexcept { return cleared != 0; });
+        }
+
+        // writes the clear value to the tile if it is cleared, different tiles can be resolved concurrently
+        void resolveClear(const std::size_t tile) noexcept
+        {
+            if (!isTileCleared(tile)) return;
+
+            writeClearTile(storage.getData(), layout, tile);
+            clearedTiles[tile] = 0;
+        }
+
+        // writes the clear value to all of the cleared tiles
+        void resolveClear() noexcept
+        {
+            writeClearedTiles();
+        }
+
+        // drops the pending fast clear without writing it, for when all of the data is about to be overwritten
+        void discardClear() noexcept
+        {
+            clearedTiles.clear();
+        }
+
+        // Copies a tile of the base level of a linear texture to memory with rows of tileSize pixels and samples
+        // in planes of tileSize * tileSize pixels (the tile memory of render passes). A cleared tile is read as
+        // its clear value without resolving it.
+        void readTile(const std::size_t tile, std::uint8_t* data) const noexcept
         {
             const auto pixelSize = getPixelSize(pixelFormat);
-            if (pixelSize == 0)
-                throw std::runtime_error{"Invalid pixel format"};
+            const auto minX = (tile % getTileCountX()) * tileSize;
+            const auto minY = (tile / getTileCountX()) * tileSize;
+            const auto maxX = std::min(minX + tileSize, width);
+            const auto maxY = std::min(minY + tileSize, height);
 
-            if (buffer.size() != width * height * pixelSize)
-                throw std::runtime_error{"Invalid buffer size"};
+            for (std::size_t sample = 0; sample < sampleCount; ++sample)
+            {
+                const auto plane = storage.getData() + sample * width * height * pixelSize;
+                const auto tilePlane = data + sample * tileSize * tileSize * pixelSize;
+
+                for (auto y = minY; y < maxY; ++y)
+                    if (isTileCleared(tile))
+                        writeClearPixels(tilePlane + (y - minY) * tileSize * pixelSize, maxX - minX);
+                    else
+                        std::memcpy(tilePlane + (y - minY) * tileSize * pixelSize,
+                                    plane + (y * width + minX) * pixelSize,
+                                    (maxX - minX) * pixelSize);
+            }
+        }
+
+        // Copies a tile from memory in the layout of readTile, replacing its pending clear. Different tiles can be
+        // written concurrently, so it does not update the version of the data like getRenderTargetData(), which has
+        // to be called before.
+        void writeTile(const std::size_t tile, const std::uint8_t* data) noexcept
+        {
+            const auto pixelSize = getPixelSize(pixelFormat);
+            const auto minX = (tile % getTileCountX()) * tileSize;
+            const auto minY = (tile / getTileCountX()) * tileSize;
+            const auto maxX = std::min(minX + tileSize, width);
+            const auto maxY = std::min(minY + tileSize, height);
+
+            for (std::size_t sample = 0; sample < sampleCount; ++sample)
+            {
+                const auto plane = storage.getData() + sample * width * height * pixelSize;
+                const auto tilePlane = data + sample * tileSize * tileSize * pixelSize;
+
+                for (auto y = minY; y < maxY; ++y)
+                    std::memcpy(plane + (y * width + minX) * pixelSize,
+                                tilePlane + (y - minY) * tileSize * pixelSize,
+                                (maxX - minX) * pixelSize);
+            }
+
+            if (isTileCleared(tile)) clearedTiles[tile] = 0;
+        }
+
+        // The data of the level without resolving the pending fast clear. The depths may be written through it,
+        // so the tile depth ranges of the base level are reset.
+        Span<std::uint8_t> getUnresolvedData(std::uint32_t level = 0)
+        {
+            if (level == 0) tileDepthRanges.clear();
+            return getRenderTargetData(level);
+        }
 
-            if (level >= levels.size()) levels.resize(level + 1);
-            levels[level] = buffer;
+        // getUnresolvedData() for the renderer, which resolves the tiles that it draws into and keeps the tile
+        // depth ranges up to date itself
+        Span<std::uint8_t> getRenderTargetData(std::uint32_t level = 0)
+        {
+            // the data may be written through the span
+            version = getNextVersion();
+            return Span<std::uint8_t>{storage.getData() + levelOffsets[level], getLevelDataSize(level)};
         }
 
+        // the first sample of the pixels of multisampled textures
         Color getPixel(const std::size_t x,
                        const std::size_t y,
                        const std::uint32_t level) const
         {
-            const auto& buffer = levels[level];
+            const auto buffer = getLevelData(level);
+
+            if (isBlockCompressed(pixelFormat))
+            {
+                const auto blocksPerRow = (getLevelWidth(level) + 3) / 4;
+                const auto block = &buffer[((y / 4) * blocksPerRow + x / 4) * getBlockSize(pixelFormat)];
+                const auto texel = getDecodedBlock(pixelFormat, block, version) + ((y % 4) * 4 + x % 4) * 4;
+                return Color{texel[0], texel[1], texel[2], texel[3]};
+            }
+
+            // the tiles of a pending fast clear hold the clear value
+            const auto pixel = (level == 0 && isTileCleared((y / tileSize) * getTileCountX() + x / tileSize)) ?
+                clearPixel.data() :
+                &buffer[getTexelIndex(x, y, level) * getPixelSize(pixelFormat)];
 
             switch (pixelFormat)
             {
                 case PixelFormat::r8:
-                {
-                    const auto* r = &buffer[(y * width + x) * 1];
-                    return Color{*r, *r, *r, std::uint8_t(255U)};
-                }
+                case PixelFormat::stencil8:
+                    return Color{pixel[0], pixel[0], pixel[0], std::uint8_t(255U)};
                 case PixelFormat::a8:
-                {
-                    const auto* a = &buffer[(y * width + x) * 1];
-                    return Color{std::uint8_t(0U), std::uint8_t(0U), std::uint8_t(0U), *a};
-                }
+                    return Color{std::uint8_t(0U), std::uint8_t(0U), std::uint8_t(0U), pixel[0]};
                 case PixelFormat::rgba8:
+                    return Color{pixel[0], pixel[1], pixel[2], pixel[3]};
+                case PixelFormat::float32:
                 {
-                    const auto* rgba = &buffer[(y * width + x) * 4];
-                    return Color{rgba[0], rgba[1], rgba[2], rgba[3]};
+                    float f;
+                    std::memcpy(&f, pixel, sizeof(f));
+                    return Color{f, f, f, 1.0F};
                 }
-                case PixelFormat::float32:
+                case PixelFormat::depth16:
+                case PixelFormat::d24s8:
                 {
-                    const float f = reinterpret_cast<const float*>(buffer.data())[y * width + x];
+                    // the depth as a gray, the stencil of d24s8 is not visible
+                    std::uint32_t value = 0;
+                    std::memcpy(&value, pixel, getPixelSize(pixelFormat));
+                    const auto depthMax = getDepthMax(pixelFormat);
+                    const auto f = static_cast<float>(value & depthMax) / static_cast<float>(depthMax);
                     return Color{f, f, f, 1.0F};
                 }
                 default:
@@ -146,97 +464,449 @@ namespace sr
             }
         }
 
+        // samples the base level, the mip filters are linear
         Color sample(const Sampler* sampler, const Vector<float, 2>& coord) const
         {
-            if (sampler && !levels.empty())
-            {
-                const auto u =
-                    (sampler->addressModeX == Sampler::AddressMode::clamp) ? std::clamp(coord.v[0], 0.0F, 1.0F) * (width - 1) :
-                    (sampler->addressModeX == Sampler::AddressMode::repeat) ? std::fmod(coord.v[0], 1.0F) * (width - 1) :
-                    (sampler->addressModeX == Sampler::AddressMode::mirror) ? 1.0F - 2.0F * std::fabs(std::fmod(coord.v[0] / 2.0F, 1.0F) - 0.5F) * (width - 1) :
-                    0.0F;
+            if (sampler && !levelOffsets.empty())
+                return sampleLevel(*sampler, coord, 0);
+
+            return Color{};
+        }
+
+        // samples the levels selected by the screen-space derivatives of the texture coordinates
+        Color sample(const Sampler* sampler,
+                     const Vector<float, 2>& coord,
+                     const Vector<float, 2>& ddx,
+                     const Vector<float, 2>& ddy) const
+        {
+            if (!sampler || levelOffsets.empty())
+                return Color{};
+
+            return sampleLevels(sampler->filter, ddx, ddy, [this, sampler, &coord](const std::uint32_t level) {
+                return sampleLevel(*sampler, coord, level);
+            });
+        }
+
+        // Selects the levels for the filter by the derivatives and blends them, getLevelSample(level) returns the
+        // sample of a single level. Point and linear filters read the base level.
+        template <class GetLevelSample>
+        Color sampleLevels(const Sampler::Filter filter,
+                           const Vector<float, 2>& ddx,
+                           const Vector<float, 2>& ddy,
+                           const GetLevelSample& getLevelSample) const
+        {
+            if (filter == Sampler::Filter::point || filter == Sampler::Filter::linear)
+                return getLevelSample(0);
+
+            const auto lod = getLOD(ddx, ddy);
+
+            if (filter == Sampler::Filter::linearMipPoint)
+                return getLevelSample(static_cast<std::uint32_t>(lod + 0.5F));
+
+            // trilinear
+            const auto level = static_cast<std::uint32_t>(lod);
+            const auto t = lod - static_cast<float>(level);
+            const auto color0 = getLevelSample(level);
+            if (t == 0.0F) return color0;
+
+            const auto color1 = getLevelSample(level + 1);
+            return Color{
+                color0.r + unfused((color1.r - color0.r) * t),
+                color0.g + unfused((color1.g - color0.g) * t),
+                color0.b + unfused((color1.b - color0.b) * t),
+                color0.a + unfused((color1.a - color0.a) * t)
+            };
+        }
+
+        // the level of detail is log2 of the longer of the footprints of a pixel along x and y in texels of the
+        // base level, clamped to the levels that exist and to the LOD range
+        float getLOD(const Vector<float, 2>& ddx, const Vector<float, 2>& ddy) const noexcept
+        {
+            const auto textureWidth = static_cast<float>(width);
+            const auto textureHeight = static_cast<float>(height);
+            const auto lengthX = unfused((ddx.v[0] * textureWidth) * (ddx.v[0] * textureWidth)) + unfused((ddx.v[1] * textureHeight) * (ddx.v[1] * textureHeight));
+            const auto lengthY = unfused((ddy.v[0] * textureWidth) * (ddy.v[0] * textureWidth)) + unfused((ddy.v[1] * textureHeight) * (ddy.v[1] * textureHeight));
+
+            // log2 of the square root
+            const auto lod = unfused(0.5F * std::log2(std::max(lengthX, lengthY))) + lodBias;
 
-                const auto v =
-                    (sampler->addressModeY == Sampler::AddressMode::clamp) ? std::clamp(coord.v[1], 0.0F, 1.0F) * (height - 1) :
-                    (sampler->addressModeY == Sampler::AddressMode::repeat) ? std::fmod(coord.v[1], 1.0F) * (height - 1) :
-                    (sampler->addressModeY == Sampler::AddressMode::mirror) ? 1.0F - 2.0F * std::fabs(std::fmod(coord.v[1] / 2.0F, 1.0F) - 0.5F) * (height - 1) :
-                    0.0F;
+            const auto maxLevel = static_cast<float>(std::min(static_cast<std::size_t>(maxLOD), getLevelCount() - 1));
+            const auto minLevel = std::min(static_cast<float>(minLOD), maxLevel);
 
-                if (sampler->filter == Sampler::Filter::point)
+            // NaNs (from infinite derivatives) select the first level
+            return std::min(std::max(minLevel, lod), maxLevel);
+        }
+
+    private:
+        Span<const std::uint8_t> getLevelData(const std::uint32_t level) const noexcept
+        {
+            return Span<const std::uint8_t>{storage.getData() + levelOffsets[level], getLevelDataSize(level)};
+        }
+
+        std::size_t getTileCountX() const noexcept { return (width + tileSize - 1) / tileSize; }
+        std::size_t getTileCountY() const noexcept { return (height + tileSize - 1) / tileSize; }
+
+        template <class T>
+        static void fillPixels(std::uint8_t* data, const std::size_t count, const T value) noexcept
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                std::memcpy(data + i * sizeof(T), &value, sizeof(T));
+        }
+
+        // writes the clear value to count consecutive pixels
+        void writeClearPixels(std::uint8_t* data, const std::size_t count) const noexcept
+        {
+            switch (getPixelSize(pixelFormat))
+            {
+                case 1:
+                    std::memset(data, clearPixel[0], count);
+                    break;
+                case 2:
                 {
-                    const auto textureX = static_cast<std::size_t>(std::round(u));
-                    const auto textureY = static_cast<std::size_t>(std::round(v));
-                    return getPixel(textureX, textureY, 0);
+                    std::uint16_t value;
+                    std::memcpy(&value, clearPixel.data(), sizeof(value));
+                    fillPixels(data, count, value);
+                    break;
                 }
-                else if (sampler->filter == Sampler::Filter::linear)
+                case 4:
                 {
-                    auto textureX0 = static_cast<std::size_t>(u - 0.5F);
-                    auto textureX1 = textureX0 + 1;
-                    auto textureY0 = static_cast<std::size_t>(v - 0.5F);
-                    auto textureY1 = textureY0 + 1;
-
-                    textureX0 = std::clamp(textureX0, static_cast<std::size_t>(0U), width - 1);
-                    textureX1 = std::clamp(textureX1, static_cast<std::size_t>(0U), width - 1);
-                    textureY0 = std::clamp(textureY0, static_cast<std::size_t>(0U), height - 1);
-                    textureY1 = std::clamp(textureY1, static_cast<std::size_t>(0U), height - 1);
-
-                    // TODO: calculate mip level
-                    const Color color[4] = {
-                        getPixel(textureX0, textureY0, 0),
-                        getPixel(textureX1, textureY0, 0),
-                        getPixel(textureX0, textureY1, 0),
-                        getPixel(textureX1, textureY1, 0)
-                    };
-
-                    const auto x0 = u - (textureX0 + 0.5F);
-                    const auto y0 = v - (textureY0 + 0.5F);
-                    const auto x1 = (textureX0 + 1.5F) - u;
-                    const auto y1 = (textureY0 + 1.5F) - v;
-                    
-                    return Color{
-                        color[0].r * x1 * y1 + color[1].r * x0 * y1 + color[2].r * x1 * y0 + color[3].r * x0 * y0,
-                        color[0].g * x1 * y1 + color[1].g * x0 * y1 + color[2].g * x1 * y0 + color[3].g * x0 * y0,
-                        color[0].b * x1 * y1 + color[1].b * x0 * y1 + color[2].b * x1 * y0 + color[3].b * x0 * y0,
-                        color[0].a * x1 * y1 + color[1].a * x0 * y1 + color[2].a * x1 * y0 + color[3].a * x0 * y0
-                    };
+                    std::uint32_t value;
+                    std::memcpy(&value, clearPixel.data(), sizeof(value));
+                    fillPixels(data, count, value);
+                    break;
                 }
+                default:
+                    break;
             }
+        }
 
-            return Color{};
+        // writes the clear value to the tile of a base level in the given layout, in all of its samples
+        void writeClearTile(std::uint8_t* data, const Layout dataLayout, const std::size_t tile) const noexcept
+        {
+            const auto pixelSize = getPixelSize(pixelFormat);
+            const auto minX = (tile % getTileCountX()) * tileSize;
+            const auto minY = (tile / getTileCountX()) * tileSize;
+            const auto maxX = std::min(minX + tileSize, width);
+            const auto maxY = std::min(minY + tileSize, height);
+
+            for (std::size_t sample = 0; sample < sampleCount; ++sample)
+            {
+                const auto plane = data + sample * width * height * pixelSize;
+
+                for (auto y = minY; y < maxY; ++y)
+                    if (dataLayout == Layout::linear)
+                        writeClearPixels(plane + (y * width + minX) * pixelSize, maxX - minX);
+                    else
+                        for (auto x = minX; x < maxX; ++x)
+                            writeClearPixels(plane + getTexelIndex(x, y, 0) * pixelSize, 1);
+            }
+        }
+
+        // resolves the pending fast clear
+        void writeClearedTiles() noexcept
+        {
+            if (clearedTiles.empty()) return;
+
+            if (std::all_of(clearedTiles.begin(), clearedTiles.end(), [](const std::uint8_t cleared) noexcept { return cleared != 0; }))
+            {
+                // all of the data, also the padding of tiled levels
+                writeClearPixels(storage.getData(), getLevelDataSize(0) / getPixelSize(pixelFormat));
+            }
+            else
+                for (std::size_t tile = 0; tile < clearedTiles.size(); ++tile)
+                    if (clearedTiles[tile]) writeClearTile(storage.getData(), layout, tile);
+
+            clearedTiles.clear();
+        }
+
+        bool isValidPixelFormat() const noexcept
+        {
+            return getPixelSize(pixelFormat) > 0 || isBlockCompressed(pixelFormat);
+        }
+
+        // bytes of the data of the level, including the padding of tiled levels and all samples
+        std::size_t getLevelDataSize(const std::uint32_t level) const noexcept
+        {
+            if (layout == Layout::linear)
+                return getDataSize(pixelFormat, getLevelWidth(level), getLevelHeight(level)) * sampleCount;
+
+            return getDataSize(pixelFormat,
+                               (getLevelWidth(level) + 3) & ~static_cast<std::size_t>(3U),
+                               (getLevelHeight(level) + 3) & ~static_cast<std::size_t>(3U));
+        }
+
+        // Changes whenever the data may change, so that the cached decoded blocks of block-compressed textures
+        // are never stale. The versions are unique across all textures, so a texture that reuses the memory of
+        // another one does not hit its cached blocks either.
+        static std::uint64_t getNextVersion() noexcept
+        {
+            static std::atomic<std::uint64_t> nextVersion{1};
+            return nextVersion.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::size_t getTexelIndex(const std::size_t x, const std::size_t y, const std::uint32_t level) const noexcept
+        {
+            if (layout == Layout::linear)
+                return y * getLevelWidth(level) + x;
+
+            return getTiledTexelIndex(x, y, (getLevelWidth(level) + 3) / 4);
+        }
+
+        // lays out the levels in the storage, which is reused if it is large enough, and zeroes them
+        void allocateLevels()
+        {
+            const std::uint32_t levelCount = mipMaps ? getMipLevelCount(width, height) : 1;
+
+            levelOffsets.clear();
+            std::size_t size = 0;
+            for (std::uint32_t level = 0; level < levelCount; ++level)
+            {
+                levelOffsets.push_back(size);
+                size += (getLevelDataSize(level) + AlignedBuffer::alignment - 1) / AlignedBuffer::alignment * AlignedBuffer::alignment;
+            }
+
+            storage.allocate(size);
+            std::fill_n(storage.getData(), size, std::uint8_t{0});
+            version = getNextVersion();
+        }
+
+        // levels down to 1x1
+        static std::uint32_t getMipLevelCount(std::size_t levelWidth, std::size_t levelHeight) noexcept
+        {
+            std::uint32_t levelCount = 1;
+
+            while (levelWidth > 1 || levelHeight > 1)
+            {
+                levelWidth = std::max(levelWidth >> 1, static_cast<std::size_t>(1U));
+                levelHeight = std::max(levelHeight >> 1, static_cast<std::size_t>(1U));
+                ++levelCount;
+            }
+
+            return levelCount;
+        }
+
+        // Point or bilinear sample of a single level, the mip filters are bilinear inside of their levels. The
+        // texel centers are at half-integer positions, so the texture coordinates 0 and 1 are the outer edges of
+        // the texture.
+        Color sampleLevel(const Sampler& sampler, const Vector<float, 2>& coord, const std::uint32_t level) const
+        {
+            const auto levelWidth = getLevelWidth(level);
+            const auto levelHeight = getLevelHeight(level);
+            // the products are rounded before the offsets of the texel centers are subtracted, like in SamplerBinding
+            const auto u = unfused(coord.v[0] * static_cast<float>(levelWidth));
+            const auto v = unfused(coord.v[1] * static_cast<float>(levelHeight));
+
+            if (sampler.filter == Sampler::Filter::point)
+                return getPixel(applyAddressMode(sampler.addressModeX, getTexelCoordinate(u), levelWidth),
+                                applyAddressMode(sampler.addressModeY, getTexelCoordinate(v), levelHeight),
+                                level);
+
+            const auto textureX = getTexelCoordinate(u - 0.5F);
+            const auto textureY = getTexelCoordinate(v - 0.5F);
+            const auto textureX0 = applyAddressMode(sampler.addressModeX, textureX, levelWidth);
+            const auto textureX1 = applyAddressMode(sampler.addressModeX, textureX + 1, levelWidth);
+            const auto textureY0 = applyAddressMode(sampler.addressModeY, textureY, levelHeight);
+            const auto textureY1 = applyAddressMode(sampler.addressModeY, textureY + 1, levelHeight);
+
+            const Color color[4] = {
+                getPixel(textureX0, textureY0, level),
+                getPixel(textureX1, textureY0, level),
+                getPixel(textureX0, textureY1, level),
+                getPixel(textureX1, textureY1, level)
+            };
+
+            // weights of the second column and row
+            const auto x1 = (u - 0.5F) - static_cast<float>(textureX);
+            const auto y1 = (v - 0.5F) - static_cast<float>(textureY);
+            const auto x0 = 1.0F - x1;
+            const auto y0 = 1.0F - y1;
+
+            const auto blend = [x0, y0, x1, y1](const float value0, const float value1, const float value2, const float value3) noexcept {
+                return unfused(value0 * x0 * y0) + unfused(value1 * x1 * y0) + unfused(value2 * x0 * y1) + unfused(value3 * x1 * y1);
+            };
+
+            return Color{
+                blend(color[0].r, color[1].r, color[2].r, color[3].r),
+                blend(color[0].g, color[1].g, color[2].g, color[3].g),
+                blend(color[0].b, color[1].b, color[2].b, color[3].b),
+                blend(color[0].a, color[1].a, color[2].a, color[3].a)
+            };
+        }
+
+        // averages 2x2 pixels of two rows of the level above, rounded to nearest
+        static void downsampleRow(const std::uint8_t* row0,
+                                  const std::uint8_t* row1,
+                                  std::uint8_t* result,
+                                  const std::size_t resultWidth,
+                                  const std::size_t sourceWidth,
+                                  const std::size_t pixelSize) noexcept
+        {
+            std::size_t x = 0;
+
+#ifdef SR_SIMD_SSE2
+            // two RGBA pixels from four pixels of each row at once
+            if (pixelSize == 4 && sourceWidth == resultWidth * 2)
+            {
+                const auto zero = _mm_setzero_si128();
+                const auto rounding = _mm_set1_epi16(2);
+
+                for (; x + 2 <= resultWidth; x += 2)
+                {
+                    const auto pixels0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+                    const auto pixels1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+
+                    // vertical sums of the channels of the four columns, then of the pairs of columns
+                    const auto sums01 = _mm_add_epi16(_mm_unpacklo_epi8(pixels0, zero), _mm_unpacklo_epi8(pixels1, zero));
+                    const auto sums23 = _mm_add_epi16(_mm_unpackhi_epi8(pixels0, zero), _mm_unpackhi_epi8(pixels1, zero));
+                    const auto sums = _mm_add_epi16(_mm_unpacklo_epi64(sums01, sums23), _mm_unpackhi_epi64(sums01, sums23));
+
+                    const auto averages = _mm_srli_epi16(_mm_add_epi16(sums, rounding), 2);
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(result + x * 4), _mm_packus_epi16(averages, zero));
+                }
+            }
+#endif
+
+            for (; x < resultWidth; ++x)
+            {
+                const auto x0 = std::min(x * 2, sourceWidth - 1) * pixelSize;
+                const auto x1 = std::min(x * 2 + 1, sourceWidth - 1) * pixelSize;
+
+                for (std::size_t channel = 0; channel < pixelSize; ++channel)
+                    result[x * pixelSize + channel] = static_cast<std::uint8_t>((row0[x0 + channel] + row0[x1 + channel] +
+                                                                                 row1[x0 + channel] + row1[x1 + channel] + 2) / 4);
+            }
+        }
+
+        static void downsampleRow(const float* row0,
+                                  const float* row1,
+                                  float* result,
+                                  const std::size_t resultWidth,
+                                  const std::size_t sourceWidth) noexcept
+        {
+            for (std::size_t x = 0; x < resultWidth; ++x)
+            {
+                const auto x0 = std::min(x * 2, sourceWidth - 1);
+                const auto x1 = std::min(x * 2 + 1, sourceWidth - 1);
+                result[x] = (row0[x0] + row0[x1] + row1[x0] + row1[x1]) * 0.25F;
+            }
         }
 
-    private:
         PixelFormat pixelFormat;
         std::size_t width = 0;
         std::size_t height = 0;
         bool mipMaps = false;
-        std::vector<std::vector<std::uint8_t>> levels;
+        Layout layout = Layout::linear;
+        std::size_t sampleCount = 1;
+        AlignedBuffer storage;
+        std::vector<std::size_t> levelOffsets; // of the levels in the storage
+        std::vector<DepthRange> tileDepthRanges;
+        std::vector<std::uint8_t> clearedTiles; // empty if no fast clear is pending
+        std::array<std::uint8_t, 4> clearPixel{};
         std::uint32_t minLOD = 0;
         std::uint32_t maxLOD = UINT_MAX;
         float lodBias = 0.0F;
+        std::uint64_t version = getNextVersion();
     };
 
-    inline void clear(Texture& renderTarget, const Color color)
+    // Block-compressed copy of an rgba8 texture with all of its levels, for converting assets offline. The
+    // encoder is simple and fast rather than of the best quality.
+    inline Texture compressTexture(const Texture& texture, const PixelFormat pixelFormat)
+    {
+        if (texture.getPixelFormat() != PixelFormat::rgba8)
+            throw std::runtime_error{"Only rgba8 textures can be compressed"};
+
+        Texture result{pixelFormat, texture.getWidth(), texture.getHeight(), texture.getLevelCount() > 1};
+
+        for (std::uint32_t level = 0; level < texture.getLevelCount(); ++level)
+            result.setData(encodeBlocks(pixelFormat, texture.getLinearData(level),
+                                        texture.getLevelWidth(level), texture.getLevelHeight(level)), level);
+
+        result.setMinLOD(texture.getMinLOD());
+        result.setMaxLOD(texture.getMaxLOD());
+        result.setLODBias(texture.getLODBias());
+        return result;
+    }
+
+    // records the clear value for the tiles of the render target instead of writing them, see Texture::fastClear
+    inline void fastClear(Texture& renderTarget, const Color color)
     {
         assert(renderTarget.getPixelFormat() == PixelFormat::rgba8);
 
-        const auto bufferData = reinterpret_cast<std::uint32_t*>(renderTarget.getData().data());
         const auto rgba = color.getIntValueRaw();
+        renderTarget.fastClear(&rgba);
+    }
+
+    // the bytes of a pixel of a depth format with the depth (and the stencil of d24s8)
+    inline std::array<std::uint8_t, 4> getDepthPixel(const PixelFormat pixelFormat, const float depth, const std::uint8_t stencil) noexcept
+    {
+        std::array<std::uint8_t, 4> pixel{};
+
+        const auto storedDepth = quantizeDepth(pixelFormat, depth);
+        if (pixelFormat == PixelFormat::depth16)
+        {
+            const auto value = static_cast<std::uint16_t>(storedDepth);
+            std::memcpy(pixel.data(), &value, sizeof(value));
+        }
+        else if (pixelFormat == PixelFormat::d24s8)
+        {
+            const auto value = static_cast<std::uint32_t>(storedDepth) |
+                (static_cast<std::uint32_t>(stencil) << (getStencilOffset(pixelFormat) * 8));
+            std::memcpy(pixel.data(), &value, sizeof(value));
+        }
+        else
+            std::memcpy(pixel.data(), &depth, sizeof(depth));
+
+        return pixel;
+    }
+
+    // the range of a tile that holds only the depth (NaN passes every depth test, like an unbounded range)
+    inline Texture::DepthRange getClearDepthRange(const PixelFormat pixelFormat, const float depth) noexcept
+    {
+        const auto storedDepth = quantizeDepth(pixelFormat, depth);
+        return std::isnan(storedDepth) ?
+            Texture::DepthRange{-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()} :
+            Texture::DepthRange{storedDepth, storedDepth};
+    }
+
+    // clears the stencil of d24s8 too
+    inline void fastClear(Texture& renderTarget, const float depth, const std::uint8_t stencil = 0)
+    {
+        const auto pixelFormat = renderTarget.getPixelFormat();
+        assert(isDepthFormat(pixelFormat));
+
+        const auto pixel = getDepthPixel(pixelFormat, depth, stencil);
+        renderTarget.fastClear(pixel.data());
+
+        // the tiles hold only the cleared depth from now on
+        auto& tileDepthRanges = renderTarget.getTileDepthRanges();
+        std::fill(tileDepthRanges.begin(), tileDepthRanges.end(), getClearDepthRange(pixelFormat, depth));
+    }
+
+    // the stencil of d24s8 is cleared together with its depth
+    inline void fastClearStencil(Texture& renderTarget, const std::uint8_t stencil)
+    {
+        assert(renderTarget.getPixelFormat() == PixelFormat::stencil8);
 
-        const auto bufferSize = renderTarget.getWidth() * renderTarget.getHeight();
-        for (std::size_t p = 0; p < bufferSize; ++p)
-            bufferData[p] = rgba;
+        renderTarget.fastClear(&stencil);
     }
 
-    inline void clear(Texture& renderTarget, const float depth)
+    // writes the clear value to all of the render target, also to the padding of tiled textures
+    inline void clear(Texture& renderTarget, const Color color)
     {
-        assert(renderTarget.getPixelFormat() == PixelFormat::float32);
+        fastClear(renderTarget, color);
+        renderTarget.resolveClear();
+    }
 
-        const auto bufferData = reinterpret_cast<float*>(renderTarget.getData().data());
+    inline void clear(Texture& renderTarget, const float depth, const std::uint8_t stencil = 0)
+    {
+        fastClear(renderTarget, depth, stencil);
+        renderTarget.resolveClear();
+    }
 
-        const auto bufferSize = renderTarget.getWidth() * renderTarget.getHeight();
-        for (std::size_t p = 0; p < bufferSize; ++p)
-            bufferData[p] = depth;
+    inline void clearStencil(Texture& renderTarget, const std::uint8_t stencil)
+    {
+        fastClearStencil(renderTarget, stencil);
+        renderTarget.resolveClear();
     }
 }
 
@@ -0,0 +1,208 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_THREADPOOL_HPP
+#define SR_THREADPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace sr
+{
+    class ThreadPool final
+    {
+    public:
+        explicit ThreadPool(const std::size_t initThreadCount = std::thread::hardware_concurrency())
+        {
+            start(initThreadCount);
+        }
+
+        ~ThreadPool()
+        {
+            stop();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ThreadPool(ThreadPool&&) = delete;
+        ThreadPool& operator=(ThreadPool&&) = delete;
+
+        // number of threads that execute jobs, including the calling thread
+        std::size_t getThreadCount() const noexcept
+        {
+            return workers.size() + 1;
+        }
+
+        void setThreadCount(const std::size_t newThreadCount)
+        {
+            std::lock_guard submitLock{submitMutex};
+            stop();
+            start(newThreadCount);
+        }
+
+        // calls function(index, threadIndex) for every index in [0, count)
+        // threadIndex is in [0, getThreadCount()) and can be used to address per-thread data
+        template <class Function>
+        void parallelFor(const std::size_t count, Function&& function)
+        {
+            if (count == 0) return;
+
+            // nested calls run on the calling thread
+            if (isInsideJob())
+            {
+                for (std::size_t index = 0; index < count; ++index)
+                    function(index, std::size_t(0));
+                return;
+            }
+
+            std::lock_guard submitLock{submitMutex};
+
+            Job job;
+            job.context = &function;
+            job.run = [](void* context, std::size_t index, std::size_t threadIndex) {
+                (*static_cast<std::remove_reference_t<Function>*>(context))(index, threadIndex);
+            };
+            job.count = count;
+
+            const bool parallel = !workers.empty() && count > 1;
+
+            if (parallel)
+            {
+                {
+                    std::lock_guard lock{mutex};
+                    currentJob = &job;
+                    pendingWorkers = workers.size();
+                    ++generation;
+                }
+                startCondition.notify_all();
+            }
+
+            isInsideJob() = true;
+            execute(job, 0);
+            isInsideJob() = false;
+
+            if (parallel)
+            {
+                std::unique_lock lock{mutex};
+                finishCondition.wait(lock, [this]() noexcept { return pendingWorkers == 0; });
+                currentJob = nullptr;
+            }
+
+            if (job.exception) std::rethrow_exception(job.exception);
+        }
+
+    private:
+        struct Job final
+        {
+            void* context = nullptr;
+            void (*run)(void* context, std::size_t index, std::size_t threadIndex) = nullptr;
+            std::size_t count = 0;
+            std::atomic<std::size_t> next{0};
+            std::atomic<bool> failed{false};
+            std::exception_ptr exception;
+            std::mutex exceptionMutex;
+        };
+
+        static bool& isInsideJob() noexcept
+        {
+            static thread_local bool insideJob = false;
+            return insideJob;
+        }
+
+        static void execute(Job& job, const std::size_t threadIndex)
+        {
+            for (;;)
+            {
+                const auto index = job.next.fetch_add(1, std::memory_order_relaxed);
+                if (index >= job.count || job.failed.load(std::memory_order_relaxed)) break;
+
+                try
+                {
+                    job.run(job.context, index, threadIndex);
+                }
+                catch (...)
+                {
+                    std::lock_guard lock{job.exceptionMutex};
+                    if (!job.exception) job.exception = std::current_exception();
+                    job.failed = true;
+                }
+            }
+        }
+
+        void start(const std::size_t threadCount)
+        {
+            running = true;
+
+            for (std::size_t i = 1; i < std::max(threadCount, std::size_t(1)); ++i)
+                workers.emplace_back(&ThreadPool::work, this, i, generation);
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard lock{mutex};
+                running = false;
+            }
+            startCondition.notify_all();
+
+            for (auto& worker : workers)
+                worker.join();
+
+            workers.clear();
+        }
+
+        void work(const std::size_t threadIndex, std::size_t lastGeneration)
+        {
+            isInsideJob() = true;
+
+            for (;;)
+            {
+                std::unique_lock lock{mutex};
+                startCondition.wait(lock, [this, lastGeneration]() noexcept {
+                    return !running || generation != lastGeneration;
+                });
+
+                if (!running) break;
+
+                lastGeneration = generation;
+                auto job = currentJob;
+                lock.unlock();
+
+                execute(*job, threadIndex);
+
+                lock.lock();
+                if (--pendingWorkers == 0)
+                {
+                    lock.unlock();
+                    finishCondition.notify_one();
+                }
+            }
+        }
+
+        std::vector<std::thread> workers;
+        std::mutex submitMutex;
+        std::mutex mutex;
+        std::condition_variable startCondition;
+        std::condition_variable finishCondition;
+        Job* currentJob = nullptr;
+        std::size_t pendingWorkers = 0;
+        std::size_t generation = 0;
+        bool running = false;
+    };
+
+    inline ThreadPool& getThreadPool()
+    {
+        static ThreadPool threadPool;
+        return threadPool;
+    }
+}
+
+#endif
@@ -0,0 +1,274 @@
+//
+//  SoftwareRenderer
+//
+
+#ifndef SR_TRIANGLESETUP_HPP
+#define SR_TRIANGLESETUP_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include "RasterizerState.hpp"
+#include "Rect.hpp"
+#include "RenderError.hpp"
+#include "Shader.hpp"
+#include "Vector.hpp"
+
+namespace sr
+{
+    // Positions of the samples of multisampled render targets in 1/16 of a pixel from its center: the standard
+    // rotated grid of 4 samples, so that near-horizontal and near-vertical edges get 4 levels of coverage.
+    // Single-sampled render targets have a single sample at the center.
+    constexpr std::size_t maxSampleCount = 4;
+    inline constexpr std::array<std::array<std::int32_t, 2>, maxSampleCount> samplePositions{{
+        {-2, -6}, {6, -2}, {-6, 2}, {2, 6}
+    }};
+    constexpr std::int64_t maxSampleOffset = 6;
+
+    constexpr std::array<std::int32_t, 2> getSamplePosition(const std::size_t sampleCount,
+                                                            const std::size_t sample) noexcept
+    {
+        return sampleCount == 1 ? std::array<std::int32_t, 2>{0, 0} : samplePositions[sample];
+    }
+
+    // A value that is linear in screen space, given by its values at the vertices and its increments per pixel.
+    // It is evaluated at the origin of every block from the exact edge functions and stepped to the pixels from there.
+    struct Plane final
+    {
+        std::array<float, 3> vertexValues;
+        float stepX = 0.0F;
+        float stepY = 0.0F;
+    };
+
+    // a triangle whose varyings have the given number of components
+    template <std::size_t componentCount>
+    struct TriangleSetup final
+    {
+        // the depth is linear in screen space, the components of the varyings are divided by w to make them linear,
+        // so that every pixel needs only one reciprocal of the interpolated 1/w to get them back
+        Plane depthPlane;
+        Plane inverseWPlane;
+        std::array<Plane, componentCount> planes;
+
+        // fixed-point edge functions evaluated at the center of the pixel (0, 0) and their increments per pixel
+        // the edge i is opposite to the vertex i, so its value is proportional to the barycentric weight of the vertex
+        std::array<std::int64_t, 3> edgeOrigins;
+        std::array<std::int64_t, 3> edgeStepsX;
+        std::array<std::int64_t, 3> edgeStepsY;
+
+        // smallest edge function value that is inside the triangle (0 for top and left edges, 1 for the rest)
+        std::array<std::int64_t, 3> edgeThresholds;
+
+        // range of the vertex depths, the interpolated depths are clamped to it
+        float minDepth = 0.0F;
+        float maxDepth = 0.0F;
+
+        float inverseArea = 0.0F;
+        std::size_t minX = 0;
+        std::size_t minY = 0;
+        std::size_t maxX = 0;
+        std::size_t maxY = 0;
+        bool visible = false;
+    };
+
+    inline float getPlaneValue(const Plane& plane, const std::array<float, 3>& barycentrics) noexcept
+    {
+        return plane.vertexValues[0] * barycentrics[0] +
+            plane.vertexValues[1] * barycentrics[1] +
+            plane.vertexValues[2] * barycentrics[2];
+    }
+
+    inline void setPlaneSteps(Plane& plane,
+                              const std::array<float, 3>& barycentricStepsX,
+                              const std::array<float, 3>& barycentricStepsY) noexcept
+    {
+        plane.stepX = getPlaneValue(plane, barycentricStepsX);
+        plane.stepY = getPlaneValue(plane, barycentricStepsY);
+    }
+
+    template <class T>
+    void setupTriangle(TriangleSetup<Varyings<T>::componentCount>& triangle,
+                       const std::array<T, 3>& vsOutputs,
+                       const Rect<float>& viewport,
+                       const Rect<std::size_t>& scissor,
+                       const RasterizerState& rasterizerState,
+                       const std::size_t sampleCount)
+    {
+        const auto subpixelBits = rasterizerState.subpixelBits;
+
+        triangle.visible = false;
+
+        std::array<Vector<float, 2>, 3> viewportPositions;
+        auto& depths = triangle.depthPlane.vertexValues;
+
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            // transform to normalized device coordinates
+            const auto ndcPosition = vsOutputs[i].position / vsOutputs[i].position.v[3];
+
+            // transform to viewport coordinates
+            viewportPositions[i].v[0] = ndcPosition.v[0] * viewport.size.v[0] / 2.0F + viewport.position.v[0] + viewport.size.v[0] / 2.0F; // xndc * width / 2 + x + width / 2
+            viewportPositions[i].v[1] = ndcPosition.v[1] * viewport.size.v[1] / 2.0F + viewport.position.v[1] + viewport.size.v[1] / 2.0F;  // yndc * height / 2 + y + height / 2
+            //viewportPosition.v[2] = viewportPosition.v[2] * (1.0F - 0.0F) / 2.0F + (1.0F + 0.0F) / 2.0F; // zndc * (far - near) / 2 + (far + near) / 2
+
+            depths[i] = ndcPosition.v[2];
+
+            const auto inverseW = 1.0F / vsOutputs[i].position.v[3];
+            triangle.inverseWPlane.vertexValues[i] = inverseW;
+
+            const auto components = Varyings<T>::getComponents(vsOutputs[i]);
+            for (std::size_t component = 0; component < components.size(); ++component)
+                triangle.planes[component].vertexValues[i] = components[component] * inverseW;
+        }
+
+        if (std::isnan(depths[0]) || std::isnan(depths[1]) || std::isnan(depths[2]))
+        {
+            triangle.minDepth = -std::numeric_limits<float>::infinity();
+            triangle.maxDepth = std::numeric_limits<float>::infinity();
+        }
+        else
+        {
+            triangle.minDepth = std::min({depths[0], depths[1], depths[2]});
+            triangle.maxDepth = std::max({depths[0], depths[1], depths[2]});
+        }
+
+        // the edge functions of positions that are further away do not fit in 64 bits (this also rejects NaNs)
+        const auto maxCoordinate = static_cast<float>(std::int64_t(1) << (29 - subpixelBits));
+        for (const auto& viewportPosition : viewportPositions)
+            if (!(std::fabs(viewportPosition.v[0]) < maxCoordinate) ||
+                !(std::fabs(viewportPosition.v[1]) < maxCoordinate))
+                return;
+
+        const auto one = std::int64_t(1) << subpixelBits;
+        const auto half = one >> 1;
+
+        // snap the vertices to the subpixel grid
+        std::array<std::array<std::int64_t, 2>, 3> positions;
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            positions[i][0] = std::llround(viewportPositions[i].v[0] * static_cast<float>(one));
+            positions[i][1] = std::llround(viewportPositions[i].v[1] * static_cast<float>(one));
+        }
+
+        auto area = (positions[1][0] - positions[0][0]) * (positions[2][1] - positions[0][1]) -
+            (positions[1][1] - positions[0][1]) * (positions[2][0] - positions[0][0]);
+
+        // reject degenerate triangles before anything is divided by their area
+        if (area == 0) return;
+
+        const auto counterClockwise = area > 0;
+        const auto frontFacing = counterClockwise == (rasterizerState.frontFace == RasterizerState::FrontFace::counterClockwise);
+
+        switch (rasterizerState.cullMode)
+        {
+            case RasterizerState::CullMode::none:
+                break;
+            case RasterizerState::CullMode::front:
+                if (frontFacing) return;
+                break;
+            case RasterizerState::CullMode::back:
+                if (!frontFacing) return;
+                break;
+            default:
+                throw RenderError{"Invalid cull mode"};
+        }
+
+        // make the winding of all triangles the same, so that the insides of the edges are positive
+        if (area < 0)
+        {
+            std::swap(positions[1], positions[2]);
+            std::swap(triangle.depthPlane.vertexValues[1], triangle.depthPlane.vertexValues[2]);
+            std::swap(triangle.inverseWPlane.vertexValues[1], triangle.inverseWPlane.vertexValues[2]);
+            for (auto& plane : triangle.planes)
+                std::swap(plane.vertexValues[1], plane.vertexValues[2]);
+            area = -area;
+        }
+
+        // pixels whose centers (or samples) are inside of the bounding box
+        const auto sampleExtent = sampleCount > 1 ? maxSampleOffset * (one / 16) : 0;
+        const auto minPositionX = std::min({positions[0][0], positions[1][0], positions[2][0]}) - sampleExtent;
+        const auto maxPositionX = std::max({positions[0][0], positions[1][0], positions[2][0]}) + sampleExtent;
+        const auto minPositionY = std::min({positions[0][1], positions[1][1], positions[2][1]}) - sampleExtent;
+        const auto maxPositionY = std::max({positions[0][1], positions[1][1], positions[2][1]}) + sampleExtent;
+
+        const auto minX = std::max(-((half - minPositionX) >> subpixelBits), static_cast<std::int64_t>(scissor.position.v[0]));
+        const auto maxX = std::min((maxPositionX - half) >> subpixelBits, static_cast<std::int64_t>(scissor.position.v[0] + scissor.size.v[0]));
+        const auto minY = std::max(-((half - minPositionY) >> subpixelBits), static_cast<std::int64_t>(scissor.position.v[1]));
+        const auto maxY = std::min((maxPositionY - half) >> subpixelBits, static_cast<std::int64_t>(scissor.position.v[1] + scissor.size.v[1]));
+
+        if (minX > maxX || minY > maxY) return;
+
+        triangle.minX = static_cast<std::size_t>(minX);
+        triangle.maxX = static_cast<std::size_t>(maxX);
+        triangle.minY = static_cast<std::size_t>(minY);
+        triangle.maxY = static_cast<std::size_t>(maxY);
+
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            const auto& start = positions[(i + 1) % 3];
+            const auto& end = positions[(i + 2) % 3];
+            const auto deltaX = end[0] - start[0];
+            const auto deltaY = end[1] - start[1];
+
+            // E(x, y) = deltaX * (y - startY) - deltaY * (x - startX)
+            triangle.edgeOrigins[i] = deltaX * (half - start[1]) - deltaY * (half - start[0]);
+            triangle.edgeStepsX[i] = -deltaY * one;
+            triangle.edgeStepsY[i] = deltaX * one;
+
+            // top-left rule: pixel centers exactly on an edge belong to the triangle only if it is a top or a left edge
+            const auto topLeft = deltaY < 0 || (deltaY == 0 && deltaX > 0);
+            triangle.edgeThresholds[i] = topLeft ? 0 : 1;
+        }
+
+        triangle.inverseArea = 1.0F / static_cast<float>(area);
+
+        // increments of the barycentric coordinates per pixel
+        std::array<float, 3> barycentricStepsX;
+        std::array<float, 3> barycentricStepsY;
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            barycentricStepsX[i] = static_cast<float>(triangle.edgeStepsX[i]) * triangle.inverseArea;
+            barycentricStepsY[i] = static_cast<float>(triangle.edgeStepsY[i]) * triangle.inverseArea;
+        }
+
+        setPlaneSteps(triangle.depthPlane, barycentricStepsX, barycentricStepsY);
+        setPlaneSteps(triangle.inverseWPlane, barycentricStepsX, barycentricStepsY);
+        for (auto& plane : triangle.planes)
+            setPlaneSteps(plane, barycentricStepsX, barycentricStepsY);
+
+        triangle.visible = true;
+    }
+
+    template <std::size_t componentCount>
+    std::array<std::int64_t, 3> getEdges(const TriangleSetup<componentCount>& triangle,
+                                         const std::size_t x,
+                                         const std::size_t y) noexcept
+    {
+        return {
+            triangle.edgeOrigins[0] + triangle.edgeStepsX[0] * static_cast<std::int64_t>(x) + triangle.edgeStepsY[0] * static_cast<std::int64_t>(y),
+            triangle.edgeOrigins[1] + triangle.edgeStepsX[1] * static_cast<std::int64_t>(x) + triangle.edgeStepsY[1] * static_cast<std::int64_t>(y),
+            triangle.edgeOrigins[2] + triangle.edgeStepsX[2] * static_cast<std::int64_t>(x) + triangle.edgeStepsY[2] * static_cast<std::int64_t>(y)
+        };
+    }
+
+    // The edge functions at a sample of the pixel whose edge functions are given. The steps per pixel are
+    // multiples of 16 with at least 4 subpixel bits, so the sample positions are exact.
+    template <std::size_t componentCount>
+    std::array<std::int64_t, 3> getSampleEdges(const TriangleSetup<componentCount>& triangle,
+                                               const std::array<std::int64_t, 3>& edges,
+                                               const std::size_t sampleCount,
+                                               const std::size_t sample) noexcept
+    {
+        const auto position = getSamplePosition(sampleCount, sample);
+        return {
+            edges[0] + triangle.edgeStepsX[0] / 16 * position[0] + triangle.edgeStepsY[0] / 16 * position[1],
+            edges[1] + triangle.edgeStepsX[1] / 16 * position[0] + triangle.edgeStepsY[1] / 16 * position[1],
+            edges[2] + triangle.edgeStepsX[2] / 16 * position[0] + triangle.edgeStepsY[2] / 16 * position[1]
+        };
+    }
+}
+
+#endif
@@ -5,17 +5,30 @@
 #ifndef SR_HPP
 #define SR_HPP
 
+#include "AlignedBuffer.hpp"
 #include "BlendState.hpp"
+#include "BlockCompression.hpp"
+#include "Clipping.hpp"
 #include "Color.hpp"
+#include "CommandBuffer.hpp"
 #include "Constants.hpp"
 #include "DepthState.hpp"
 #include "Matrix.hpp"
+#include "PixelKernels.hpp"
+#include "RasterizerState.hpp"
 #include "Rect.hpp"
+#include "RenderPass.hpp"
 #include "Renderer.hpp"
 #include "Sampler.hpp"
+#include "SamplerBinding.hpp"
 #include "Shader.hpp"
+#include "Simd.hpp"
 #include "Size.hpp"
+#include "Statistics.hpp"
+#include "StencilState.hpp"
 #include "Texture.hpp"
+#include "ThreadPool.hpp"
+#include "TriangleSetup.hpp"
 #include "Vector.hpp"
 #include "Vertex.hpp"
 
@@ -1,8 +1,1807 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
 #include <vector>
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include "catch2/catch.hpp"
 #include "sr.hpp"
 
-TEST_CASE("Test", "[test]")
+namespace
 {
+    // varyings of a flat-colored pass, only the color is interpolated
+    struct ColorVaryings final
+    {
+        sr::Vector<float, 4> position;
+        sr::Color color;
+    };
+}
+
+namespace sr
+{
+    template <>
+    struct Varyings<ColorVaryings> final
+    {
+        static constexpr std::size_t componentCount = 4;
+
+        static std::array<float, componentCount> getComponents(const ColorVaryings& output) noexcept
+        {
+            return {output.color.r, output.color.g, output.color.b, output.color.a};
+        }
+
+        static void setComponents(ColorVaryings& output, const std::array<float, componentCount>& components) noexcept
+        {
+            output.color = Color{components[0], components[1], components[2], components[3]};
+        }
+    };
+}
+
+namespace
+{
+    sr::VertexShaderOutput vertexShader(const sr::Matrix<float, 4>& modelViewProjection,
+                                        const sr::Vertex& vertex)
+    {
+        sr::VertexShaderOutput result;
+        result.position = modelViewProjection * vertex.position;
+        result.color = vertex.color;
+        result.texCoords[0] = vertex.texCoords[0];
+        result.texCoords[1] = vertex.texCoords[1];
+        result.normal = vertex.normal;
+        return result;
+    }
+
+    sr::Color fragmentShader(const sr::VertexShaderOutput& input,
+                             const std::array<const sr::Sampler*, 2>&,
+                             const std::array<const sr::Texture*, 2>&)
+    {
+        return input.color;
+    }
+
+    sr::BlendState getAlphaBlendState()
+    {
+        sr::BlendState blendState;
+        blendState.colorBlendSource = sr::BlendState::Factor::srcAlpha;
+        blendState.colorBlendDest = sr::BlendState::Factor::invSrcAlpha;
+        blendState.alphaBlendSource = sr::BlendState::Factor::one;
+        blendState.alphaBlendDest = sr::BlendState::Factor::one;
+        blendState.enabled = true;
+        return blendState;
+    }
+
+    sr::DepthState getDepthState(const bool read, const bool write)
+    {
+        sr::DepthState depthState;
+        depthState.read = read;
+        depthState.write = write;
+        return depthState;
+    }
+
+    // overlapping semi-transparent triangles, so that the result depends on the blend order
+    void getScene(std::vector<sr::Vertex>& vertices, std::vector<std::size_t>& indices)
+    {
+        std::uint32_t seed = 1;
+        const auto random = [&seed]() {
+            seed = seed * 1664525U + 1013904223U;
+            return static_cast<float>(seed >> 8) / static_cast<float>(1U << 24);
+        };
+
+        for (std::size_t i = 0; i < 600; ++i)
+        {
+            const sr::Color color{random(), random(), random(), 0.5F};
+            const auto z = random();
+
+            for (std::size_t v = 0; v < 3; ++v)
+            {
+                // w varies, so that the values are interpolated with perspective correction
+                const auto w = 0.5F + random() * 1.5F;
+                indices.push_back(vertices.size());
+                vertices.push_back(sr::Vertex{sr::Vector<float, 4>{(random() * 2.4F - 1.2F) * w, (random() * 2.4F - 1.2F) * w, z * w, w},
+                                              color,
+                                              sr::Vector<float, 2>{},
+                                              sr::Vector<float, 3>{}});
+            }
+        }
+    }
+
+    void renderScene(sr::Texture& frameBuffer,
+                     sr::Texture& depthBuffer,
+                     const sr::BlendState& blendState = getAlphaBlendState(),
+                     const sr::DepthState& depthState = getDepthState(true, false))
+    {
+        std::vector<sr::Vertex> vertices;
+        std::vector<std::size_t> indices;
+        getScene(vertices, indices);
+
+        clear(frameBuffer, sr::Color{255, 255, 255, 255});
+        clear(depthBuffer, 0.75F);
+
+        sr::drawTriangles(frameBuffer,
+                          depthBuffer,
+                          vertexShader,
+                          fragmentShader,
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          sr::Rect<float>{0.0F, 0.0F,
+                                          static_cast<float>(frameBuffer.getWidth()),
+                                          static_cast<float>(frameBuffer.getHeight())},
+                          sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                          blendState,
+                          depthState,
+                          sr::RasterizerState{},
+                          indices,
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+    }
+    // draws the triangles given in clip space with a single color and without blending
+    void drawTriangles(sr::Texture& frameBuffer,
+                       const std::vector<sr::Vector<float, 4>>& positions,
+                       const sr::Color& color,
+                       const sr::RasterizerState& rasterizerState = sr::RasterizerState{})
+    {
+        sr::Texture depthBuffer{sr::PixelFormat::float32, frameBuffer.getWidth(), frameBuffer.getHeight()};
+        clear(depthBuffer, 1.0F);
+
+        std::vector<sr::Vertex> vertices;
+        std::vector<std::size_t> indices;
+        for (const auto& position : positions)
+        {
+            indices.push_back(vertices.size());
+            vertices.push_back(sr::Vertex{position, color, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}});
+        }
+
+        sr::drawTriangles(frameBuffer,
+                          depthBuffer,
+                          vertexShader,
+                          fragmentShader,
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          sr::Rect<float>{0.0F, 0.0F,
+                                          static_cast<float>(frameBuffer.getWidth()),
+                                          static_cast<float>(frameBuffer.getHeight())},
+                          sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                          sr::BlendState{},
+                          sr::DepthState{},
+                          rasterizerState,
+                          indices,
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+    }
+}
+
+TEST_CASE("Tiled rendering matches serial rendering", "[renderer]")
+{
+    sr::Texture serialFrameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture serialDepthBuffer{sr::PixelFormat::float32, 301, 217};
+    sr::Texture parallelFrameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture parallelDepthBuffer{sr::PixelFormat::float32, 301, 217};
+
+    auto& threadPool = sr::getThreadPool();
+    const auto threadCount = threadPool.getThreadCount();
+
+    threadPool.setThreadCount(1);
+    renderScene(serialFrameBuffer, serialDepthBuffer);
+
+    threadPool.setThreadCount(8);
+    renderScene(parallelFrameBuffer, parallelDepthBuffer);
+
+    threadPool.setThreadCount(threadCount);
+
+    REQUIRE(serialFrameBuffer.getData() == parallelFrameBuffer.getData());
+    REQUIRE(serialDepthBuffer.getData() == parallelDepthBuffer.getData());
+
+    // the reference draws every triangle on its own, so no binning can reorder them
+    std::vector<sr::Vertex> vertices;
+    std::vector<std::size_t> indices;
+    getScene(vertices, indices);
+
+    sr::Texture referenceFrameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture referenceDepthBuffer{sr::PixelFormat::float32, 301, 217};
+    clear(referenceFrameBuffer, sr::Color{255, 255, 255, 255});
+    clear(referenceDepthBuffer, 0.75F);
+
+    for (std::size_t i = 0; i < indices.size(); i += 3)
+        sr::drawTriangles(referenceFrameBuffer,
+                          referenceDepthBuffer,
+                          vertexShader,
+                          fragmentShader,
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          sr::Rect<float>{0.0F, 0.0F, 301.0F, 217.0F},
+                          sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                          getAlphaBlendState(),
+                          getDepthState(true, false),
+                          sr::RasterizerState{},
+                          {indices[i], indices[i + 1], indices[i + 2]},
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+
+    REQUIRE(parallelFrameBuffer.getData() == referenceFrameBuffer.getData());
+    REQUIRE(parallelDepthBuffer.getData() == referenceDepthBuffer.getData());
+}
+
+TEST_CASE("Thread pool propagates exceptions", "[threadpool]")
+{
+    sr::ThreadPool threadPool{4};
+    std::vector<int> visited(100);
+
+    threadPool.parallelFor(visited.size(), [&visited](const std::size_t index, std::size_t) {
+        ++visited[index];
+    });
+
+    REQUIRE(std::count(visited.begin(), visited.end(), 1) == 100);
+
+    REQUIRE_THROWS_AS(threadPool.parallelFor(100, [](const std::size_t index, std::size_t) {
+        if (index == 42) throw sr::RenderError{"Test"};
+    }), sr::RenderError);
+}
+
+TEST_CASE("Shared edges are rasterized once", "[renderer]")
+{
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 64, 64};
+    sr::Texture depthBuffer{sr::PixelFormat::float32, 64, 64};
+
+    // a fan of triangles that covers the whole viewport, all of its edges go through pixel centers
+    const sr::Color color{0.25F, 0.25F, 0.25F, 0.25F};
+    const sr::Vector<float, 2> center{20.5F, 30.5F};
+    const std::array<sr::Vector<float, 2>, 8> directions{
+        sr::Vector<float, 2>{-1.0F, -1.0F}, sr::Vector<float, 2>{0.0F, -1.0F},
+        sr::Vector<float, 2>{1.0F, -2.0F}, sr::Vector<float, 2>{1.0F, 0.0F},
+        sr::Vector<float, 2>{1.0F, 1.0F}, sr::Vector<float, 2>{0.0F, 1.0F},
+        sr::Vector<float, 2>{-2.0F, 1.0F}, sr::Vector<float, 2>{-1.0F, 0.0F}
+    };
+
+    const auto toNdc = [](const sr::Vector<float, 2>& position) {
+        return sr::Vector<float, 4>{position.v[0] / 32.0F - 1.0F, position.v[1] / 32.0F - 1.0F, 0.0F, 1.0F};
+    };
+
+    std::vector<sr::Vertex> vertices;
+    std::vector<std::size_t> indices;
+    vertices.push_back(sr::Vertex{toNdc(center), color, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}});
+    for (const auto& direction : directions)
+        vertices.push_back(sr::Vertex{toNdc(center + direction * 48.0F), color, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}});
+
+    for (std::size_t i = 0; i < directions.size(); ++i)
+    {
+        indices.push_back(0);
+        indices.push_back(1 + i);
+        indices.push_back(1 + (i + 1) % directions.size());
+    }
+
+    sr::BlendState blendState;
+    blendState.colorBlendSource = sr::BlendState::Factor::one;
+    blendState.colorBlendDest = sr::BlendState::Factor::one;
+    blendState.alphaBlendSource = sr::BlendState::Factor::one;
+    blendState.alphaBlendDest = sr::BlendState::Factor::one;
+    blendState.enabled = true;
+
+    clear(frameBuffer, sr::Color{0, 0, 0, 0});
+    clear(depthBuffer, 1.0F);
+
+    auto& statistics = sr::getStatistics();
+    statistics.reset();
+
+    sr::drawTriangles(frameBuffer,
+                      depthBuffer,
+                      vertexShader,
+                      fragmentShader,
+                      {nullptr, nullptr},
+                      {nullptr, nullptr},
+                      sr::Rect<float>{0.0F, 0.0F, 64.0F, 64.0F},
+                      sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                      blendState,
+                      sr::DepthState{},
+                      sr::RasterizerState{},
+                      indices,
+                      vertices,
+                      sr::Matrix<float, 4>::identity());
+
+    const auto expected = color.getIntValueRaw();
+    const auto data = reinterpret_cast<const std::uint32_t*>(frameBuffer.getData().data());
+
+    for (std::size_t i = 0; i < frameBuffer.getWidth() * frameBuffer.getHeight(); ++i)
+        REQUIRE(data[i] == expected);
+
+    REQUIRE(statistics.blocks8x8.accepted > 0);
+    REQUIRE(statistics.blocks8x8.rejected > 0);
+    REQUIRE(statistics.blocks8x8.partial > 0);
+    REQUIRE(statistics.blocks4x4.partial > 0);
+}
+
+TEST_CASE("SIMD pixel kernels match the scalar kernel", "[renderer]")
+{
+    const auto simdWidth = sr::getSimdWidth();
+
+    // a specialized blend mode, the generic path (min is not specialized) and no blending
+    auto genericBlendState = getAlphaBlendState();
+    genericBlendState.colorOperation = sr::BlendState::Operation::min;
+
+    const std::vector<std::pair<sr::BlendState, sr::DepthState>> states{
+        {getAlphaBlendState(), getDepthState(true, false)},
+        {genericBlendState, getDepthState(true, true)},
+        {sr::BlendState{}, getDepthState(false, true)}
+    };
+
+    for (const auto depthFormat : {sr::PixelFormat::float32, sr::PixelFormat::depth16, sr::PixelFormat::d24s8})
+        for (const auto& [blendState, depthState] : states)
+        {
+            sr::Texture scalarFrameBuffer{sr::PixelFormat::rgba8, 301, 217};
+            sr::Texture scalarDepthBuffer{depthFormat, 301, 217};
+
+            sr::setSimdWidth(sr::SimdWidth::scalar);
+            renderScene(scalarFrameBuffer, scalarDepthBuffer, blendState, depthState);
+
+            for (const auto width : {sr::SimdWidth::sse41, sr::SimdWidth::avx2, sr::SimdWidth::avx512})
+            {
+                sr::Texture frameBuffer{sr::PixelFormat::rgba8, 301, 217};
+                sr::Texture depthBuffer{depthFormat, 301, 217};
+
+                sr::setSimdWidth(width);
+                renderScene(frameBuffer, depthBuffer, blendState, depthState);
+
+                REQUIRE(frameBuffer.getData() == scalarFrameBuffer.getData());
+                REQUIRE(depthBuffer.getData() == scalarDepthBuffer.getData());
+            }
+        }
+
+    sr::setSimdWidth(simdWidth);
+}
+
+TEST_CASE("Triangles are clipped against the near plane", "[renderer]")
+{
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 32, 32};
+    clear(frameBuffer, sr::Color{0, 0, 0, 0});
+
+    // a full-screen quad whose upper half is in front of the near plane
+    const sr::Color color{1.0F, 0.0F, 0.0F, 1.0F};
+    drawTriangles(frameBuffer, {
+        sr::Vector<float, 4>{-1.0F, -1.0F, 0.5F, 1.0F}, sr::Vector<float, 4>{1.0F, -1.0F, 0.5F, 1.0F}, sr::Vector<float, 4>{1.0F, 1.0F, -0.5F, 1.0F},
+        sr::Vector<float, 4>{-1.0F, -1.0F, 0.5F, 1.0F}, sr::Vector<float, 4>{1.0F, 1.0F, -0.5F, 1.0F}, sr::Vector<float, 4>{-1.0F, 1.0F, -0.5F, 1.0F}
+    }, color);
+
+    const auto data = reinterpret_cast<const std::uint32_t*>(frameBuffer.getData().data());
+
+    for (std::size_t y = 0; y < frameBuffer.getHeight(); ++y)
+        for (std::size_t x = 0; x < frameBuffer.getWidth(); ++x)
+            REQUIRE(data[y * frameBuffer.getWidth() + x] == (y < 16 ? color.getIntValueRaw() : 0U));
+}
+
+TEST_CASE("Triangles outside of the guard band are clipped", "[renderer]")
+{
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 32, 32};
+    clear(frameBuffer, sr::Color{0, 0, 0, 0});
+
+    // the vertices are too far away for the fixed-point edge functions
+    const sr::Color color{0.0F, 1.0F, 0.0F, 1.0F};
+    drawTriangles(frameBuffer, {
+        sr::Vector<float, 4>{-1.0F, -1.0F, 0.5F, 1.0F}, sr::Vector<float, 4>{1.0E6F, -1.0F, 0.5F, 1.0F}, sr::Vector<float, 4>{-1.0F, 1.0E6F, 0.5F, 1.0F}
+    }, color);
+
+    const auto data = reinterpret_cast<const std::uint32_t*>(frameBuffer.getData().data());
+
+    for (std::size_t i = 0; i < frameBuffer.getWidth() * frameBuffer.getHeight(); ++i)
+        REQUIRE(data[i] == color.getIntValueRaw());
+}
+
+TEST_CASE("Triangles are culled by their winding", "[renderer]")
+{
+    const std::vector<sr::Vector<float, 4>> counterClockwise{
+        sr::Vector<float, 4>{-1.0F, -1.0F, 0.5F, 1.0F}, sr::Vector<float, 4>{1.0F, -1.0F, 0.5F, 1.0F}, sr::Vector<float, 4>{-1.0F, 1.0F, 0.5F, 1.0F}
+    };
+    const std::vector<sr::Vector<float, 4>> clockwise{
+        counterClockwise[0], counterClockwise[2], counterClockwise[1]
+    };
+
+    const auto isDrawn = [](const std::vector<sr::Vector<float, 4>>& positions,
+                            const sr::RasterizerState::CullMode cullMode,
+                            const sr::RasterizerState::FrontFace frontFace) {
+        sr::Texture frameBuffer{sr::PixelFormat::rgba8, 8, 8};
+        clear(frameBuffer, sr::Color{0, 0, 0, 0});
+
+        sr::RasterizerState rasterizerState;
+        rasterizerState.cullMode = cullMode;
+        rasterizerState.frontFace = frontFace;
+
+        const sr::Color color{1.0F, 1.0F, 1.0F, 1.0F};
+        drawTriangles(frameBuffer, positions, color, rasterizerState);
+
+        return *reinterpret_cast<const std::uint32_t*>(frameBuffer.getData().data()) == color.getIntValueRaw();
+    };
+
+    using CullMode = sr::RasterizerState::CullMode;
+    using FrontFace = sr::RasterizerState::FrontFace;
+
+    REQUIRE(isDrawn(counterClockwise, CullMode::none, FrontFace::counterClockwise));
+    REQUIRE(isDrawn(clockwise, CullMode::none, FrontFace::counterClockwise));
+    REQUIRE(isDrawn(counterClockwise, CullMode::back, FrontFace::counterClockwise));
+    REQUIRE_FALSE(isDrawn(clockwise, CullMode::back, FrontFace::counterClockwise));
+    REQUIRE_FALSE(isDrawn(counterClockwise, CullMode::front, FrontFace::counterClockwise));
+    REQUIRE(isDrawn(clockwise, CullMode::front, FrontFace::counterClockwise));
+    REQUIRE_FALSE(isDrawn(counterClockwise, CullMode::back, FrontFace::clockwise));
+    REQUIRE(isDrawn(clockwise, CullMode::back, FrontFace::clockwise));
+}
+
+TEST_CASE("Shared vertices are shaded once", "[renderer]")
+{
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 8, 8};
+    sr::Texture depthBuffer{sr::PixelFormat::float32, 8, 8};
+
+    const std::vector<sr::Vertex> vertices{
+        sr::Vertex{sr::Vector<float, 4>{-1.0F, -1.0F, 0.5F, 1.0F}, sr::Color{}, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}},
+        sr::Vertex{sr::Vector<float, 4>{1.0F, -1.0F, 0.5F, 1.0F}, sr::Color{}, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}},
+        sr::Vertex{sr::Vector<float, 4>{1.0F, 1.0F, 0.5F, 1.0F}, sr::Color{}, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}},
+        sr::Vertex{sr::Vector<float, 4>{-1.0F, 1.0F, 0.5F, 1.0F}, sr::Color{}, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}}
+    };
+
+    const auto draw = [&](const std::vector<std::size_t>& indices) {
+        sr::drawTriangles(frameBuffer,
+                          depthBuffer,
+                          vertexShader,
+                          fragmentShader,
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          sr::Rect<float>{0.0F, 0.0F, 8.0F, 8.0F},
+                          sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                          sr::BlendState{},
+                          sr::DepthState{},
+                          sr::RasterizerState{},
+                          indices,
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+    };
+
+    auto& statistics = sr::getStatistics();
+    statistics.reset();
+
+    draw({0, 1, 2, 0, 2, 3});
+
+    REQUIRE(statistics.vertexCache.misses == 4);
+    REQUIRE(statistics.vertexCache.hits == 2);
+    REQUIRE(statistics.vertexCache.getHitRate() == Approx(2.0 / 6.0));
+
+    REQUIRE_THROWS_AS(draw({0, 1, 4}), sr::RenderError);
+}
+
+TEST_CASE("Hierarchical Z rejects occluded triangles", "[renderer]")
+{
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 128, 128};
+    sr::Texture depthBuffer{sr::PixelFormat::float32, 128, 128};
+
+    const auto drawQuad = [&](const float z, const sr::Color& color) {
+        std::vector<sr::Vertex> vertices;
+        for (const auto& position : {sr::Vector<float, 2>{-1.0F, -1.0F}, sr::Vector<float, 2>{1.0F, -1.0F},
+                                     sr::Vector<float, 2>{1.0F, 1.0F}, sr::Vector<float, 2>{-1.0F, 1.0F}})
+            vertices.push_back(sr::Vertex{sr::Vector<float, 4>{position.v[0], position.v[1], z, 1.0F}, color, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}});
+
+        sr::DepthState depthState;
+        depthState.read = true;
+        depthState.write = true;
+
+        sr::drawTriangles(frameBuffer,
+                          depthBuffer,
+                          vertexShader,
+                          fragmentShader,
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          sr::Rect<float>{0.0F, 0.0F, 128.0F, 128.0F},
+                          sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                          sr::BlendState{},
+                          depthState,
+                          sr::RasterizerState{},
+                          {0, 1, 2, 0, 2, 3},
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+    };
+
+    const auto isFilledWith = [&frameBuffer](const sr::Color& color) {
+        const auto data = reinterpret_cast<const std::uint32_t*>(frameBuffer.getData().data());
+        for (std::size_t i = 0; i < frameBuffer.getWidth() * frameBuffer.getHeight(); ++i)
+            if (data[i] != color.getIntValueRaw()) return false;
+        return true;
+    };
+
+    const sr::Color red{1.0F, 0.0F, 0.0F, 1.0F};
+    const sr::Color green{0.0F, 1.0F, 0.0F, 1.0F};
+    const sr::Color blue{0.0F, 0.0F, 1.0F, 1.0F};
+
+    clear(frameBuffer, sr::Color{0, 0, 0, 0});
+    clear(depthBuffer, 1.0F);
+
+    auto& statistics = sr::getStatistics();
+    statistics.reset();
+
+    // both triangles of every quad touch all of the 4 tiles
+    drawQuad(0.25F, red);
+    REQUIRE(statistics.hierarchicalZ.accepted == 8);
+    REQUIRE(isFilledWith(red));
+
+    drawQuad(0.5F, green);
+    REQUIRE(statistics.hierarchicalZ.rejected == 8);
+    REQUIRE(isFilledWith(red));
+
+    drawQuad(0.125F, blue);
+    REQUIRE(statistics.hierarchicalZ.accepted == 16);
+    REQUIRE(isFilledWith(blue));
+
+    // the farthest depths are only bounds after the depth test, they are read again when they could reject
+    drawQuad(0.1875F, green);
+    REQUIRE(statistics.hierarchicalZ.rejected == 16);
+    REQUIRE(isFilledWith(blue));
+
+    // the depth ranges follow the clears
+    clear(depthBuffer, 0.0F);
+    drawQuad(0.25F, red);
+    REQUIRE(statistics.hierarchicalZ.rejected == 24);
+    REQUIRE(isFilledWith(blue));
+
+    // and the depths written through the data
+    const auto data = depthBuffer.getData();
+    std::fill_n(reinterpret_cast<float*>(data.data()), 128 * 128, 1.0F);
+    drawQuad(0.5F, green);
+    REQUIRE(statistics.hierarchicalZ.rejected == 24);
+    REQUIRE(isFilledWith(green));
+}
+
+TEST_CASE("Packed depth formats store rounded depths", "[renderer]")
+{
+    const auto format = GENERATE(sr::PixelFormat::depth16, sr::PixelFormat::d24s8);
+
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 100, 80};
+    sr::Texture depthBuffer{format, 100, 80};
+    const auto pixelCount = depthBuffer.getWidth() * depthBuffer.getHeight();
+
+    const auto drawQuad = [&](const float z, const sr::Color& color) {
+        std::vector<sr::Vertex> vertices;
+        for (const auto& position : {sr::Vector<float, 2>{-1.0F, -1.0F}, sr::Vector<float, 2>{1.0F, -1.0F},
+                                     sr::Vector<float, 2>{1.0F, 1.0F}, sr::Vector<float, 2>{-1.0F, 1.0F}})
+            vertices.push_back(sr::Vertex{sr::Vector<float, 4>{position.v[0], position.v[1], z, 1.0F}, color, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}});
+
+        sr::drawTriangles(frameBuffer,
+                          depthBuffer,
+                          vertexShader,
+                          fragmentShader,
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          sr::Rect<float>{0.0F, 0.0F, 100.0F, 80.0F},
+                          sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                          sr::BlendState{},
+                          getDepthState(true, true),
+                          sr::RasterizerState{},
+                          {0, 1, 2, 0, 2, 3},
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+    };
+
+    const auto getStoredDepth = [&](const std::size_t i) {
+        const auto data = depthBuffer.getData();
+        return format == sr::PixelFormat::depth16 ?
+            static_cast<std::uint32_t>(reinterpret_cast<const std::uint16_t*>(data.data())[i]) :
+            reinterpret_cast<const std::uint32_t*>(data.data())[i] & 0x00FFFFFFU;
+    };
+
+    clear(frameBuffer, sr::Color{0, 0, 0, 0});
+    clear(depthBuffer, 1.0F);
+    REQUIRE(getStoredDepth(0) == sr::getDepthMax(format));
+
+    // the stencil of d24s8 is kept by the depth writes
+    if (format == sr::PixelFormat::d24s8)
+    {
+        auto data = depthBuffer.getData();
+        for (std::size_t i = 0; i < pixelCount; ++i) data[i * 4 + 3] = 0x5AU;
+        depthBuffer.resetTileDepthRanges();
+    }
+
+    const sr::Color red{1.0F, 0.0F, 0.0F, 1.0F};
+    const sr::Color green{0.0F, 1.0F, 0.0F, 1.0F};
+    drawQuad(0.25F, red);
+
+    // a depth that rounds to the same value passes the test
+    const auto depthStep = 1.0F / static_cast<float>(sr::getDepthMax(format));
+    drawQuad(0.25F + depthStep * 0.25F, green);
+
+    const auto expectedDepth = static_cast<std::uint32_t>(sr::quantizeDepth(format, 0.25F));
+    const auto frameBufferData = reinterpret_cast<const std::uint32_t*>(frameBuffer.getData().data());
+    for (std::size_t i = 0; i < pixelCount; ++i)
+    {
+        REQUIRE(frameBufferData[i] == green.getIntValueRaw());
+        REQUIRE(getStoredDepth(i) == expectedDepth);
+        if (format == sr::PixelFormat::d24s8)
+            REQUIRE(depthBuffer.getData()[i * 4 + 3] == 0x5AU);
+    }
+
+    REQUIRE(depthBuffer.getPixel(0, 0, 0).r == Approx(0.25F).margin(depthStep));
+
+    // a depth that rounds to a farther value fails it (one step is below the precision of a float for d24s8)
+    drawQuad(0.25F + depthStep * 2.0F, red);
+    REQUIRE(frameBufferData[0] == green.getIntValueRaw());
+}
+
+TEST_CASE("Stencil test masks pixels before fragment shading", "[renderer]")
+{
+    const auto format = GENERATE(sr::PixelFormat::stencil8, sr::PixelFormat::d24s8);
+    const auto simdWidth = sr::getSimdWidth();
+
+    for (const auto width : {sr::SimdWidth::scalar, sr::SimdWidth::sse41, sr::SimdWidth::avx2, sr::SimdWidth::avx512})
+    {
+        sr::setSimdWidth(width);
+
+        sr::Texture frameBuffer{sr::PixelFormat::rgba8, 100, 80};
+        sr::Texture depthBuffer{format == sr::PixelFormat::d24s8 ? sr::PixelFormat::d24s8 : sr::PixelFormat::float32, 100, 80};
+        sr::Texture stencilBuffer{sr::PixelFormat::stencil8, 100, 80};
+        auto& stencilTarget = format == sr::PixelFormat::d24s8 ? depthBuffer : stencilBuffer;
+
+        std::atomic<std::size_t> shadedPixels{0};
+        const auto countingFragmentShader = [&shadedPixels](const sr::VertexShaderOutput& input,
+                                                            const std::array<const sr::Sampler*, 2>&,
+                                                            const std::array<const sr::Texture*, 2>&) {
+            ++shadedPixels;
+            return input.color;
+        };
+
+        // a quad from minX to 1 in normalized device coordinates
+        const auto drawQuad = [&](const float minX, const float z, const sr::Color& color, const sr::StencilState& stencilState) {
+            std::vector<sr::Vertex> vertices;
+            for (const auto& position : {sr::Vector<float, 2>{minX, -1.0F}, sr::Vector<float, 2>{1.0F, -1.0F},
+                                         sr::Vector<float, 2>{1.0F, 1.0F}, sr::Vector<float, 2>{minX, 1.0F}})
+                vertices.push_back(sr::Vertex{sr::Vector<float, 4>{position.v[0], position.v[1], z, 1.0F}, color, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}});
+
+            shadedPixels = 0;
+            sr::drawTriangles(frameBuffer,
+                              depthBuffer,
+                              stencilTarget,
+                              vertexShader,
+                              countingFragmentShader,
+                              {nullptr, nullptr},
+                              {nullptr, nullptr},
+                              sr::Rect<float>{0.0F, 0.0F, 100.0F, 80.0F},
+                              sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                              sr::BlendState{},
+                              getDepthState(true, true),
+                              stencilState,
+                              sr::RasterizerState{},
+                              {0, 1, 2, 0, 2, 3},
+                              vertices,
+                              sr::Matrix<float, 4>::identity());
+        };
+
+        const auto getStencil = [&](const std::size_t x, const std::size_t y) {
+            const auto data = stencilTarget.getData();
+            return format == sr::PixelFormat::d24s8 ? data[(y * 100 + x) * 4 + 3] : data[y * 100 + x];
+        };
+
+        clear(frameBuffer, sr::Color{0, 0, 0, 0});
+        if (format == sr::PixelFormat::d24s8)
+            clear(depthBuffer, 1.0F, 0x80U);
+        else
+        {
+            clear(depthBuffer, 1.0F);
+            clearStencil(stencilBuffer, 0x80U);
+        }
+
+        const sr::Color red{1.0F, 0.0F, 0.0F, 1.0F};
+        const sr::Color green{0.0F, 1.0F, 0.0F, 1.0F};
+        const sr::Color blue{0.0F, 0.0F, 1.0F, 1.0F};
+
+        // the right half writes 1 into the low bits and keeps the high bit
+        sr::StencilState writeState;
+        writeState.enabled = true;
+        writeState.reference = 1;
+        writeState.writeMask = 0x7FU;
+        writeState.passOperation = sr::StencilState::Operation::replace;
+        drawQuad(0.0F, 0.5F, red, writeState);
+        REQUIRE(shadedPixels == 50 * 80);
+        REQUIRE(getStencil(0, 0) == 0x80U);
+        REQUIRE(getStencil(99, 79) == 0x81U);
+
+        // only the right half passes the test, the rest is never shaded
+        sr::StencilState maskState;
+        maskState.enabled = true;
+        maskState.reference = 1;
+        maskState.readMask = 0x7FU;
+        maskState.function = sr::StencilState::Function::equal;
+        maskState.failOperation = sr::StencilState::Operation::zero;
+        drawQuad(-1.0F, 0.25F, green, maskState);
+        REQUIRE(shadedPixels == 50 * 80);
+        REQUIRE(frameBuffer.getPixel(0, 0, 0).getIntValueRaw() == 0U);
+        REQUIRE(frameBuffer.getPixel(99, 79, 0).getIntValueRaw() == green.getIntValueRaw());
+        REQUIRE(getStencil(0, 0) == 0U);
+        REQUIRE(getStencil(99, 79) == 0x81U);
+
+        // the pixels behind the right half run the depth fail operation even if hierarchical Z could reject them
+        sr::StencilState depthFailState;
+        depthFailState.enabled = true;
+        depthFailState.depthFailOperation = sr::StencilState::Operation::incrementSaturate;
+        depthFailState.passOperation = sr::StencilState::Operation::invert;
+        drawQuad(-1.0F, 0.75F, blue, depthFailState);
+        REQUIRE(shadedPixels == 50 * 80);
+        REQUIRE(frameBuffer.getPixel(0, 0, 0).getIntValueRaw() == blue.getIntValueRaw());
+        REQUIRE(frameBuffer.getPixel(99, 79, 0).getIntValueRaw() == green.getIntValueRaw());
+        REQUIRE(getStencil(0, 0) == 0xFFU);
+        REQUIRE(getStencil(99, 79) == 0x82U);
+
+        // the depths of d24s8 are kept by the stencil writes
+        REQUIRE(depthBuffer.getPixel(0, 0, 0).r == Approx(0.75F).margin(0.001F));
+        REQUIRE(depthBuffer.getPixel(99, 79, 0).r == Approx(0.25F).margin(0.001F));
+    }
+
+    sr::setSimdWidth(simdWidth);
+}
+
+TEST_CASE("Multisampling shades once per pixel and resolves the coverage", "[renderer]")
+{
+    const auto simdWidth = sr::getSimdWidth();
+    std::vector<std::uint8_t> scalarSamples;
+
+    for (const auto width : {sr::SimdWidth::scalar, sr::SimdWidth::sse41, sr::SimdWidth::avx2, sr::SimdWidth::avx512})
+    {
+        sr::setSimdWidth(width);
+
+        sr::Texture frameBuffer{sr::PixelFormat::rgba8, 100, 80, false, sr::Texture::Layout::linear, 4};
+        sr::Texture depthBuffer{sr::PixelFormat::float32, 100, 80, false, sr::Texture::Layout::linear, 4};
+        clear(frameBuffer, sr::Color{0, 0, 0, 255});
+        clear(depthBuffer, 1.0F);
+
+        std::atomic<std::size_t> shadedPixels{0};
+        const auto countingFragmentShader = [&shadedPixels](const sr::VertexShaderOutput& input,
+                                                            const std::array<const sr::Sampler*, 2>&,
+                                                            const std::array<const sr::Texture*, 2>&) {
+            ++shadedPixels;
+            return input.color;
+        };
+
+        // a white triangle with slanted edges
+        std::vector<sr::Vertex> vertices;
+        for (const auto& position : {sr::Vector<float, 2>{-0.9F, -0.8F}, sr::Vector<float, 2>{0.7F, -0.3F}, sr::Vector<float, 2>{-0.2F, 0.9F}})
+            vertices.push_back(sr::Vertex{sr::Vector<float, 4>{position.v[0], position.v[1], 0.5F, 1.0F},
+                                          sr::Color{255, 255, 255, 255}, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}});
+
+        sr::drawTriangles(frameBuffer,
+                          depthBuffer,
+                          vertexShader,
+                          countingFragmentShader,
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          sr::Rect<float>{0.0F, 0.0F, 100.0F, 80.0F},
+                          sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                          sr::BlendState{},
+                          getDepthState(true, true),
+                          sr::RasterizerState{},
+                          {0, 1, 2},
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+
+        const auto samples = frameBuffer.getData();
+        sr::Texture resolved{sr::PixelFormat::rgba8, 100, 80};
+        sr::fastClear(resolved, sr::Color{255, 0, 0, 255}); // overwritten by the resolve, not written after it
+        sr::resolve(frameBuffer, resolved);
+        REQUIRE_FALSE(resolved.isTileCleared(0));
+        const auto resolvedData = resolved.getData();
+
+        // the resolve averages the samples with rounding, every pixel with a covered sample was shaded once
+        std::size_t coveredPixels = 0;
+        std::size_t edgePixels = 0;
+        for (std::size_t pixel = 0; pixel < 100 * 80; ++pixel)
+        {
+            for (std::size_t channel = 0; channel < 4; ++channel)
+            {
+                unsigned int sum = 2;
+                for (std::size_t sample = 0; sample < 4; ++sample)
+                    sum += samples[(sample * 100 * 80 + pixel) * 4 + channel];
+                REQUIRE(resolvedData[pixel * 4 + channel] == sum / 4);
+            }
+
+            if (resolvedData[pixel * 4] != 0) ++coveredPixels;
+            if (resolvedData[pixel * 4] != 0 && resolvedData[pixel * 4] != 255) ++edgePixels;
+        }
+
+        REQUIRE(shadedPixels == coveredPixels);
+        REQUIRE(edgePixels > 0);
+
+        if (width == sr::SimdWidth::scalar)
+            scalarSamples.assign(samples.begin(), samples.end());
+        else
+            REQUIRE(std::equal(samples.begin(), samples.end(), scalarSamples.begin(), scalarSamples.end()));
+    }
+
+    sr::setSimdWidth(simdWidth);
+}
+
+TEST_CASE("Command buffers sort opaque draws and keep the other draws in order", "[renderer]")
+{
+    std::vector<sr::Vertex> vertices;
+    std::vector<std::size_t> indices;
+    getScene(vertices, indices);
+
+    // the first half of the triangles is opaque, the second half is blended over it
+    const auto opaqueIndexCount = indices.size() / 6 * 3;
+    const std::vector<std::size_t> opaqueIndices(indices.begin(), indices.begin() + static_cast<std::ptrdiff_t>(opaqueIndexCount));
+    const std::vector<std::size_t> blendedIndices(indices.begin() + static_cast<std::ptrdiff_t>(opaqueIndexCount), indices.end());
+    const sr::Rect<float> viewport{0.0F, 0.0F, 301.0F, 217.0F};
+    const sr::Rect<float> scissorRect{0.0F, 0.0F, 1.0F, 1.0F};
+
+    sr::Texture expectedFrameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture expectedDepthBuffer{sr::PixelFormat::float32, 301, 217};
+    clear(expectedFrameBuffer, sr::Color{255, 255, 255, 255});
+    clear(expectedDepthBuffer, 1.0F);
+
+    for (const auto& [drawIndices, blendState, depthState] : {std::make_tuple(opaqueIndices, sr::BlendState{}, getDepthState(true, true)),
+                                                              std::make_tuple(blendedIndices, getAlphaBlendState(), getDepthState(true, false))})
+        sr::drawTriangles(expectedFrameBuffer,
+                          expectedDepthBuffer,
+                          vertexShader,
+                          fragmentShader,
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          viewport,
+                          scissorRect,
+                          blendState,
+                          depthState,
+                          sr::RasterizerState{},
+                          drawIndices,
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture depthBuffer{sr::PixelFormat::float32, 301, 217};
+    clear(frameBuffer, sr::Color{255, 255, 255, 255});
+    clear(depthBuffer, 1.0F);
+
+    std::array<sr::CommandBuffer, 3> commandBuffers;
+    for (auto& commandBuffer : commandBuffers)
+    {
+        commandBuffer.setRenderTargets(frameBuffer, depthBuffer);
+        commandBuffer.setShaders(vertexShader, fragmentShader);
+        commandBuffer.setViewport(viewport);
+        commandBuffer.setDepthState(getDepthState(true, true));
+    }
+
+    REQUIRE_THROWS_AS(commandBuffers[0].drawIndexed(indices, indices.size() - 2, 3, vertices, 0, vertices.size(), sr::Matrix<float, 4>::identity()),
+                      sr::RenderError);
+
+    // every opaque triangle is a draw of its own, recorded alternately by two threads
+    const auto record = [&](sr::CommandBuffer& commandBuffer, const std::size_t firstTriangle) {
+        for (auto triangle = firstTriangle; triangle < opaqueIndexCount / 3; triangle += 2)
+            commandBuffer.drawIndexed(indices, triangle * 3, 3, vertices, 0, vertices.size(), sr::Matrix<float, 4>::identity());
+    };
+
+    std::thread firstThread{record, std::ref(commandBuffers[0]), 0};
+    std::thread secondThread{record, std::ref(commandBuffers[1]), 1};
+    firstThread.join();
+    secondThread.join();
+
+    commandBuffers[2].setBlendState(getAlphaBlendState());
+    commandBuffers[2].setDepthState(getDepthState(true, false));
+    commandBuffers[2].drawIndexed(indices, opaqueIndexCount, indices.size() - opaqueIndexCount,
+                                  vertices, 0, vertices.size(), sr::Matrix<float, 4>::identity());
+
+    sr::submit({&commandBuffers[0], &commandBuffers[1], &commandBuffers[2]});
+
+    REQUIRE(frameBuffer.getData() == expectedFrameBuffer.getData());
+    REQUIRE(depthBuffer.getData() == expectedDepthBuffer.getData());
+}
+
+TEST_CASE("Command buffers keep draws that sample a render target after the draws into it", "[renderer]")
+{
+    const auto getQuad = [](const float z) {
+        std::vector<sr::Vertex> vertices;
+        for (const auto& position : {sr::Vector<float, 2>{-1.0F, -1.0F}, sr::Vector<float, 2>{1.0F, -1.0F},
+                                     sr::Vector<float, 2>{1.0F, 1.0F}, sr::Vector<float, 2>{-1.0F, 1.0F}})
+            vertices.push_back(sr::Vertex{sr::Vector<float, 4>{position.v[0], position.v[1], z, 1.0F},
+                                          sr::Color{0.0F, 1.0F, 0.0F, 1.0F},
+                                          sr::Vector<float, 2>{0.5F, 0.5F},
+                                          sr::Vector<float, 3>{}});
+        return vertices;
+    };
+
+    const std::vector<std::size_t> indices{0, 1, 2, 0, 2, 3};
+    const auto renderTargetVertices = getQuad(0.5F);
+    const auto vertices = getQuad(0.25F);
+
+    const auto samplingFragmentShader = [](const sr::VertexShaderOutput& input,
+                                           const std::array<const sr::Sampler*, 2>& samplers,
+                                           const std::array<const sr::Texture*, 2>& textures) {
+        return textures[0]->sample(samplers[0], input.texCoords[0]);
+    };
+
+    // both orders of the addresses of the render targets
+    std::array<sr::Texture, 2> frameBuffers{sr::Texture{sr::PixelFormat::rgba8, 8, 8}, sr::Texture{sr::PixelFormat::rgba8, 8, 8}};
+    std::array<sr::Texture, 2> depthBuffers{sr::Texture{sr::PixelFormat::float32, 8, 8}, sr::Texture{sr::PixelFormat::float32, 8, 8}};
+    const sr::Sampler sampler;
+
+    for (std::size_t renderTargetIndex = 0; renderTargetIndex < 2; ++renderTargetIndex)
+    {
+        auto& renderTarget = frameBuffers[renderTargetIndex];
+        auto& frameBuffer = frameBuffers[1 - renderTargetIndex];
+
+        for (auto& texture : frameBuffers) clear(texture, sr::Color{0, 0, 0, 255});
+        for (auto& texture : depthBuffers) clear(texture, 1.0F);
+
+        // the draw that samples the render target is nearer, both are opaque
+        sr::CommandBuffer commandBuffer;
+        commandBuffer.setViewport(sr::Rect<float>{0.0F, 0.0F, 8.0F, 8.0F});
+        commandBuffer.setDepthState(getDepthState(true, true));
+        commandBuffer.setRenderTargets(renderTarget, depthBuffers[renderTargetIndex]);
+        commandBuffer.setShaders(vertexShader, fragmentShader);
+        commandBuffer.drawIndexed(indices, renderTargetVertices, sr::Matrix<float, 4>::identity());
+
+        commandBuffer.setRenderTargets(frameBuffer, depthBuffers[1 - renderTargetIndex]);
+        commandBuffer.setShaders(vertexShader, samplingFragmentShader);
+        commandBuffer.setTextures({&sampler, nullptr}, {&renderTarget, nullptr});
+        commandBuffer.drawIndexed(indices, vertices, sr::Matrix<float, 4>::identity());
+
+        sr::submit(commandBuffer);
+
+        REQUIRE(frameBuffer.getPixel(3, 3, 0).getIntValueRaw() == sr::Color{0.0F, 1.0F, 0.0F, 1.0F}.getIntValueRaw());
+    }
+}
+
+TEST_CASE("Command buffers keep the order of coplanar opaque draws", "[renderer]")
+{
+    const auto getQuad = [](const sr::Color& color) {
+        std::vector<sr::Vertex> vertices;
+        for (const auto& position : {sr::Vector<float, 2>{-1.0F, -1.0F}, sr::Vector<float, 2>{1.0F, -1.0F},
+                                     sr::Vector<float, 2>{1.0F, 1.0F}, sr::Vector<float, 2>{-1.0F, 1.0F}})
+            vertices.push_back(sr::Vertex{sr::Vector<float, 4>{position.v[0], position.v[1], 0.5F, 1.0F},
+                                          color, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}});
+        return vertices;
+    };
+
+    const std::vector<std::size_t> indices{0, 1, 2, 0, 2, 3};
+    const sr::Color red{1.0F, 0.0F, 0.0F, 1.0F};
+    const sr::Color green{0.0F, 1.0F, 0.0F, 1.0F};
+    const auto redVertices = getQuad(red);
+    const auto greenVertices = getQuad(green);
+
+    // the textures are not sampled, they would only sort the green draw first
+    std::array<sr::Texture, 2> textures{sr::Texture{sr::PixelFormat::rgba8, 1, 1}, sr::Texture{sr::PixelFormat::rgba8, 1, 1}};
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 8, 8};
+    sr::Texture depthBuffer{sr::PixelFormat::float32, 8, 8};
+    clear(frameBuffer, sr::Color{0, 0, 0, 255});
+    clear(depthBuffer, 1.0F);
+
+    sr::CommandBuffer commandBuffer;
+    commandBuffer.setViewport(sr::Rect<float>{0.0F, 0.0F, 8.0F, 8.0F});
+    commandBuffer.setDepthState(getDepthState(true, true));
+    commandBuffer.setRenderTargets(frameBuffer, depthBuffer);
+    commandBuffer.setShaders(vertexShader, fragmentShader);
+    commandBuffer.setTextures({nullptr, nullptr}, {&textures[1], nullptr});
+    commandBuffer.drawIndexed(indices, redVertices, sr::Matrix<float, 4>::identity());
+    commandBuffer.setTextures({nullptr, nullptr}, {&textures[0], nullptr});
+    commandBuffer.drawIndexed(indices, greenVertices, sr::Matrix<float, 4>::identity());
+
+    sr::submit(commandBuffer);
+
+    // the depth test passes for equal depths, so the later draw covers the earlier one
+    for (std::size_t y = 0; y < 8; ++y)
+        for (std::size_t x = 0; x < 8; ++x)
+            REQUIRE(frameBuffer.getPixel(x, y, 0).getIntValueRaw() == green.getIntValueRaw());
+}
+
+TEST_CASE("Render passes keep discarded depth in tile memory", "[renderer]")
+{
+    std::vector<sr::Vertex> vertices;
+    std::vector<std::size_t> indices;
+    getScene(vertices, indices);
+
+    const auto opaqueIndexCount = indices.size() / 6 * 3;
+    const sr::Rect<float> viewport{0.0F, 0.0F, 301.0F, 217.0F};
+
+    sr::Texture expectedFrameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture expectedDepthBuffer{sr::PixelFormat::float32, 301, 217};
+    clear(expectedFrameBuffer, sr::Color{255, 255, 255, 255});
+    clear(expectedDepthBuffer, 1.0F);
+
+    sr::CommandBuffer expectedCommandBuffer;
+    sr::CommandBuffer commandBuffer;
+    expectedCommandBuffer.setRenderTargets(expectedFrameBuffer, expectedDepthBuffer);
+
+    // opaque triangles and then blended triangles over them
+    for (auto buffer : {&expectedCommandBuffer, &commandBuffer})
+    {
+        buffer->setShaders(vertexShader, fragmentShader);
+        buffer->setViewport(viewport);
+        buffer->setDepthState(getDepthState(true, true));
+        buffer->drawIndexed(indices, 0, opaqueIndexCount, vertices, 0, vertices.size(), sr::Matrix<float, 4>::identity());
+        buffer->setBlendState(getAlphaBlendState());
+        buffer->setDepthState(getDepthState(true, false));
+        buffer->drawIndexed(indices, opaqueIndexCount, indices.size() - opaqueIndexCount,
+                            vertices, 0, vertices.size(), sr::Matrix<float, 4>::identity());
+    }
+
+    sr::submit(expectedCommandBuffer);
+
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture depthBuffer{sr::PixelFormat::float32, 301, 217};
+    clear(frameBuffer, sr::Color{0, 0, 0, 255});
+    clear(depthBuffer, 0.5F);
+
+    sr::RenderPass renderPass;
+    renderPass.colorAttachment.texture = &frameBuffer;
+    renderPass.colorAttachment.loadAction = sr::RenderPass::LoadAction::clear;
+    renderPass.colorAttachment.clearColor = sr::Color{255, 255, 255, 255};
+    renderPass.depthAttachment.texture = &depthBuffer;
+    renderPass.depthAttachment.loadAction = sr::RenderPass::LoadAction::clear;
+    renderPass.depthAttachment.clearDepth = 1.0F;
+
+    sr::submit(renderPass, commandBuffer);
+
+    REQUIRE(frameBuffer.getData() == expectedFrameBuffer.getData());
+    REQUIRE(depthBuffer.getData() == expectedDepthBuffer.getData());
+
+    // a discarded depth buffer keeps the depths that were loaded from it
+    clear(depthBuffer, 1.0F);
+    const auto depthData = depthBuffer.getData();
+
+    renderPass.depthAttachment.loadAction = sr::RenderPass::LoadAction::load;
+    renderPass.depthAttachment.storeAction = sr::RenderPass::StoreAction::discard;
+
+    sr::submit(renderPass, commandBuffer);
+
+    REQUIRE(frameBuffer.getData() == expectedFrameBuffer.getData());
+    REQUIRE(depthBuffer.getData() == depthData);
+
+    // the tile memory of a depth buffer that is not loaded starts with the clear depth, in every pass
+    renderPass.depthAttachment.loadAction = sr::RenderPass::LoadAction::dontCare;
+
+    for (std::size_t pass = 0; pass < 2; ++pass)
+    {
+        sr::submit(renderPass, commandBuffer);
+
+        REQUIRE(frameBuffer.getData() == expectedFrameBuffer.getData());
+        REQUIRE(depthBuffer.getData() == depthData);
+    }
+
+    renderPass.depthAttachment.texture = nullptr;
+    REQUIRE_THROWS_AS(sr::submit(renderPass, commandBuffer), sr::RenderError);
+}
+
+TEST_CASE("Fast clears write only the tiles that are drawn into", "[renderer]")
+{
+    const auto drawTriangle = [](sr::Texture& frameBuffer, sr::Texture& depthBuffer) {
+        // in a corner, far from the last tile
+        const sr::Color green{0.0F, 1.0F, 0.0F, 1.0F};
+        const std::vector<sr::Vertex> vertices{
+            sr::Vertex{sr::Vector<float, 4>{-1.0F, -1.0F, 0.5F, 1.0F}, green, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}},
+            sr::Vertex{sr::Vector<float, 4>{-0.6F, -1.0F, 0.5F, 1.0F}, green, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}},
+            sr::Vertex{sr::Vector<float, 4>{-1.0F, -0.6F, 0.5F, 1.0F}, green, sr::Vector<float, 2>{}, sr::Vector<float, 3>{}}
+        };
+
+        sr::drawTriangles(frameBuffer,
+                          depthBuffer,
+                          vertexShader,
+                          fragmentShader,
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          sr::Rect<float>{0.0F, 0.0F, 200.0F, 150.0F},
+                          sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                          sr::BlendState{},
+                          getDepthState(true, true),
+                          sr::RasterizerState{},
+                          {0, 1, 2},
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+    };
+
+    const sr::Color black{0, 0, 0, 255};
+    const sr::Color white{255, 255, 255, 255};
+
+    sr::Texture expectedFrameBuffer{sr::PixelFormat::rgba8, 200, 150};
+    sr::Texture expectedDepthBuffer{sr::PixelFormat::float32, 200, 150};
+    clear(expectedFrameBuffer, white);
+    clear(expectedDepthBuffer, 1.0F);
+    drawTriangle(expectedFrameBuffer, expectedDepthBuffer);
+
+    // the depth of the old contents would fail the depth test of the triangle
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 200, 150};
+    sr::Texture depthBuffer{sr::PixelFormat::float32, 200, 150};
+    clear(frameBuffer, black);
+    clear(depthBuffer, 0.5F);
+    sr::fastClear(frameBuffer, white);
+    sr::fastClear(depthBuffer, 1.0F);
+    drawTriangle(frameBuffer, depthBuffer);
+
+    // the last tile still has the old contents, but reads as cleared
+    const std::size_t lastTile = 4 * 3 - 1;
+    REQUIRE(frameBuffer.isTileCleared(lastTile));
+    REQUIRE(depthBuffer.isTileCleared(lastTile));
+    REQUIRE(reinterpret_cast<const std::uint32_t*>(frameBuffer.getUnresolvedData().data())[200 * 150 - 1] == black.getIntValueRaw());
+    REQUIRE(frameBuffer.getPixel(199, 149, 0).getIntValueRaw() == white.getIntValueRaw());
+    REQUIRE(depthBuffer.getPixel(199, 149, 0).r == 1.0F);
+
+    REQUIRE(frameBuffer.getLinearData() == expectedFrameBuffer.getLinearData());
+    REQUIRE(frameBuffer.isTileCleared(lastTile));
+
+    // the const data and sampler bindings leave the clear pending
+    const auto& constFrameBuffer = frameBuffer;
+    REQUIRE(reinterpret_cast<const std::uint32_t*>(constFrameBuffer.getData().data())[200 * 150 - 1] == black.getIntValueRaw());
+    sr::Sampler sampler;
+    sampler.filter = sr::Sampler::Filter::linear;
+    const sr::SamplerBinding binding{frameBuffer, sampler};
+    REQUIRE(binding.sample(sr::Vector<float, 2>{0.99F, 0.99F}).getIntValueRaw() == white.getIntValueRaw());
+    REQUIRE(frameBuffer.isTileCleared(lastTile));
+
+    // reading the data writes the cleared tiles
+    REQUIRE(frameBuffer.getData() == expectedFrameBuffer.getData());
+    REQUIRE(depthBuffer.getData() == expectedDepthBuffer.getData());
+    REQUIRE_FALSE(frameBuffer.isTileCleared(lastTile));
+}
+
+TEST_CASE("Callable shaders match function shaders", "[renderer]")
+{
+    sr::Texture functionFrameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture functionDepthBuffer{sr::PixelFormat::float32, 301, 217};
+    renderScene(functionFrameBuffer, functionDepthBuffer);
+
+    // the same scene drawn with lambdas that capture a uniform
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture depthBuffer{sr::PixelFormat::float32, 301, 217};
+    clear(frameBuffer, sr::Color{255, 255, 255, 255});
+    clear(depthBuffer, 0.75F);
+
+    const float alphaScale = 1.0F;
+    const auto lambdaVertexShader = [](const sr::Matrix<float, 4>& modelViewProjection, const sr::Vertex& vertex) {
+        return vertexShader(modelViewProjection, vertex);
+    };
+    const auto lambdaFragmentShader = [alphaScale](const sr::VertexShaderOutput& input,
+                                                   const std::array<const sr::Sampler*, 2>&,
+                                                   const std::array<const sr::Texture*, 2>&) {
+        return sr::Color{input.color.r, input.color.g, input.color.b, input.color.a * alphaScale};
+    };
+
+    std::vector<sr::Vertex> vertices;
+    std::vector<std::size_t> indices;
+    getScene(vertices, indices);
+
+    sr::drawTriangles(frameBuffer,
+                      depthBuffer,
+                      lambdaVertexShader,
+                      lambdaFragmentShader,
+                      {nullptr, nullptr},
+                      {nullptr, nullptr},
+                      sr::Rect<float>{0.0F, 0.0F, 301.0F, 217.0F},
+                      sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                      getAlphaBlendState(),
+                      getDepthState(true, false),
+                      sr::RasterizerState{},
+                      indices,
+                      vertices,
+                      sr::Matrix<float, 4>::identity());
+
+    REQUIRE(frameBuffer.getData() == functionFrameBuffer.getData());
+
+    // the function-pointer form without a rasterizer state
+    clear(frameBuffer, sr::Color{255, 255, 255, 255});
+    clear(depthBuffer, 0.75F);
+
+    sr::drawTriangles(frameBuffer,
+                      depthBuffer,
+                      vertexShader,
+                      fragmentShader,
+                      {nullptr, nullptr},
+                      {nullptr, nullptr},
+                      sr::Rect<float>{0.0F, 0.0F, 301.0F, 217.0F},
+                      sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                      getAlphaBlendState(),
+                      getDepthState(true, false),
+                      indices,
+                      vertices,
+                      sr::Matrix<float, 4>::identity());
+
+    REQUIRE(frameBuffer.getData() == functionFrameBuffer.getData());
+}
+
+TEST_CASE("User-defined varyings interpolate only their components", "[renderer]")
+{
+    sr::Texture fullFrameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture fullDepthBuffer{sr::PixelFormat::float32, 301, 217};
+    renderScene(fullFrameBuffer, fullDepthBuffer);
+
+    sr::Texture frameBuffer{sr::PixelFormat::rgba8, 301, 217};
+    sr::Texture depthBuffer{sr::PixelFormat::float32, 301, 217};
+    clear(frameBuffer, sr::Color{255, 255, 255, 255});
+    clear(depthBuffer, 0.75F);
+
+    std::vector<sr::Vertex> vertices;
+    std::vector<std::size_t> indices;
+    getScene(vertices, indices);
+
+    sr::drawTriangles(frameBuffer,
+                      depthBuffer,
+                      [](const sr::Matrix<float, 4>& modelViewProjection, const sr::Vertex& vertex) {
+                          return ColorVaryings{modelViewProjection * vertex.position, vertex.color};
+                      },
+                      [](const ColorVaryings& input,
+                         const std::array<const sr::Sampler*, 2>&,
+                         const std::array<const sr::Texture*, 2>&) {
+                          return input.color;
+                      },
+                      {nullptr, nullptr},
+                      {nullptr, nullptr},
+                      sr::Rect<float>{0.0F, 0.0F, 301.0F, 217.0F},
+                      sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                      getAlphaBlendState(),
+                      getDepthState(true, false),
+                      sr::RasterizerState{},
+                      indices,
+                      vertices,
+                      sr::Matrix<float, 4>::identity());
+
+    REQUIRE(frameBuffer.getData() == fullFrameBuffer.getData());
+}
+
+TEST_CASE("Fragment shaders get the derivatives of their input", "[renderer]")
+{
+    const auto simdWidth = sr::getSimdWidth();
+
+    // the texture coordinates advance by 4 across the 64 pixels of the frame buffer
+    const std::vector<sr::Vertex> vertices{
+        sr::Vertex{sr::Vector<float, 4>{-1.0F, -1.0F, 0.5F, 1.0F}, sr::Color{}, sr::Vector<float, 2>{0.0F, 0.0F}, sr::Vector<float, 3>{}},
+        sr::Vertex{sr::Vector<float, 4>{1.0F, -1.0F, 0.5F, 1.0F}, sr::Color{}, sr::Vector<float, 2>{4.0F, 0.0F}, sr::Vector<float, 3>{}},
+        sr::Vertex{sr::Vector<float, 4>{1.0F, 1.0F, 0.5F, 1.0F}, sr::Color{}, sr::Vector<float, 2>{4.0F, 4.0F}, sr::Vector<float, 3>{}},
+        sr::Vertex{sr::Vector<float, 4>{-1.0F, 1.0F, 0.5F, 1.0F}, sr::Color{}, sr::Vector<float, 2>{0.0F, 4.0F}, sr::Vector<float, 3>{}}
+    };
+    const std::vector<std::size_t> indices{0, 1, 2, 0, 2, 3};
+
+    const auto render = [&vertices, &indices](const sr::SimdWidth width) {
+        sr::Texture frameBuffer{sr::PixelFormat::rgba8, 64, 64};
+        sr::Texture depthBuffer{sr::PixelFormat::float32, 64, 64};
+        clear(depthBuffer, 1.0F);
+
+        // every pixel is written by a single thread
+        std::vector<sr::Derivatives<sr::VertexShaderOutput>> derivatives(64 * 64);
+
+        sr::setSimdWidth(width);
+        sr::drawTriangles(frameBuffer,
+                          depthBuffer,
+                          vertexShader,
+                          [&derivatives](const sr::VertexShaderOutput& input,
+                                         const sr::Derivatives<sr::VertexShaderOutput>& inputDerivatives,
+                                         const std::array<const sr::Sampler*, 2>&,
+                                         const std::array<const sr::Texture*, 2>&) {
+                              const auto x = static_cast<std::size_t>(input.position.v[0]);
+                              const auto y = static_cast<std::size_t>(input.position.v[1]);
+                              derivatives[y * 64 + x] = inputDerivatives;
+                              return input.color;
+                          },
+                          {nullptr, nullptr},
+                          {nullptr, nullptr},
+                          sr::Rect<float>{0.0F, 0.0F, 64.0F, 64.0F},
+                          sr::Rect<float>{0.0F, 0.0F, 1.0F, 1.0F},
+                          sr::BlendState{},
+                          getDepthState(true, true),
+                          sr::RasterizerState{},
+                          indices,
+                          vertices,
+                          sr::Matrix<float, 4>::identity());
+
+        return derivatives;
+    };
+
+    const auto scalarDerivatives = render(sr::SimdWidth::scalar);
+
+    // the pixels along the diagonal take their neighbors from the helper pixels of the other triangle
+    for (const auto& pixelDerivatives : scalarDerivatives)
+    {
+        REQUIRE(pixelDerivatives.ddx.position.v[0] == 1.0F);
+        REQUIRE(pixelDerivatives.ddy.position.v[1] == 1.0F);
+        REQUIRE(pixelDerivatives.ddx.texCoords[0].v[0] == Approx(0.0625F));
+        REQUIRE(pixelDerivatives.ddx.texCoords[0].v[1] == Approx(0.0F).margin(0.0001F));
+        REQUIRE(pixelDerivatives.ddy.texCoords[0].v[0] == Approx(0.0F).margin(0.0001F));
+        REQUIRE(std::abs(pixelDerivatives.ddy.texCoords[0].v[1]) == Approx(0.0625F));
+    }
+
+    for (const auto width : {sr::SimdWidth::sse41, sr::SimdWidth::avx2, sr::SimdWidth::avx512})
+    {
+        const auto derivatives = render(width);
+
+        for (std::size_t i = 0; i < derivatives.size(); ++i)
+        {
+            REQUIRE(derivatives[i].ddx.texCoords[0].v[0] == scalarDerivatives[i].ddx.texCoords[0].v[0]);
+            REQUIRE(derivatives[i].ddy.texCoords[0].v[1] == scalarDerivatives[i].ddy.texCoords[0].v[1]);
+        }
+    }
+
+    sr::setSimdWidth(simdWidth);
+}
+
+TEST_CASE("Mip maps are box filtered and selected by the derivatives", "[texture]")
+{
+    // 4x4 texture, each 2x2 quarter averages to a different color
+    sr::Texture texture{sr::PixelFormat::rgba8, 4, 4, true};
+    REQUIRE(texture.getLevelCount() == 3);
+
+    std::vector<std::uint8_t> data(4 * 4 * 4);
+    for (std::size_t y = 0; y < 4; ++y)
+        for (std::size_t x = 0; x < 4; ++x)
+        {
+            const auto quarter = (y / 2) * 2 + x / 2;
+            const std::uint8_t value = static_cast<std::uint8_t>(quarter * 64 + ((x + y) % 2) * 10);
+            for (std::size_t channel = 0; channel < 4; ++channel)
+                data[(y * 4 + x) * 4 + channel] = value;
+        }
+
+    texture.setData(data);
+    texture.generateMipMaps();
+
+    const auto& level1 = texture.getData(1);
+    REQUIRE(level1.size() == 2 * 2 * 4);
+    for (std::size_t quarter = 0; quarter < 4; ++quarter)
+        REQUIRE(level1[quarter * 4] == quarter * 64 + 5);
+
+    // (5 + 69 + 133 + 197 + 2) / 4
+    REQUIRE(texture.getData(2)[0] == 101);
+
+    sr::Sampler sampler;
+    sampler.filter = sr::Sampler::Filter::linearMipPoint;
+
+    const sr::Vector<float, 2> center{0.5F, 0.5F};
+    const sr::Vector<float, 2> zero{0.0F, 0.0F};
+
+    // a pixel spans 4 texels along x, so the last level is read
+    REQUIRE(texture.sample(&sampler, center, sr::Vector<float, 2>{1.0F, 0.0F}, zero).r == Approx(101.0F / 255.0F));
+
+    // magnified textures read the base level
+    const auto magnified = texture.sample(&sampler, center, sr::Vector<float, 2>{0.01F, 0.0F}, zero);
+    REQUIRE(magnified.r == texture.sample(&sampler, center).r);
+
+    // the LOD range limits the levels, (0.25, 0.25) is the center of the first texel of the 2x2 level
+    const sr::Vector<float, 2> firstTexel{0.25F, 0.25F};
+    texture.setMaxLOD(1);
+    REQUIRE(texture.sample(&sampler, firstTexel, sr::Vector<float, 2>{1.0F, 0.0F}, zero).r == Approx(5.0F / 255.0F));
+    texture.setMaxLOD(UINT_MAX);
+
+    // halfway between the levels 1 and 2
+    sampler.filter = sr::Sampler::Filter::trilinear;
+    const auto trilinear = texture.sample(&sampler, firstTexel, zero, sr::Vector<float, 2>{0.0F, std::sqrt(0.5F)});
+    REQUIRE(trilinear.r == Approx((5.0F + 101.0F) / 2.0F / 255.0F));
+}
+
+namespace
+{
+    std::vector<std::uint8_t> getRandomTexels(const std::size_t size)
+    {
+        std::uint32_t seed = 1;
+        std::vector<std::uint8_t> texels(size);
+        for (auto& texel : texels)
+        {
+            seed = seed * 1664525U + 1013904223U;
+            texel = static_cast<std::uint8_t>(seed >> 24);
+        }
+        return texels;
+    }
+}
+
+TEST_CASE("Tiled textures match linear textures", "[texture]")
+{
+    // not a multiple of the block size, so that the blocks are padded
+    const auto data = getRandomTexels(13 * 7 * 4);
+
+    sr::Texture linearTexture{sr::PixelFormat::rgba8, 13, 7, true};
+    sr::Texture tiledTexture{sr::PixelFormat::rgba8, 13, 7, true, sr::Texture::Layout::tiled};
+
+    linearTexture.setData(data);
+    tiledTexture.setData(data);
+    REQUIRE(tiledTexture.getLinearData() == data);
+
+    linearTexture.generateMipMaps();
+    tiledTexture.generateMipMaps();
+
+    for (std::uint32_t level = 0; level < linearTexture.getLevelCount(); ++level)
+    {
+        REQUIRE(tiledTexture.getLinearData(level) == linearTexture.getLinearData(level));
+
+        for (std::size_t y = 0; y < linearTexture.getLevelHeight(level); ++y)
+            for (std::size_t x = 0; x < linearTexture.getLevelWidth(level); ++x)
+                REQUIRE(tiledTexture.getPixel(x, y, level).getIntValueRaw() == linearTexture.getPixel(x, y, level).getIntValueRaw());
+    }
+
+    sr::Sampler sampler;
+    sampler.filter = sr::Sampler::Filter::trilinear;
+    sampler.addressModeX = sr::Sampler::AddressMode::repeat;
+
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        const sr::Vector<float, 2> coord{static_cast<float>(i) * 0.037F, static_cast<float>(i % 10) * 0.1F};
+        const sr::Vector<float, 2> ddx{static_cast<float>(i) * 0.002F, 0.0F};
+        const sr::Vector<float, 2> ddy{0.0F, 0.05F};
+
+        const auto linearColor = linearTexture.sample(&sampler, coord, ddx, ddy);
+        const auto tiledColor = tiledTexture.sample(&sampler, coord, ddx, ddy);
+        REQUIRE(tiledColor.r == linearColor.r);
+        REQUIRE(tiledColor.g == linearColor.g);
+        REQUIRE(tiledColor.b == linearColor.b);
+        REQUIRE(tiledColor.a == linearColor.a);
+    }
+}
+
+TEST_CASE("Texture levels share one aligned allocation", "[texture]")
+{
+    sr::Texture texture{sr::PixelFormat::rgba8, 13, 7, true};
+    REQUIRE(texture.getLevelCount() == 4);
+
+    for (std::uint32_t level = 0; level < texture.getLevelCount(); ++level)
+    {
+        REQUIRE(reinterpret_cast<std::uintptr_t>(texture.getData(level).data()) % 64 == 0);
+        REQUIRE(texture.getData(level).size() == texture.getLevelWidth(level) * texture.getLevelHeight(level) * 4);
+        if (level > 0) REQUIRE(texture.getData(level).data() > texture.getData(level - 1).data());
+    }
+
+    // the allocation is reused if it is large enough, and the levels are zeroed
+    const auto data = texture.getData().data();
+    texture.setData(getRandomTexels(13 * 7 * 4));
+    texture.resize(8, 8);
+    REQUIRE(texture.getData().data() == data);
+    REQUIRE(texture.getLevelCount() == 4);
+    for (const auto value : texture.getData())
+        REQUIRE(value == 0);
+}
+
+TEST_CASE("Sampler bindings match Texture::sample", "[texture]")
+{
+    using AddressMode = sr::Sampler::AddressMode;
+    using Filter = sr::Sampler::Filter;
+
+    // power-of-two sides wrap by masking, the others through the address modes
+    for (const auto& [width, height] : {std::pair<std::size_t, std::size_t>{16, 8}, std::pair<std::size_t, std::size_t>{13, 7}})
+        for (const auto pixelFormat : {sr::PixelFormat::rgba8, sr::PixelFormat::r8})
+            for (const auto layout : {sr::Texture::Layout::linear, sr::Texture::Layout::tiled})
+            {
+                sr::Texture texture{pixelFormat, width, height, true, layout};
+                texture.setData(getRandomTexels(width * height * sr::getPixelSize(pixelFormat)));
+                texture.generateMipMaps();
+
+                for (const auto addressMode : {AddressMode::clamp, AddressMode::repeat, AddressMode::mirror})
+                    for (const auto filter : {Filter::point, Filter::linear, Filter::trilinear})
+                    {
+                        sr::Sampler sampler;
+                        sampler.addressModeX = addressMode;
+                        sampler.addressModeY = AddressMode::repeat;
+                        sampler.filter = filter;
+
+                        const sr::SamplerBinding binding{texture, sampler};
+
+                        for (std::size_t i = 0; i < 200; ++i)
+                        {
+                            const sr::Vector<float, 2> coord{static_cast<float>(i) * 0.0137F - 1.3F, static_cast<float>(i) * -0.0291F + 0.7F};
+                            const sr::Vector<float, 2> ddx{static_cast<float>(i % 20) * 0.01F, 0.0F};
+                            const sr::Vector<float, 2> ddy{0.0F, 0.02F};
+
+                            const auto expected = texture.sample(&sampler, coord, ddx, ddy);
+                            const auto color = binding.sample(coord, ddx, ddy);
+
+                            // rgba8 is blended with 8-bit weights
+                            const auto margin = (pixelFormat == sr::PixelFormat::rgba8 && filter != Filter::point) ? 2.5F / 255.0F : 0.0F;
+                            REQUIRE(color.r == Approx(expected.r).margin(margin));
+                            REQUIRE(color.g == Approx(expected.g).margin(margin));
+                            REQUIRE(color.b == Approx(expected.b).margin(margin));
+                            REQUIRE(color.a == Approx(expected.a).margin(margin));
+                        }
+                    }
+            }
+
+    // the clamped positions of NaNs and huge coordinates sample the corners with valid weights
+    sr::Texture texture{sr::PixelFormat::rgba8, 16, 8};
+    texture.setData(getRandomTexels(16 * 8 * 4));
+
+    sr::Sampler sampler;
+    sampler.filter = Filter::linear;
+    const sr::SamplerBinding binding{texture, sampler};
+
+    const auto nan = std::numeric_limits<float>::quiet_NaN();
+    for (const auto& [u, v, x, y] : {std::make_tuple(nan, nan, 0, 0),
+                                     std::make_tuple(1.0E10F, nan, 15, 0),
+                                     std::make_tuple(-1.0E10F, 1.0E10F, 0, 7),
+                                     std::make_tuple(1.0E20F, 1.0E20F, 15, 7)})
+    {
+        const auto color = binding.sample(sr::Vector<float, 2>{u, v});
+        const auto expected = texture.getPixel(static_cast<std::size_t>(x), static_cast<std::size_t>(y), 0);
+        REQUIRE(color.getIntValueRaw() == expected.getIntValueRaw());
+    }
+}
+
+TEST_CASE("Batched sampling matches single samples", "[texture]")
+{
+    using AddressMode = sr::Sampler::AddressMode;
+
+    const auto simdWidth = sr::getSimdWidth();
+
+    const auto checkSamples = [](const sr::SamplerBinding& binding, const auto& us, const auto& vs) {
+        constexpr auto count = sizeof(us) / sizeof(us[0]);
+        float colors[4][count];
+        binding.sampleN(us, vs, colors);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const auto color = binding.sample(sr::Vector<float, 2>{us[i], vs[i]});
+            REQUIRE(colors[0][i] == color.r);
+            REQUIRE(colors[1][i] == color.g);
+            REQUIRE(colors[2][i] == color.b);
+            REQUIRE(colors[3][i] == color.a);
+        }
+    };
+
+    // the gathers, and the single samples for a side that is not a power of two and without AVX2
+    for (const auto& [width, height] : {std::pair<std::size_t, std::size_t>{16, 8}, std::pair<std::size_t, std::size_t>{16, 7}})
+        for (const auto layout : {sr::Texture::Layout::linear, sr::Texture::Layout::tiled})
+            for (const auto batchSimdWidth : {sr::SimdWidth::scalar, sr::SimdWidth::avx2})
+            {
+                sr::Texture texture{sr::PixelFormat::rgba8, width, height, false, layout};
+                texture.setData(getRandomTexels(width * height * 4));
+
+                sr::setSimdWidth(batchSimdWidth);
+
+                for (const auto addressMode : {AddressMode::clamp, AddressMode::repeat, AddressMode::mirror})
+                    for (const auto filter : {sr::Sampler::Filter::point, sr::Sampler::Filter::linear})
+                    {
+                        sr::Sampler sampler;
+                        sampler.addressModeX = addressMode;
+                        sampler.addressModeY = addressMode;
+                        sampler.filter = filter;
+
+                        const sr::SamplerBinding binding{texture, sampler};
+
+                        for (std::size_t batch = 0; batch < 10; ++batch)
+                        {
+                            float us[16];
+                            float vs[16];
+                            for (std::size_t i = 0; i < 16; ++i)
+                            {
+                                us[i] = static_cast<float>(batch * 16 + i) * 0.0137F - 1.3F;
+                                vs[i] = static_cast<float>(batch * 16 + i) * -0.0291F + 0.7F;
+                            }
+
+                            float us4[4];
+                            float vs4[4];
+                            float us8[8];
+                            float vs8[8];
+                            std::copy_n(us, 4, us4);
+                            std::copy_n(vs, 4, vs4);
+                            std::copy_n(us, 8, us8);
+                            std::copy_n(vs, 8, vs8);
+
+                            checkSamples(binding, us4, vs4);
+                            checkSamples(binding, us8, vs8);
+                            checkSamples(binding, us, vs);
+                        }
+
+                        // NaNs and the positions beyond the limits of the texel coordinates
+                        const auto nan = std::numeric_limits<float>::quiet_NaN();
+                        const float us8[8] = {nan, 1.0E10F, -1.0E10F, 1.0E20F, nan, 0.5F, -3.0E9F, 2.5E9F};
+                        const float vs8[8] = {nan, nan, 1.0E10F, 1.0E20F, 0.25F, nan, 3.0E9F, -2.5E9F};
+                        checkSamples(binding, us8, vs8);
+                    }
+            }
+
+    sr::setSimdWidth(simdWidth);
+}
+
+TEST_CASE("Block-compressed textures decode their blocks", "[texture]")
+{
+    SECTION("BC1")
+    {
+        // red and blue, with the indices 0, 1, 2 and 3 in the first row and 0 elsewhere
+        sr::Texture texture{sr::PixelFormat::bc1, 4, 4};
+        texture.setData({0x00, 0xF8, 0x1F, 0x00, 0xE4, 0x00, 0x00, 0x00});
+
+        REQUIRE(texture.getPixel(0, 0, 0).getIntValueRaw() == sr::Color{255U, 0U, 0U}.getIntValueRaw());
+        REQUIRE(texture.getPixel(1, 0, 0).getIntValueRaw() == sr::Color{0U, 0U, 255U}.getIntValueRaw());
+        REQUIRE(texture.getPixel(2, 0, 0).getIntValueRaw() == sr::Color{170U, 0U, 85U}.getIntValueRaw());
+        REQUIRE(texture.getPixel(3, 0, 0).getIntValueRaw() == sr::Color{85U, 0U, 170U}.getIntValueRaw());
+        REQUIRE(texture.getPixel(3, 3, 0).getIntValueRaw() == sr::Color{255U, 0U, 0U}.getIntValueRaw());
+
+        // the cached block is replaced when the data changes
+        texture.setData({0x1F, 0x00, 0x00, 0xF8, 0x00, 0x00, 0x00, 0x00});
+        REQUIRE(texture.getPixel(0, 0, 0).getIntValueRaw() == sr::Color{0U, 0U, 255U}.getIntValueRaw());
+    }
+
+    SECTION("ETC2 planar mode")
+    {
+        // the differential mode with blue out of range, the origin and the vertical color are (130, 129, 130)
+        // and the horizontal color is (146, 129, 130)
+        std::uint64_t bits = (std::uint64_t{32} << 57) | (std::uint64_t{1} << 56) | (std::uint64_t{1} << 48) |
+            (std::uint64_t{1} << 42) | (std::uint64_t{1} << 33) |
+            (std::uint64_t{36 >> 1} << 34) | (std::uint64_t{64} << 25) | (std::uint64_t{32} << 19) |
+            (std::uint64_t{32} << 13) | (std::uint64_t{64} << 6) | std::uint64_t{32};
+
+        std::vector<std::uint8_t> block(8);
+        for (std::size_t i = 0; i < 8; ++i)
+            block[i] = static_cast<std::uint8_t>(bits >> (56 - i * 8));
+
+        sr::Texture texture{sr::PixelFormat::etc2, 4, 4};
+        texture.setData(block);
+
+        for (std::size_t y = 0; y < 4; ++y)
+            for (std::size_t x = 0; x < 4; ++x)
+                REQUIRE(texture.getPixel(x, y, 0).getIntValueRaw() ==
+                        sr::Color{static_cast<std::uint32_t>(130 + x * 4), 129U, 130U}.getIntValueRaw());
+    }
+
+    // T and H blocks with the differential bit and the pixel (x, y) using the paint color (x + y) % 4, whose
+    // index bits are at x * 4 + y (low bit) and 16 + x * 4 + y (high bit)
+    const auto getPaintBlock = [](std::uint64_t bits) {
+        bits |= std::uint64_t{1} << 33;
+        for (std::size_t x = 0; x < 4; ++x)
+            for (std::size_t y = 0; y < 4; ++y)
+            {
+                const auto index = (x + y) % 4;
+                bits |= std::uint64_t{index & 1} << (x * 4 + y);
+                bits |= std::uint64_t{index >> 1} << (16 + x * 4 + y);
+            }
+
+        std::vector<std::uint8_t> block(8);
+        for (std::size_t i = 0; i < 8; ++i)
+            block[i] = static_cast<std::uint8_t>(bits >> (56 - i * 8));
+        return block;
+    };
+
+    const auto checkPaintColors = [](const std::vector<std::uint8_t>& block, const std::array<sr::Color, 4>& paintColors) {
+        sr::Texture texture{sr::PixelFormat::etc2, 4, 4};
+        texture.setData(block);
+
+        for (std::size_t y = 0; y < 4; ++y)
+            for (std::size_t x = 0; x < 4; ++x)
+                REQUIRE(texture.getPixel(x, y, 0).getIntValueRaw() == paintColors[(x + y) % 4].getIntValueRaw());
+    };
+
+    SECTION("ETC2 T mode")
+    {
+        // red out of range: the bits 63-61 are set, so red (63-59) is 30 and its delta (58-56) is 2. The first
+        // color (R 60-59 and 57-56, G 55-52, B 51-48) is (0xA, 0x5, 0xC), the second (47-44, 43-40, 39-36) is
+        // (0x3, 0x8, 0x6), the distance index (35-34 and 32) is 5, so the distance is 32
+        const auto block = getPaintBlock((std::uint64_t{0x7} << 61) | (std::uint64_t{0x2} << 59) | (std::uint64_t{0x2} << 56) |
+                                         (std::uint64_t{0x5} << 52) | (std::uint64_t{0xC} << 48) |
+                                         (std::uint64_t{0x3} << 44) | (std::uint64_t{0x8} << 40) | (std::uint64_t{0x6} << 36) |
+                                         (std::uint64_t{0x2} << 34) | (std::uint64_t{1} << 32));
+
+        // the first color, the second one plus the distance, the second one and the second one minus the distance
+        checkPaintColors(block, {sr::Color{170U, 85U, 204U}, sr::Color{83U, 168U, 134U},
+                                 sr::Color{51U, 136U, 102U}, sr::Color{19U, 104U, 70U}});
+    }
+
+    SECTION("ETC2 H mode")
+    {
+        // Green out of range with red in range. The first color is R 62-59, G 58-56 and 52, B 51 and 49-47. The
+        // second color is 46-43, 42-39, 38-35. The distance index is formed from bit 34, bit 32 and whether the
+        // first color is at least the second one (as 12-bit RGB).
+        // (0x9, 0x4, 0xB) and (0x2, 0xD, 0x7): red is 9 + 2 and green (55-51) is 1 with the delta (50-48) -3
+        const auto greaterFirst = getPaintBlock((std::uint64_t{0x9} << 59) | (std::uint64_t{0x2} << 56) |
+                                                (std::uint64_t{1} << 51) | (std::uint64_t{1} << 50) | (std::uint64_t{0x3} << 47) |
+                                                (std::uint64_t{0x2} << 43) | (std::uint64_t{0xD} << 39) | (std::uint64_t{0x7} << 35) |
+                                                (std::uint64_t{1} << 34));
+
+        // the index 0b101 is distance 32: the first color plus and minus it, then the second one
+        checkPaintColors(greaterFirst, {sr::Color{185U, 100U, 219U}, sr::Color{121U, 36U, 155U},
+                                        sr::Color{66U, 253U, 151U}, sr::Color{2U, 189U, 87U}});
+
+        // the same colors swapped: red is 2 - 2 and green is 30 with the delta 3, the index 0b100 is distance 23
+        const auto lessFirst = getPaintBlock((std::uint64_t{0x2} << 59) | (std::uint64_t{0x6} << 56) |
+                                             (std::uint64_t{0x7} << 53) | (std::uint64_t{1} << 52) | (std::uint64_t{0x7} << 47) |
+                                             (std::uint64_t{0x9} << 43) | (std::uint64_t{0x4} << 39) | (std::uint64_t{0xB} << 35) |
+                                             (std::uint64_t{1} << 34));
+
+        checkPaintColors(lessFirst, {sr::Color{57U, 244U, 142U}, sr::Color{11U, 198U, 96U},
+                                     sr::Color{176U, 91U, 210U}, sr::Color{130U, 45U, 164U}});
+    }
+}
+
+TEST_CASE("Block-compressed textures stay close to their sources", "[texture]")
+{
+    // a two-color gradient with partial blocks and fading alpha
+    constexpr std::size_t width = 13;
+    constexpr std::size_t height = 10;
+
+    sr::Texture source{sr::PixelFormat::rgba8, width, height, true};
+    std::vector<std::uint8_t> data(width * height * 4);
+    for (std::size_t y = 0; y < height; ++y)
+        for (std::size_t x = 0; x < width; ++x)
+        {
+            const auto t = static_cast<float>(x + y) / static_cast<float>(width + height - 2);
+            data[(y * width + x) * 4 + 0] = static_cast<std::uint8_t>(200.0F + (30.0F - 200.0F) * t);
+            data[(y * width + x) * 4 + 1] = static_cast<std::uint8_t>(40.0F + (220.0F - 40.0F) * t);
+            data[(y * width + x) * 4 + 2] = static_cast<std::uint8_t>(90.0F + (160.0F - 90.0F) * t);
+            data[(y * width + x) * 4 + 3] = static_cast<std::uint8_t>(255.0F - 200.0F * t);
+        }
+    source.setData(data);
+    source.generateMipMaps();
+
+    for (const auto& [pixelFormat, tolerance] : {std::pair<sr::PixelFormat, float>{sr::PixelFormat::bc1, 16.0F},
+                                                 std::pair<sr::PixelFormat, float>{sr::PixelFormat::bc3, 16.0F},
+                                                 std::pair<sr::PixelFormat, float>{sr::PixelFormat::bc4, 4.0F},
+                                                 std::pair<sr::PixelFormat, float>{sr::PixelFormat::etc2, 24.0F}})
+    {
+        const auto texture = sr::compressTexture(source, pixelFormat);
+        REQUIRE(texture.getLevelCount() == source.getLevelCount());
+        REQUIRE(texture.getData().size() == 4 * 3 * sr::getBlockSize(pixelFormat));
+
+        // the blocks of the smaller levels span most of the gradient, which ETC2 can not follow in chroma
+        for (std::size_t y = 0; y < height; ++y)
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                const auto expected = source.getPixel(x, y, 0);
+                const auto color = texture.getPixel(x, y, 0);
+
+                // BC1 has 1-bit alpha, with transparent black
+                if (pixelFormat == sr::PixelFormat::bc1 && expected.a < 0.5F)
+                {
+                    REQUIRE(color.getIntValueRaw() == 0);
+                    continue;
+                }
+
+                const auto margin = tolerance / 255.0F;
+                REQUIRE(color.r == Approx(expected.r).margin(margin));
+                if (pixelFormat == sr::PixelFormat::bc4) continue;
+
+                REQUIRE(color.g == Approx(expected.g).margin(margin));
+                REQUIRE(color.b == Approx(expected.b).margin(margin));
+                if (pixelFormat == sr::PixelFormat::bc3)
+                    REQUIRE(color.a == Approx(expected.a).margin(margin));
+            }
+
+        // sampler bindings read the blocks through the texture
+        sr::Sampler sampler;
+        sampler.filter = sr::Sampler::Filter::trilinear;
+        const sr::SamplerBinding binding{texture, sampler};
+
+        for (std::size_t i = 0; i < 50; ++i)
+        {
+            const sr::Vector<float, 2> coord{static_cast<float>(i) * 0.021F, static_cast<float>(i) * 0.017F};
+            const sr::Vector<float, 2> ddx{static_cast<float>(i % 10) * 0.02F, 0.0F};
+            const sr::Vector<float, 2> ddy{0.0F, 0.05F};
+
+            const auto expected = texture.sample(&sampler, coord, ddx, ddy);
+            const auto color = binding.sample(coord, ddx, ddy);
+            REQUIRE(color.r == expected.r);
+            REQUIRE(color.g == expected.g);
+            REQUIRE(color.b == expected.b);
+            REQUIRE(color.a == expected.a);
+        }
+    }
+}
+
+// run with: ./test "[benchmark]"
+TEST_CASE("Bilinear sampling throughput of the texture layouts", "[.][benchmark]")
+{
+    // the samples step by a texel and cover more texels than fit into the caches
+    constexpr std::size_t textureSize = 2048;
+    constexpr std::size_t sampleCount = 1024;
+    const auto data = getRandomTexels(textureSize * textureSize * 4);
+
+    sr::Sampler sampler;
+    sampler.filter = sr::Sampler::Filter::linear;
+    sampler.addressModeX = sr::Sampler::AddressMode::repeat;
+    sampler.addressModeY = sr::Sampler::AddressMode::repeat;
+
+    for (const auto layout : {sr::Texture::Layout::linear, sr::Texture::Layout::tiled})
+    {
+        sr::Texture texture{sr::PixelFormat::rgba8, textureSize, textureSize, false, layout};
+        texture.setData(data);
+
+        for (const auto degrees : {0, 30, 45, 60, 90})
+        {
+            const auto angle = static_cast<float>(degrees) * sr::tau<float> / 360.0F;
+            const auto step = 1.0F / static_cast<float>(textureSize);
+            const sr::Vector<float, 2> stepX{std::cos(angle) * step, std::sin(angle) * step};
+            const sr::Vector<float, 2> stepY{-std::sin(angle) * step, std::cos(angle) * step};
+
+            BENCHMARK((layout == sr::Texture::Layout::linear ? "linear, " : "tiled, ") + std::to_string(degrees) + " degrees")
+            {
+                float sum = 0.0F;
+                for (std::size_t y = 0; y < sampleCount; ++y)
+                    for (std::size_t x = 0; x < sampleCount; ++x)
+                    {
+                        const sr::Vector<float, 2> coord{
+                            0.25F + stepX.v[0] * static_cast<float>(x) + stepY.v[0] * static_cast<float>(y),
+                            0.25F + stepX.v[1] * static_cast<float>(x) + stepY.v[1] * static_cast<float>(y)
+                        };
+                        sum += texture.sample(&sampler, coord).r;
+                    }
+                return sum;
+            };
+        }
+    }
 }